@@ -198,11 +198,13 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime) {
   // nTime is not updated here, to avoid leaking information about
   // currently-connected peers.
 
+  fSnapshotStale = true;
+
   // if it is already in the tried set, don't do anything else
   if (info.fInTried) return;
 
   // find a bucket it is in now
-  int nRnd = GetRandInt(ADDRMAN_NEW_BUCKET_COUNT);
+  int nRnd = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
   int nUBucket = -1;
   for (uint32_t n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
     int nB = (n + nRnd) % ADDRMAN_NEW_BUCKET_COUNT;
@@ -223,16 +225,17 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime) {
   MakeTried(info, nId);
 }
 
-bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty) {
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, int64_t nNow) {
   if (!addr.IsRoutable()) return false;
 
+  fSnapshotStale = true;
   bool fNew = false;
   int nId;
   CAddrInfo* pinfo = Find(addr, &nId);
 
   if (pinfo) {
     // periodically update nTime
-    bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
+    bool fCurrentlyOnline = (nNow - addr.nTime < 24 * 60 * 60);
     int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
     if (addr.nTime && (!pinfo->nTime || pinfo->nTime < addr.nTime - nUpdateInterval - nTimePenalty))
       pinfo->nTime = max((int64_t)0, addr.nTime - nTimePenalty);
@@ -252,7 +255,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     // stochastic test: previous nRefCount == N: 2^N times harder to increase it
     int nFactor = 1;
     for (int n = 0; n < pinfo->nRefCount; n++) nFactor *= 2;
-    if (nFactor > 1 && (GetRandInt(nFactor) != 0)) return false;
+    if (nFactor > 1 && (insecure_rand.randrange(nFactor) != 0)) return false;
   } else {
     pinfo = Create(addr, source, &nId);
     pinfo->nTime = max((int64_t)0, (int64_t)pinfo->nTime - nTimePenalty);
@@ -266,7 +269,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
     if (!fInsert) {
       CAddrInfo& infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
-      if (infoExisting.IsTerrible() || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
+      if (infoExisting.IsTerrible(nNow) || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
         // Overwrite the existing new table entry.
         fInsert = true;
       }
@@ -296,39 +299,58 @@ void CAddrMan::Attempt_(const CService& addr, int64_t nTime) {
   // update info
   info.nLastTry = nTime;
   info.nAttempts++;
+  fSnapshotStale = true;
 }
 
-CAddress CAddrMan::Select_() {
-  if (size() == 0) return CAddress();
-
-  // Use a 50% chance for choosing between tried and new table entries.
-  if (nTried > 0 && (nNew == 0 || GetRandInt(2) == 0)) {
-    // use a tried node
-    double fChanceFactor = 1.0;
-    while (true) {
-      int nKBucket = GetRandInt(ADDRMAN_TRIED_BUCKET_COUNT);
-      int nKBucketPos = GetRandInt(ADDRMAN_BUCKET_SIZE);
-      if (vvTried[nKBucket][nKBucketPos] == -1) continue;
-      int nId = vvTried[nKBucket][nKBucketPos];
-      assert(mapInfo.count(nId) == 1);
-      CAddrInfo& info = mapInfo[nId];
-      if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30)) return info;
-      fChanceFactor *= 1.2;
-    }
-  } else {
-    // use a new node
-    double fChanceFactor = 1.0;
-    while (1) {
-      int nUBucket = GetRandInt(ADDRMAN_NEW_BUCKET_COUNT);
-      int nUBucketPos = GetRandInt(ADDRMAN_BUCKET_SIZE);
-      if (vvNew[nUBucket][nUBucketPos] == -1) continue;
-      int nId = vvNew[nUBucket][nUBucketPos];
-      assert(mapInfo.count(nId) == 1);
-      CAddrInfo& info = mapInfo[nId];
-      if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30)) return info;
-      fChanceFactor *= 1.2;
+// Selection from a snapshot runs without cs, so it draws from a generator of its own thread
+static FastRandomContext& SelectRand() {
+  static thread_local FastRandomContext rand;
+  return rand;
+}
+
+std::shared_ptr<const CAddrManSnapshot> CAddrMan::MakeSnapshot_() const {
+  auto snap = std::make_shared<CAddrManSnapshot>();
+  snap->vInfo.reserve(vRandom.size());
+  for (int nId : vRandom) snap->vInfo.push_back(mapInfo.at(nId));
+  // nRandomPos is the entry's index in vRandom, and so in vInfo
+  for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++)
+    for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++)
+      if (vvTried[n][i] != -1) snap->vTriedSlots.push_back(mapInfo.at(vvTried[n][i]).nRandomPos);
+  for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++)
+    for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++)
+      if (vvNew[n][i] != -1) snap->vNewSlots.push_back(mapInfo.at(vvNew[n][i]).nRandomPos);
+  return snap;
+}
+
+std::shared_ptr<const CAddrManSnapshot> CAddrMan::GetSnapshot() {
+  // Copying the tables is paid once per read after a change, never once per addr message
+  if (fSnapshotStale) {
+    LOCK(cs);
+    if (fSnapshotStale) {
+      Check();
+      std::atomic_store(&snapshot, MakeSnapshot_());
+      fSnapshotStale = false;
     }
   }
+  return std::atomic_load(&snapshot);
+}
+
+CAddress CAddrMan::Select_(const CAddrManSnapshot& snap) {
+  if (snap.vTriedSlots.empty() && snap.vNewSlots.empty()) return CAddress();
+
+  FastRandomContext& rand = SelectRand();
+  int64_t nNow = GetAdjustedTime();
+
+  // Use a 50% chance for choosing between tried and new table entries. Picking among the occupied slots gives each
+  // the chance it has of being hit by a random probe of the whole table.
+  bool fTried = !snap.vTriedSlots.empty() && (snap.vNewSlots.empty() || rand.randbool());
+  const std::vector<uint32_t>& vSlots = fTried ? snap.vTriedSlots : snap.vNewSlots;
+  double fChanceFactor = 1.0;
+  while (true) {
+    const CAddrInfo& info = snap.vInfo[vSlots[rand.randrange(vSlots.size())]];
+    if (rand.randbits(30) < fChanceFactor * info.GetChance(nNow) * (1 << 30)) return info;
+    fChanceFactor *= 1.2;
+  }
 }
 
 #ifdef DEBUG_ADDRMAN
@@ -388,20 +410,26 @@ int CAddrMan::Check_() {
 }
 #endif
 
-void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr) {
-  uint32_t nNodes = ADDRMAN_GETADDR_MAX_PCT * vRandom.size() / 100;
+void CAddrMan::GetAddr_(const CAddrManSnapshot& snap, std::vector<CAddress>& vAddr) {
+  uint32_t nNodes = ADDRMAN_GETADDR_MAX_PCT * snap.vInfo.size() / 100;
   if (nNodes > ADDRMAN_GETADDR_MAX) nNodes = ADDRMAN_GETADDR_MAX;
 
-  // gather a list of random nodes, skipping those of low quality
-  for (uint32_t n = 0; n < vRandom.size(); n++) {
+  FastRandomContext& rand = SelectRand();
+  int64_t nNow = GetAdjustedTime();
+  vAddr.reserve(nNodes);
+
+  // gather a list of random nodes, skipping those of low quality, by shuffling an index of the snapshot as far as
+  // needed
+  std::vector<uint32_t> vOrder(snap.vInfo.size());
+  for (uint32_t n = 0; n < vOrder.size(); n++) vOrder[n] = n;
+  for (uint32_t n = 0; n < vOrder.size(); n++) {
     if (vAddr.size() >= nNodes) break;
 
-    int nRndPos = GetRandInt(vRandom.size() - n) + n;
-    SwapRandom(n, nRndPos);
-    assert(mapInfo.count(vRandom[n]) == 1);
+    uint32_t nRndPos = rand.randrange(vOrder.size() - n) + n;
+    std::swap(vOrder[n], vOrder[nRndPos]);
 
-    const CAddrInfo& ai = mapInfo[vRandom[n]];
-    if (!ai.IsTerrible()) vAddr.push_back(ai);
+    const CAddrInfo& ai = snap.vInfo[vOrder[n]];
+    if (!ai.IsTerrible(nNow)) vAddr.push_back(ai);
   }
 }
 
@@ -418,5 +446,8 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime) {
 
   // update info
   int64_t nUpdateInterval = 20 * 60;
-  if (nTime - info.nTime > nUpdateInterval) info.nTime = nTime;
+  if (nTime - info.nTime > nUpdateInterval) {
+    info.nTime = nTime;
+    fSnapshotStale = true;
+  }
 }
@@ -14,9 +14,12 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -151,6 +154,19 @@ class CAddrInfo : public CAddress {
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+/**
+ * Immutable copy of the address tables, which Select and GetAddr read without taking the addrman lock. The slot lists
+ * index vInfo once per occupied bucket slot, so an entry in several "new" buckets is picked as often as in the tables.
+ */
+struct CAddrManSnapshot {
+  //! every entry, in vRandom order
+  std::vector<CAddrInfo> vInfo;
+  //! the entry in each occupied "tried" bucket slot
+  std::vector<uint32_t> vTriedSlots;
+  //! the entry in each occupied "new" bucket slot
+  std::vector<uint32_t> vNewSlots;
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -166,7 +182,7 @@ class CAddrMan {
   int nIdCount;
 
   //! table with information about all nIds
-  std::map<int, CAddrInfo> mapInfo;
+  std::unordered_map<int, CAddrInfo> mapInfo;
 
   //! find an nId based on its network address
   std::map<CNetAddr, int> mapAddr;
@@ -186,6 +202,15 @@ class CAddrMan {
   //! list of "new" buckets
   int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+  //! randomness for bucket and entry selection, only used while holding cs
+  FastRandomContext insecure_rand;
+
+  //! tables as of the last read after a change, swapped under cs and read with std::atomic_load
+  std::shared_ptr<const CAddrManSnapshot> snapshot;
+
+  //! set under cs whenever the tables change, so the next reader takes a fresh snapshot
+  std::atomic<bool> fSnapshotStale{true};
+
  protected:
   //! Find an entry.
   CAddrInfo* Find(const CNetAddr& addr, int* pnId = nullptr);
@@ -210,14 +235,19 @@ class CAddrMan {
   void Good_(const CService& addr, int64_t nTime);
 
   //! Add an entry to the "new" table.
-  bool Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty);
+  bool Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, int64_t nNow);
 
   //! Mark an entry as attempted to connect.
   void Attempt_(const CService& addr, int64_t nTime);
 
+  //! Copy the tables for readers.
+  std::shared_ptr<const CAddrManSnapshot> MakeSnapshot_() const;
+
+  //! Return the current snapshot, taking a fresh one under cs if the tables changed since the last.
+  std::shared_ptr<const CAddrManSnapshot> GetSnapshot();
+
   //! Select an address to connect to.
-  //! nUnkBias determines how much to favor new addresses over tried ones (min=0, max=100)
-  CAddress Select_();
+  static CAddress Select_(const CAddrManSnapshot& snap);
 
 #ifdef DEBUG_ADDRMAN
   //! Perform consistency check. Returns an error code or zero.
@@ -225,7 +255,7 @@ class CAddrMan {
 #endif
 
   //! Select several addresses at once.
-  void GetAddr_(std::vector<CAddress>& vAddr);
+  static void GetAddr_(const CAddrManSnapshot& snap, std::vector<CAddress>& vAddr);
 
   //! Mark an entry as currently-connected-to.
   void Connected_(const CService& addr, int64_t nTime);
@@ -272,9 +302,10 @@ class CAddrMan {
 
     int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
     s << nUBuckets;
-    std::map<int, int> mapUnkIds;
+    std::unordered_map<int, int> mapUnkIds;
+    mapUnkIds.reserve(mapInfo.size());
     int nIds = 0;
-    for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
       mapUnkIds[(*it).first] = nIds;
       const CAddrInfo& info = (*it).second;
       if (info.nRefCount) {
@@ -284,7 +315,7 @@ class CAddrMan {
       }
     }
     nIds = 0;
-    for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
       const CAddrInfo& info = (*it).second;
       if (info.fInTried) {
         assert(nIds != nTried);  // this means nTried was wrong, oh ow
@@ -386,9 +417,9 @@ class CAddrMan {
 
     // Prune new entries with refcount 0 (as a result of collisions).
     int nLostUnk = 0;
-    for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end();) {
+    for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end();) {
       if (it->second.fInTried == false && it->second.nRefCount == 0) {
-        std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+        std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
         Delete(itCopy->first);
         nLostUnk++;
       } else {
@@ -417,6 +448,7 @@ class CAddrMan {
     nIdCount = 0;
     nTried = 0;
     nNew = 0;
+    fSnapshotStale = true;
   }
 
   CAddrMan() { Clear(); }
@@ -443,7 +475,7 @@ class CAddrMan {
     {
       LOCK(cs);
       Check();
-      fRet |= Add_(addr, source, nTimePenalty);
+      fRet |= Add_(addr, source, nTimePenalty, GetAdjustedTime());
       Check();
     }
     if (fRet)
@@ -452,14 +484,16 @@ class CAddrMan {
     return fRet;
   }
 
-  //! Add multiple addresses.
+  //! Add multiple addresses, such as a whole addr message, under a single lock acquisition.
   bool Add(const std::vector<CAddress>& vAddr, const CNetAddr& source, int64_t nTimePenalty = 0) {
     int nAdd = 0;
+    int64_t nNow = GetAdjustedTime();
     {
       LOCK(cs);
+      mapInfo.reserve(mapInfo.size() + vAddr.size());
       Check();
       for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-        nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        nAdd += Add_(*it, source, nTimePenalty, nNow) ? 1 : 0;
       Check();
     }
     if (nAdd)
@@ -488,30 +522,13 @@ class CAddrMan {
     }
   }
 
-  /**
-   * Choose an address to connect to.
-   * nUnkBias determines how much "new" entries are favored over "tried" ones (0-100).
-   */
-  CAddress Select() {
-    CAddress addrRet;
-    {
-      LOCK(cs);
-      Check();
-      addrRet = Select_();
-      Check();
-    }
-    return addrRet;
-  }
+  //! Choose an address to connect to. Reads the snapshot, so it only waits for cs after the tables changed.
+  CAddress Select() { return Select_(*GetSnapshot()); }
 
-  //! Return a bunch of addresses, selected at random.
+  //! Return a bunch of addresses, selected at random, from the snapshot.
   std::vector<CAddress> GetAddr() {
-    Check();
     std::vector<CAddress> vAddr;
-    {
-      LOCK(cs);
-      GetAddr_(vAddr);
-    }
-    Check();
+    GetAddr_(*GetSnapshot(), vAddr);
     return vAddr;
   }
 
@@ -93,3 +93,36 @@ class CBloomFilter {
   //! Checks for empty and full filters to avoid wasting cpu
   void UpdateEmptyFull();
 };
+
+/**
+ * RollingBloomFilter is a probabilistic "keep track of most recently inserted" set.
+ * Construct it with the number of items to keep track of, and a false-positive
+ * rate. Unlike CBloomFilter, by default nTweak is set to a cryptographically
+ * secure random value for you.
+ *
+ * It needs around 1.8 bytes per element per factor 0.1 of false positive rate,
+ * and uses a fixed amount of memory regardless of how many items are inserted.
+ * (More accurately: 3/(log(256)*log(2)) * log(1/fpRate) * nElements bytes)
+ */
+class CRollingBloomFilter {
+ public:
+  // A random bloom filter calls GetRand() at creation time.
+  // Don't create global CRollingBloomFilter objects, as they may be
+  // constructed before the randomizer is properly initialized.
+  CRollingBloomFilter(uint32_t nElements, double nFPRate);
+
+  void insert(const std::vector<uint8_t>& vKey);
+  void insert(const uint256& hash);
+  bool contains(const std::vector<uint8_t>& vKey) const;
+  bool contains(const uint256& hash) const;
+
+  void reset();
+
+ private:
+  int nEntriesPerGeneration;
+  int nEntriesThisGeneration;
+  int nGeneration;
+  std::vector<uint64_t> data;
+  uint32_t nTweak;
+  int nHashFuncs;
+};
@@ -29,11 +29,24 @@ static const uint32_t STANDARD_LOCKTIME_VERIFY_FLAGS = LOCKTIME_VERIFY_SEQUENCE
 static const uint32_t MAX_BLOCK_SIZE_CURRENT = 2000000;
 static const uint32_t MAX_BLOCK_SIZE_LEGACY = 1000000;
 
-/** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
+/** Default for -blockmaxsize, which controls the maximum size of block the mining code will create **/
 static const uint32_t DEFAULT_BLOCK_MAX_SIZE = 750000;
-static const uint32_t DEFAULT_BLOCK_MIN_SIZE = 0;
+/** Seconds a full block template keeps turning new transactions away before it is rebuilt from the whole mempool */
+static const int64_t BLOCK_TEMPLATE_REFRESH_INTERVAL = 30;
+/** Number of future timestamps each stake input is hashed against per staking round */
+static const uint32_t STAKE_HASH_DRIFT = 30;
+/** Number of kernel hashes evaluated per batch while searching for a stake */
+static const size_t STAKE_KERNEL_BATCH = 256;
+/** Seconds the staking thread sleeps when only a new tip or wallet change can give it something to do */
+static const int64_t STAKE_IDLE_WAIT = 60;
+/** Nonces the proof-of-work search splits between its threads before the template needs a new extra nonce */
+static const uint32_t MINER_NONCE_RANGE = 0xffff0000;
+/** Milliseconds between the proof-of-work coordinator's checks on the template, block time and hash meter */
+static const int64_t MINER_POLL_INTERVAL = 1000;
 /** Default for -blockprioritysize, maximum space for zero/low-fee transactions **/
 static const uint32_t DEFAULT_BLOCK_PRIORITY_SIZE = 50000;
+/** Transactions in a block from which its merkle root is computed on several threads */
+static const size_t MERKLE_PARALLEL_MIN_LEAVES = 2048;
 /** The maximum size for transactions we're willing to relay/mine */
 static const uint32_t MAX_STANDARD_TX_SIZE = 100000;
 static const uint32_t MAX_ZEROCOIN_TX_SIZE = 150000;
@@ -45,6 +58,14 @@ static const uint32_t MAX_P2SH_SIGOPS = 15;
 /** The maximum number of sigops we're willing to relay/mine in a single tx */
 static const uint32_t MAX_TX_SIGOPS_CURRENT = MAX_BLOCK_SIGOPS_CURRENT / 5;
 static const uint32_t MAX_TX_SIGOPS_LEGACY = MAX_BLOCK_SIGOPS_LEGACY / 5;
+/** Default for -maxmempool, maximum megabytes of memory the transaction pool may use */
+static const uint32_t DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Maximum number of in-mempool ancestors (including itself) a transaction may have */
+static const uint32_t MEMPOOL_ANCESTOR_LIMIT = 25;
+/** Maximum number of in-mempool descendants (including itself) a mempool transaction may have */
+static const uint32_t MEMPOOL_DESCENDANT_LIMIT = 25;
+/** Default for -persistmempool, dump the mempool to mempool.dat on shutdown and reload it on startup */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const uint32_t DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** The maximum size of a blk?????.dat file (since 0.8) */
@@ -53,12 +74,44 @@ static const uint32_t MAX_BLOCKFILE_SIZE = 0x8000000;  // 128 MiB
 static const uint32_t BLOCKFILE_CHUNK_SIZE = 0x1000000;  // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const uint32_t UNDOFILE_CHUNK_SIZE = 0x100000;  // 1 MiB
+/** Initial map size of the LMDB key-value databases, doubled whenever a write finds the map full */
+static const size_t DB_INITIAL_MAP_SIZE = 0xa00000;  // 10 MiB
+/** Blocks a wallet rescan reads ahead on several threads, then applies under one lock and database transaction */
+static const size_t WALLET_RESCAN_WINDOW_BLOCKS = 128;
+/** Wallet records read off the database cursor before their transactions are parsed in parallel */
+static const size_t WALLET_LOAD_CHUNK = 8192;
+/** Fewest wallet transactions worth handing to another thread while loading */
+static const size_t WALLET_LOAD_MIN_TX_PER_THREAD = 256;
+/** Most keys a keypool top-up derives before storing them and taking the next run */
+static const uint32_t WALLET_KEYPOOL_TOPUP_BATCH = 1000;
+/** Fewest keypool keys worth deriving on another thread */
+static const size_t WALLET_KEYPOOL_MIN_KEYS_PER_THREAD = 16;
+/** Time deriving the wallet key from its passphrase is calibrated to take, at encryption and passphrase changes */
+static const int64_t WALLET_KDF_TARGET_MS = 250;
+/** Memory budget of the wallet passphrase derivation, halved on machines where one pass over it exceeds the target */
+static const uint32_t WALLET_KDF_MAX_MEMORY_KIB = 64 * 1024;
+/** Least memory the wallet passphrase derivation is calibrated down to */
+static const uint32_t WALLET_KDF_MIN_MEMORY_KIB = 8 * 1024;
+/** Most lanes, each filled on its own thread, the wallet passphrase derivation uses */
+static const uint32_t WALLET_KDF_MAX_LANES = 4;
+/** Most passes over its memory the wallet passphrase derivation is calibrated up to */
+static const uint32_t WALLET_KDF_MAX_PASSES = 64;
+/** Steps the branch and bound coin selection may take looking for a changeless set of inputs */
+static const uint32_t COIN_SELECTION_BNB_TRIES = 100000;
+/** Excess over the target a changeless coin selection may leave; CreateTransaction adds it to the fee */
+static const int64_t COIN_SELECTION_CHANGE_COST = COINCENT_AMOUNT;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int32_t DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int32_t MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Lower bound of the adaptive per-peer download window, however slow the peer is. */
+static const int32_t MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Seconds of transfer (on top of one round trip) the per-peer download window should cover. */
+static const uint32_t BLOCK_DOWNLOAD_TARGET_SECONDS = 2;
+/** Microseconds a block must be in flight before a peer at least twice as fast may take it over. */
+static const int64_t BLOCK_REREQUEST_MIN_AGE = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const uint32_t BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -71,6 +124,9 @@ static const uint32_t MAX_HEADERS_RESULTS = 2000;
 static const uint32_t BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const uint32_t DATABASE_WRITE_INTERVAL = 3600;
+/** Average delay (in seconds) between trickled transaction inventory announcements to inbound peers.
+ *  Outbound peers get half this delay. */
+static const uint32_t INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum length of reject messages. */
 static const uint32_t MAX_REJECT_MESSAGE_LENGTH = 111;
 
@@ -243,6 +243,12 @@ ARGON2_PUBLIC const char *argon2_type2string(argon2_type type, int uppercase);
  */
 ARGON2_PUBLIC int argon2_ctx(argon2_context *context, argon2_type type);
 
+/*
+ * Name of the memory filling implementation picked for this CPU
+ * @return "ref", "sse2", "ssse3", "avx2" or "avx512f"
+ */
+ARGON2_PUBLIC const char *argon2_impl_name(void);
+
 /**
  * Hashes a password with Argon2i, producing an encoded hash
  * @param t_cost Number of iterations
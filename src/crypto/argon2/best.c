@@ -1,7 +1,55 @@
-#if defined (__x86_64__)
-#pragma message("Building Argon2 with SIMD optimisations")
-#include "opt.c"
-#else
-#pragma message("Building Argon2 without SIMD optimisations")
-#include "ref.c"
-#endif
+/*
+ * Selects the fastest fill_segment the running CPU supports. On x86_64 the
+ * SIMD variants of opt.c are compiled for each instruction set and chosen
+ * at run time, so a single binary runs everywhere without giving up
+ * AVX2/AVX-512 on machines that have them.
+ */
+
+#include "core.h"
+#include "ref.h"
+#if defined(__x86_64__)
+#include "opt.h"
+#endif
+
+typedef void (*fill_segment_fn)(const argon2_instance_t *instance,
+                                argon2_position_t position);
+
+/*
+ * The CPU feature bits are read once by __builtin_cpu_init, so picking the
+ * implementation per segment is a handful of loads and keeps this free of
+ * shared state between the lane threads.
+ */
+static fill_segment_fn select_fill_segment(const char **name) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *name = "avx512f";
+        return fill_segment_avx512f;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return fill_segment_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        *name = "ssse3";
+        return fill_segment_ssse3;
+    }
+    *name = "sse2";
+    return fill_segment_sse2;
+#else
+    *name = "ref";
+    return fill_segment_ref;
+#endif
+}
+
+void fill_segment(const argon2_instance_t *instance,
+                  argon2_position_t position) {
+    const char *name;
+    select_fill_segment(&name)(instance, position);
+}
+
+const char *argon2_impl_name(void) {
+    const char *name;
+    select_fill_segment(&name);
+    return name;
+}
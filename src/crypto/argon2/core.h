@@ -37,6 +37,8 @@ enum argon2_core_constants {
     ARGON2_BLOCK_SIZE = 1024,
     ARGON2_QWORDS_IN_BLOCK = ARGON2_BLOCK_SIZE / 8,
     ARGON2_OWORDS_IN_BLOCK = ARGON2_BLOCK_SIZE / 16,
+    ARGON2_HWORDS_IN_BLOCK = ARGON2_BLOCK_SIZE / 32,
+    ARGON2_512BIT_WORDS_IN_BLOCK = ARGON2_BLOCK_SIZE / 64,
 
     /* Number of pseudo-random values generated by one call to Blake in Argon2i
        to
@@ -214,7 +216,7 @@ void finalize(const argon2_context *context, argon2_instance_t *instance);
 
 /*
  * Function that fills the segment using previous segments also from other
- * threads
+ * threads. Dispatches to the fastest implementation the CPU supports.
  * @param context current context
  * @param instance Pointer to the current instance
  * @param position Current position
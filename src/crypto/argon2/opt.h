@@ -19,17 +19,18 @@
 #define ARGON2_OPT_H
 
 #include "core.h"
-#include <emmintrin.h>
 
 /*
- * Function fills a new memory block and optionally XORs the old block over the new one.
- * Memory must be initialized.
- * @param state Pointer to the just produced block. Content will be updated(!)
- * @param ref_block Pointer to the reference block
- * @param next_block Pointer to the block to be XORed over. May coincide with @ref_block
- * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
- * @pre all block pointers must be valid
+ * SIMD implementations of fill_segment. opt.c is built once per instruction
+ * set, each build naming its fill_segment after the target.
  */
-void fill_block(__m128i *s, const block *ref_block, block *next_block, int with_xor);
+void fill_segment_sse2(const argon2_instance_t *instance,
+                       argon2_position_t position);
+void fill_segment_ssse3(const argon2_instance_t *instance,
+                        argon2_position_t position);
+void fill_segment_avx2(const argon2_instance_t *instance,
+                       argon2_position_t position);
+void fill_segment_avx512f(const argon2_instance_t *instance,
+                          argon2_position_t position);
 
 #endif /* ARGON2_OPT_H */
@@ -0,0 +1,7 @@
+/*
+ * Argon2 optimised fill_segment built for the AVX2 instruction set.
+ * Selected at run time by best.c when the CPU supports it.
+ */
+
+#define ARGON2_FILL_SEGMENT fill_segment_avx2
+#include "opt.c"
@@ -0,0 +1,7 @@
+/*
+ * Argon2 optimised fill_segment built for the SSSE3 instruction set.
+ * Selected at run time by best.c when the CPU supports it.
+ */
+
+#define ARGON2_FILL_SEGMENT fill_segment_ssse3
+#include "opt.c"
@@ -27,8 +27,17 @@
 #include "blake2.h"
 
 
-void fill_block(const block *prev_block, const block *ref_block,
-                block *next_block, int with_xor) {
+/*
+ * Function fills a new memory block and optionally XORs the old block over the new one.
+ * @next_block must be initialized.
+ * @param prev_block Pointer to the previous block
+ * @param ref_block Pointer to the reference block
+ * @param next_block Pointer to the block to be constructed
+ * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
+ * @pre all block pointers must be valid
+ */
+static void fill_block(const block *prev_block, const block *ref_block,
+                       block *next_block, int with_xor) {
     block blockR, block_tmp;
     unsigned i;
 
@@ -78,8 +87,8 @@ static void next_addresses(block *address_block, block *input_block,
     fill_block(zero_block, address_block, address_block, 0);
 }
 
-void fill_segment(const argon2_instance_t *instance,
-                  argon2_position_t position) {
+void fill_segment_ref(const argon2_instance_t *instance,
+                      argon2_position_t position) {
     block *ref_block = NULL, *curr_block = NULL;
     block address_block, input_block, zero_block;
     uint64_t pseudo_rand, ref_index, ref_lane;
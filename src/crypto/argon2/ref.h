@@ -21,15 +21,9 @@
 #include "core.h"
 
 /*
- * Function fills a new memory block and optionally XORs the old block over the new one.
- * @next_block must be initialized.
- * @param prev_block Pointer to the previous block
- * @param ref_block Pointer to the reference block
- * @param next_block Pointer to the block to be constructed
- * @param with_xor Whether to XOR into the new block (1) or just overwrite (0)
- * @pre all block pointers must be valid
+ * Portable implementation of fill_segment
  */
-void fill_block(const block *prev_block, const block *ref_block,
-                block *next_block, int with_xor);
+void fill_segment_ref(const argon2_instance_t *instance,
+                      argon2_position_t position);
 
 #endif /* ARGON2_REF_H */
@@ -1,30 +1,80 @@
-// Copyright (c) 2009-2010 Satoshi Nakamoto
-// Copyright (c) 2009-2012 The Bitcoin developers
-// Distributed under the MIT/X11 software license, see the accompanying
-// file COPYING or http://www.opensource.org/licenses/mit-license.php.
-#pragma once
-
-#include "uint256.h"
-#include "serialize.h"
-#include "argon2/argon2.h"
-#include <vector>
-
-template<typename T1>
-inline uint256 HashArgon2d(const T1 pbegin, const T1 pend)
-{
-    uint32_t t_cost = 1; // 1 iteration
-    uint32_t m_cost = 4096; // use 4MB
-    uint32_t parallelism = 1; // 1 thread, 2 lanes
-    
-    static unsigned char pblank[1];
-    size_t pwdlen = (pend - pbegin) * sizeof(pbegin[0]);
-    
-    uint256 hash;
-    size_t hashlen = 32;
-    
-    argon2d_hash_raw(t_cost, m_cost, parallelism, (pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), pwdlen,
-                    (pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), pwdlen, (unsigned char*)&hash, hashlen);
-    
-    return hash;
-}
-
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#pragma once
+
+#include "uint256.h"
+#include "serialize.h"
+#include "argon2/argon2.h"
+#include <new>
+#include <vector>
+
+// Argon2 memory cost of the block hash, in KiB
+static const uint32_t ARGON2D_BLOCK_M_COST = 4096;
+
+// Argon2 memory for block hashing comes from a per-thread arena that is kept
+// between calls, so hashing a header does not malloc and fault in 4MB each time.
+// Argon2 still wipes the blocks before handing them back.
+inline std::vector<uint8_t>& Argon2Arena()
+{
+    static thread_local std::vector<uint8_t> arena;
+    return arena;
+}
+
+inline int Argon2ArenaAllocate(uint8_t** memory, size_t bytes)
+{
+    try {
+        std::vector<uint8_t>& arena = Argon2Arena();
+        if (arena.size() < bytes) arena.resize(bytes);
+        *memory = arena.data();
+    } catch (const std::bad_alloc&) {
+        *memory = nullptr;
+    }
+    return *memory != nullptr;
+}
+
+inline void Argon2ArenaFree(uint8_t* memory, size_t bytes)
+{
+    // The arena owns the buffer for the lifetime of the thread
+}
+
+// Fault in this thread's arena ahead of the first hash, e.g. when a miner thread starts
+inline void ReserveArgon2Arena()
+{
+    Argon2Arena().resize(ARGON2D_BLOCK_M_COST * 1024);
+}
+
+template<typename T1>
+inline uint256 HashArgon2d(const T1 pbegin, const T1 pend)
+{
+    static unsigned char pblank[1];
+    uint32_t pwdlen = (pend - pbegin) * sizeof(pbegin[0]);
+    uint8_t* pwd = (pbegin == pend ? pblank : (unsigned char*)&pbegin[0]);
+
+    uint256 hash;
+
+    argon2_context context;
+    context.out = (uint8_t*)&hash;
+    context.outlen = 32;
+    context.pwd = pwd;
+    context.pwdlen = pwdlen;
+    context.salt = pwd;
+    context.saltlen = pwdlen;
+    context.secret = nullptr;
+    context.secretlen = 0;
+    context.ad = nullptr;
+    context.adlen = 0;
+    context.t_cost = 1; // 1 iteration
+    context.m_cost = ARGON2D_BLOCK_M_COST; // use 4MB
+    context.lanes = 1; // 1 lane
+    context.threads = 1; // 1 thread
+    context.allocate_cbk = Argon2ArenaAllocate;
+    context.free_cbk = Argon2ArenaFree;
+    context.flags = ARGON2_DEFAULT_FLAGS;
+    context.version = ARGON2_VERSION_NUMBER;
+
+    argon2_ctx(&context, Argon2_d);
+
+    return hash;
+}
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,19 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 implementation for this CPU. Call once at startup,
+ *  before other threads hash. Returns a description of what was chosen. */
+std::string SHA256AutoDetect();
+
+/** Compute the double SHA-256 of `blocks` 64-byte messages, e.g. pairs of
+ *  merkle tree nodes. Writes 32 bytes per message to out. Messages are hashed
+ *  in order and each is read before its digest is written, so out may equal
+ *  in to reduce a merkle level in place. */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
+/** Compute the double SHA-256 of `blocks` messages that each fit in one
+ *  64-byte chunk, already padded by the caller. Writes 32 bytes per message
+ *  to out. */
+void SHA256DSingleBlock(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -16,13 +16,29 @@
 #include <atomic>
 #include <liblmdb/lmdb.h>
 #include <string>
+#include <vector>
+
+/** A put or erase made inside a write transaction, kept so the transaction can be replayed after the map grows */
+struct CDbWrapperOp {
+  CDataStream key;
+  CDataStream value;
+  bool fErase;
+  bool fOverwrite;
+  CDbWrapperOp(CDataStream&& keyIn, CDataStream&& valueIn, bool fEraseIn, bool fOverwriteIn)
+      : key(std::move(keyIn)), value(std::move(valueIn)), fErase(fEraseIn), fOverwrite(fOverwriteIn) {}
+};
 
 class CDbWrapper {
  protected:
   const int KEY_RESERVE = 100;
   MDB_dbi dbi = 0;
-  MDB_txn* activeTxn = nullptr;
+  MDB_txn* activeTxn = nullptr;        //! Write transaction of the open batch
+  mutable MDB_txn* readTxn = nullptr;  //! Read-only transaction, reset between reads and renewed for the next
   MDB_env* env = nullptr;
+  int nBatchDepth = 0;
+  mutable int nReaders = 0;
+  bool fBatchAbort = false;
+  std::vector<CDbWrapperOp> vBatchOps;
   bool fReadOnly;
   bool fDbEnvInit;
   std::atomic<bool> interrupt = false;
@@ -36,9 +52,22 @@ class CDbWrapper {
   void Close();
   void Interrupt();
 
-  MDB_txn* TxnBegin();
+  /** Begin a write transaction, or join the one already open. Holds cs_db until the matching commit or abort. */
+  bool TxnBegin();
+  /** Commit, once the outermost transaction ends. Returns false if it, or a nested one, failed or aborted. */
+  bool TxnCommit();
+  void TxnAbort();
+
+ protected:
   MDB_txn* ReadBegin() const;
+  void ReadEnd(MDB_txn* ptxn) const;
+  int Apply(const CDbWrapperOp& op);
+  int Replay();
+  bool GrowMap();
+  void EndBatch();
+  bool WriteOp(CDbWrapperOp&& op);
 
+ public:
   template <typename K, typename T> bool Read(const K& key, T& value) const {
     // Key
     CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -49,18 +78,20 @@ class CDbWrapper {
     datKey.mv_size = ssKey.size();
 
     // Read
+    LOCK(cs_db);
+    MDB_txn* ptxn = ReadBegin();
+    if (!ptxn) return false;
     MDB_val datValue;
-    MDB_txn* Txn = ReadBegin();
-    int dbr = mdb_get(Txn, dbi, &datKey, &datValue);
-    if (dbr) return false;
-    // Throw if ret ! = 0!!!!
-
-    // Unserialize value
-    try {
-      CDataStream ssValue((char*)datValue.mv_data, (char*)datValue.mv_data + datValue.mv_size, SER_DISK,
-                          CLIENT_VERSION);
-      ssValue >> value;
-    } catch (const std::exception&) { return false; }
+    int dbr = mdb_get(ptxn, dbi, &datKey, &datValue);
+
+    // Unserialize value in place, while the transaction keeps its pages mapped
+    if (dbr == 0) {
+      try {
+        CSpanReader ssValue(datValue.mv_data, datValue.mv_size, SER_DISK, CLIENT_VERSION);
+        ssValue >> value;
+      } catch (const std::exception&) { dbr = -1; }
+    }
+    ReadEnd(ptxn);
     return (dbr == 0);
   }
 
@@ -71,27 +102,14 @@ class CDbWrapper {
     CDataStream ssKey(SER_DISK, CLIENT_VERSION);
     ssKey.reserve(KEY_RESERVE);
     ssKey << key;
-    MDB_val datKey;
-    datKey.mv_data = &ssKey[0];
-    datKey.mv_size = ssKey.size();
 
     // Value
     CDataStream ssValue(SER_DISK, CLIENT_VERSION);
     ssValue.reserve(10000);
     ssValue << value;
-    MDB_val datValue;
-    datValue.mv_data = &ssValue[0];
-    datValue.mv_size = ssValue.size();
-
-    // Write
-    activeTxn = TxnBegin();
-    int ret = mdb_put(activeTxn, dbi, &datKey, &datValue, (fOverwrite ? 0 : MDB_NOOVERWRITE));
-    ret |= TxnCommit();
 
-    // Clear memory in case it was a private key
-    std::memset(datKey.mv_data, 0, datKey.mv_size);
-    std::memset(datValue.mv_data, 0, datValue.mv_size);
-    return (ret == 0);
+    // Write. The streams wipe themselves when freed, in case this was a private key
+    return WriteOp(CDbWrapperOp(std::move(ssKey), std::move(ssValue), false, fOverwrite));
   }
 
   template <typename K> bool Erase(const K& key) {
@@ -101,15 +119,9 @@ class CDbWrapper {
     CDataStream ssKey(SER_DISK, CLIENT_VERSION);
     ssKey.reserve(KEY_RESERVE);
     ssKey << key;
-    MDB_val datKey;
-    datKey.mv_data = &ssKey[0];
-    datKey.mv_size = ssKey.size();
 
     // Erase
-    activeTxn = TxnBegin();
-    int ret = mdb_del(activeTxn, dbi, &datKey, nullptr);
-    ret |= TxnCommit();
-    return (ret == 0 || ret == MDB_NOTFOUND);
+    return WriteOp(CDbWrapperOp(std::move(ssKey), CDataStream(SER_DISK, CLIENT_VERSION), true, true));
   }
 
   template <typename K> bool Exists(const K& key) const {
@@ -122,18 +134,28 @@ class CDbWrapper {
     datKey.mv_size = ssKey.size();
 
     // Exists
-    MDB_txn* Txn = ReadBegin();
-    int ret = mdb_get(Txn, dbi, &datKey, nullptr);
+    LOCK(cs_db);
+    MDB_txn* ptxn = ReadBegin();
+    if (!ptxn) return false;
+    MDB_val datValue;
+    int ret = mdb_get(ptxn, dbi, &datKey, &datValue);
+    ReadEnd(ptxn);
+
     // if non-zero, it doesn't exist!
     return (ret == 0);
   }
 
   MDB_cursor* GetCursor() const;
   int ReadAtCursor(MDB_cursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, uint32_t fFlags = MDB_NEXT) const;
+  /**
+   * Step the cursor and read the record in place, without a copy. The readers point into the map. For a cursor opened
+   * outside a batch they stay valid across later cursor moves until it is closed: its read-only transaction keeps the
+   * pages from being reused, and GrowMap() will not remap while it is open. A cursor opened inside a batch shares the
+   * write transaction, and its readers are only valid until the next Write or Erase.
+   */
+  int ReadAtCursor(MDB_cursor* pcursor, CSpanReader& ssKey, CSpanReader& ssValue, uint32_t fFlags = MDB_NEXT) const;
 
   bool Verify();
-  bool TxnCommit();
-  void TxnAbort();
   bool cursor_commit(MDB_cursor* pcursor);
   void cursor_close(MDB_cursor* pcursor);
 
@@ -148,3 +170,32 @@ class CDbWrapper {
   bool Exists(CDataStream& key);
   bool Erase(CDataStream& key);
 };
+
+/**
+ * Scoped write transaction: every Write and Erase on the database while it is alive lands in one LMDB
+ * transaction. Batches nest and only the outermost commits; leaving scope without Commit() aborts.
+ */
+class CDbWrapperBatch {
+  CDbWrapper& db;
+  bool fOpen;
+
+ public:
+  explicit CDbWrapperBatch(CDbWrapper& dbIn) : db(dbIn) { fOpen = db.TxnBegin(); }
+  ~CDbWrapperBatch() {
+    if (fOpen) db.TxnAbort();
+  }
+  CDbWrapperBatch(const CDbWrapperBatch&) = delete;
+  CDbWrapperBatch& operator=(const CDbWrapperBatch&) = delete;
+
+  bool Commit() {
+    if (!fOpen) return false;
+    fOpen = false;
+    return db.TxnCommit();
+  }
+  /** Commit what has been written so far and carry on in a new transaction */
+  bool Flush() {
+    bool ret = Commit();
+    fOpen = db.TxnBegin();
+    return ret && fOpen;
+  }
+};
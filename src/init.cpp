@@ -16,6 +16,8 @@
 #include "amount.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/argon2/argon2.h"
+#include "crypto/sha256.h"
 #include "ecdsa/key.h"
 #include "fs.h"
 #include "fs_utils.h"
@@ -49,6 +51,7 @@
 #include "wallet/wallettx.h"
 #include "zerocoin/accumulators.h"
 
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <thread>
@@ -88,6 +91,8 @@ const std::string strWalletFile = "data.mdb";
 volatile bool fRestartRequested = false;  // true: restart false: shutdown
 extern std::list<uint256> listAccCheckpointsNoDB;
 static bool fDisableWallet = false;
+//! Only dump mempool.dat once it has been loaded, so an early shutdown cannot clobber it with a partial pool
+static std::atomic<bool> fDumpMempoolLater(false);
 
 #if ENABLE_ZMQ
 static CZMQNotificationInterface* pzmqNotificationInterface = nullptr;
@@ -235,6 +240,8 @@ void PrepareShutdown(CScheduler& scheduler) {
 
   UnregisterNodeSignals(GetNodeSignals());
 
+  if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) DumpMempool();
+
   {
     LOCK(cs_main);
     if (gpCoinsTip != nullptr) {
@@ -366,6 +373,9 @@ std::string HelpMessage(HelpMessageMode mode) {
       HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
   strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"),
                                                         Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
+  strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes "
+                                                           "(default: %u)"),
+                                                         DEFAULT_MAX_MEMPOOL_SIZE));
   strUsage += HelpMessageOpt("-maxorphantx=<n>",
                              strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"),
                                        DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -376,6 +386,9 @@ std::string HelpMessage(HelpMessageMode mode) {
 #ifndef WIN32
   strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "tessad.pid"));
 #endif
+  strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on "
+                                                            "restart (default: %u)"),
+                                                          DEFAULT_PERSIST_MEMPOOL));
   strUsage += HelpMessageOpt("-reindex",
                              _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
   strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
@@ -606,7 +619,6 @@ std::string HelpMessage(HelpMessageMode mode) {
   }
 
   strUsage += HelpMessageGroup(_("Block creation options:"));
-  strUsage += HelpMessageOpt("-blockminsize=<n>", strprintf(_("Set minimum block size in bytes (default: %u)"), 0));
   strUsage += HelpMessageOpt("-blockmaxsize=<n>",
                              strprintf(_("Set maximum block size in bytes (default: %d)"), DEFAULT_BLOCK_MAX_SIZE));
   strUsage +=
@@ -733,6 +745,12 @@ void ThreadImport(std::vector<fs::path> vImportFiles) {
     LogPrintf("Stopping after block import\n");
     StartShutdown();
   }
+
+  // Re-validate the saved mempool against the (now imported) chain tip
+  if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+    LoadMempool();
+    fDumpMempoolLater = !ShutdownRequested();
+  }
 }
 
 /** Sanity checks
@@ -926,6 +944,10 @@ bool AppInit2(CScheduler& scheduler) {
   fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
   Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+  // -maxmempool must leave room for at least a few full-size transactions
+  if (GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) < 5)
+    return InitError(_("Error: -maxmempool must be at least 5 MB"));
+
   // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
   nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
   if (nScriptCheckThreads <= 0) nScriptCheckThreads += std::thread::hardware_concurrency();
@@ -965,6 +987,9 @@ bool AppInit2(CScheduler& scheduler) {
   // ********************************************************* Step 4: application initialization: dir lock, daemonize,
   // pidfile, debug log
 
+  // Pick the SHA-256 implementation before anything hashes
+  std::string strSHA256Impl = SHA256AutoDetect();
+
   // Initialize elliptic curve code
   if (sodium_init() < 0) { throw string("Libsodium initialization failed."); }
   ECC_Start();
@@ -1025,6 +1050,8 @@ bool AppInit2(CScheduler& scheduler) {
   LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
   std::ostringstream strErrors;
 
+  LogPrintf("Using the '%s' SHA256 implementation\n", strSHA256Impl);
+  LogPrintf("Using the '%s' Argon2 implementation\n", argon2_impl_name());
   LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
   if (nScriptCheckThreads) {
     script_check_threads.reserve(nScriptCheckThreads - 1);
@@ -1549,7 +1576,7 @@ bool AppInit2(CScheduler& scheduler) {
       pwalletMain->SetupCrypter(passphrase);
 
       // Create new keyUser and set as default key
-      // Also setups pool of 200(?) keys -> calls TopUpKeyPool
+      // Hands out a key of its own and has the keypool filled in the background
       ecdsa::CPubKey newDefaultKey;
       if (pwalletMain->GetKeyFromPool(newDefaultKey)) {
         pwalletMain->SetDefaultKey(newDefaultKey);
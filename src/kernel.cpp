@@ -8,10 +8,14 @@
 #include "blockmap.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "coin_constants.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "script/interpreter.h"
 #include "script/standard.h"  // for const
+#include "staker.h"
 #include "streams.h"
 #include "timedata.h"
 #include "util.h"
@@ -222,11 +226,10 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight,
-                            int64_t& nStakeModifierTime, bool fPrintProofOfStake) {
+static bool GetKernelStakeModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight,
+                                   int64_t& nStakeModifierTime, const CBlockIndex*& pindexModifier) {
   nStakeModifier = 0;
-  if (!mapBlockIndex.count(hashBlockFrom)) return error("GetKernelStakeModifier() : block not indexed");
-  const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+  pindexModifier = nullptr;
   nStakeModifierHeight = pindexFrom->nHeight;
   nStakeModifierTime = pindexFrom->GetBlockTime();
   int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -252,9 +255,27 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
     }
   }
   nStakeModifier = pindex->nStakeModifier;
+  pindexModifier = pindex;
   return true;
 }
 
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight,
+                            int64_t& nStakeModifierTime, bool fPrintProofOfStake) {
+  nStakeModifier = 0;
+  if (!mapBlockIndex.count(hashBlockFrom)) return error("GetKernelStakeModifier() : block not indexed");
+  const CBlockIndex* pindexModifier;
+  return GetKernelStakeModifier(mapBlockIndex[hashBlockFrom], nStakeModifier, nStakeModifierHeight,
+                                nStakeModifierTime, pindexModifier);
+}
+
+bool GetKernelStakeModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier,
+                            const CBlockIndex*& pindexModifier) {
+  int nStakeModifierHeight = 0;
+  int64_t nStakeModifierTime = 0;
+  return GetKernelStakeModifier(pindexFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime,
+                                pindexModifier);
+}
+
 // test hash vs target
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, const arith_uint256& bnTargetPerCoinDay) {
   // get the stake weight - weight is equal to coin amount
@@ -275,54 +296,57 @@ bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t
   return stakeTargetHit(hashProofOfStake, nValueIn, bnTarget);
 }
 
-bool Stake(CStake* stakeInput, uint32_t nBits, uint32_t nTimeBlockFrom, uint32_t& nTimeTx, uint256& hashProofOfStake) {
-  if (nTimeTx < nTimeBlockFrom) return error("CheckStakeKernelHash() : nTime violation");
-
-  if (nTimeBlockFrom + Params().StakeMinAge() > nTimeTx)  // Min age requirement
-    return error("CheckStakeKernelHash() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d",
-                 nTimeBlockFrom, Params().StakeMinAge(), nTimeTx);
+CStakeKernel::CStakeKernel(uint64_t nStakeModifier, uint32_t nTimeBlockFrom, const COutPoint& prevout) {
+  // nStakeModifier << nTimeBlockFrom << (n << hash) << nTimeTx is 52 bytes, which pads to a single chunk
+  memset(vch, 0, SIZE);
+  WriteLE64(vch, nStakeModifier);
+  WriteLE32(vch + 8, nTimeBlockFrom);
+  WriteLE32(vch + 12, prevout.n);
+  memcpy(vch + 16, prevout.hash.begin(), 32);
+  vch[52] = 0x80;
+  WriteBE64(vch + 56, 52 * 8);
+}
 
-  // grab difficulty
-  arith_uint256 bnTargetPerCoinDay;
-  bnTargetPerCoinDay.SetCompact(nBits);
+bool FindStakeKernel(const vector<CStakeKernel>& vKernels, uint32_t nTimeStart, uint32_t nTimeEnd, int nHeightStart,
+                     size_t& nKernel, uint32_t& nTimeTx, uint256& hashProofOfStake) {
+  if (nTimeEnd < nTimeStart) return false;
+  const size_t nTimes = nTimeEnd - nTimeStart + 1;
+  const size_t nTries = vKernels.size() * nTimes;
 
-  // grab stake modifier
-  uint64_t nStakeModifier = 0;
-  if (!stakeInput->GetModifier(nStakeModifier)) return error("failed to get kernel stake modifier");
-
-  bool fSuccess = false;
-  uint32_t nTryTime = 0;
-  int nHeightStart = chainActive.Height();
-  int nHashDrift = 30;
-  CDataStream ssUniqueID = stakeInput->GetUniqueness();
-  CAmount nValueIn = stakeInput->GetValue();
-  for (int i = 0; i < nHashDrift; i++)  // iterate the hashing
-  {
+  vector<uint8_t> vIn(STAKE_KERNEL_BATCH * CStakeKernel::SIZE);
+  vector<uint8_t> vOut(STAKE_KERNEL_BATCH * CSHA256::OUTPUT_SIZE);
+  for (size_t nBatch = 0; nBatch < nTries; nBatch += STAKE_KERNEL_BATCH) {
     // new block came in, move on
     if (chainActive.Height() != nHeightStart) break;
 
-    // hash this iteration
-    nTryTime = nTimeTx + nHashDrift - i;
-
-    // if stake hash does not meet the target then continue to next iteration
-    if (!CheckStake(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime,
-                    hashProofOfStake))
-      continue;
-
-    fSuccess = true;  // if we make it this far then we have successfully created a stake hash
-    // LogPrintf("%s: hashproof=%s\n", __func__, hashProofOfStake.GetHex());
-    nTimeTx = nTryTime;
-    break;
+    // lay out (kernel, time) tries in the order the serial search visited them: latest time first per kernel
+    const size_t nCount = min(STAKE_KERNEL_BATCH, nTries - nBatch);
+    for (size_t i = 0; i < nCount; i++) {
+      const size_t nTry = nBatch + i;
+      uint8_t* pch = &vIn[i * CStakeKernel::SIZE];
+      memcpy(pch, vKernels[nTry / nTimes].data(), CStakeKernel::SIZE);
+      WriteLE32(pch + CStakeKernel::TIME_OFFSET, nTimeEnd - nTry % nTimes);
+    }
+    SHA256DSingleBlock(vOut.data(), vIn.data(), nCount);
+
+    for (size_t i = 0; i < nCount; i++) {
+      const size_t nTry = nBatch + i;
+      uint256 hash;
+      memcpy(hash.begin(), &vOut[i * CSHA256::OUTPUT_SIZE], CSHA256::OUTPUT_SIZE);
+      if (UintToArith256(hash) < vKernels[nTry / nTimes].bnTarget) {
+        nKernel = nTry / nTimes;
+        nTimeTx = nTimeEnd - nTry % nTimes;
+        hashProofOfStake = hash;
+        return true;
+      }
+    }
   }
-
-  mapHashedBlocks.clear();
-  mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime();  // store a time stamp of when we last hashed on this block
-  return fSuccess;
+  return false;
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, unique_ptr<CStake>& stake) {
-  const CTransaction tx = block.vtx[1];
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake, unique_ptr<CStake>& stake) {
+  const CTransaction& tx = block.vtx[1];
   if (!tx.IsCoinStake())
     return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
@@ -333,37 +357,27 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, unique_ptr
   if (tx.IsZerocoinSpend()) {
     return true;
   } else {
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-      return error("CheckProofOfStake() : INFO: read txPrev failed");
+    // The staked output and its block come from the coins view and block index, without reading blocks from disk
+    stake.reset(new CStake());
+    if (!stake->SetInput(txin.prevout)) return error("CheckProofOfStake() : INFO: read txPrev failed");
 
     // verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+    if (!VerifyScript(txin.scriptSig, stake->GetTxOut().scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
                       TransactionSignatureChecker(&tx, 0)))
       return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
-
-    auto pivInput = new CStake();
-    pivInput->SetInput(txPrev, txin.prevout.n);
-    stake = unique_ptr<CStake>(pivInput);
   }
 
   CBlockIndex* pindex = stake->GetIndexFrom();
   if (pindex == nullptr) return error("%s: Failed to find the block index", __func__);
 
-  // Read block header
-  CBlock blockprev;
-  if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-    return error("CheckProofOfStake(): INFO: failed to find block");
-
   arith_uint256 bnTargetPerCoinDay;
   bnTargetPerCoinDay.SetCompact(block.nBits);
 
   uint64_t nStakeModifier = 0;
   if (!stake->GetModifier(nStakeModifier)) return error("%s failed to get modifier for stake input\n", __func__);
 
-  uint32_t nBlockFromTime = blockprev.nTime;
+  // The header time of the block holding the input is kept in its index
+  uint32_t nBlockFromTime = pindex->nTime;
   uint32_t nTxTime = block.nTime;
   if (!CheckStake(stake->GetUniqueness(), stake->GetValue(), nStakeModifier, bnTargetPerCoinDay, nBlockFromTime,
                   nTxTime, hashProofOfStake)) {
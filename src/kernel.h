@@ -5,22 +5,53 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #pragma once
 
+#include "arith_uint256.h"
+#include "primitives/block.h"
 #include "stake.h"
-#include "staker.h"
+
+#include <memory>
+#include <vector>
 
 // Compute the hash modifier for proof-of-stake
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight,
                             int64_t& nStakeModifierTime, bool fPrintProofOfStake);
+// Same, also returning the block the modifier was taken from. pindexModifier is null while the chain is still too
+// short for the modifier to be final, in which case it must not be cached.
+bool GetKernelStakeModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier,
+                            const CBlockIndex*& pindexModifier);
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
 bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t nStakeModifier,
                 const arith_uint256& bnTarget, uint32_t nTimeBlockFrom, uint32_t& nTimeTx, uint256& hashProofOfStake);
 
-bool Stake(CStake* stakeInput, uint32_t nBits, uint32_t nTimeBlockFrom, uint32_t& nTimeTx, uint256& hashProofOfStake);
+// Kernel of one stake input serialized as CheckStake hashes it and padded to a single SHA-256 chunk,
+// so that trying another timestamp only rewrites nTimeTx at TIME_OFFSET
+class CStakeKernel {
+ public:
+  static const size_t SIZE = 64;
+  static const size_t TIME_OFFSET = 48;
+
+  CStakeKernel() {}
+  CStakeKernel(uint64_t nStakeModifier, uint32_t nTimeBlockFrom, const COutPoint& prevout);
+
+  const uint8_t* data() const { return vch; }
+
+  // Weighted target for the input's value, set once per round
+  arith_uint256 bnTarget;
+
+ private:
+  uint8_t vch[SIZE] = {};
+};
+
+// Try every kernel against the timestamps from nTimeEnd down to nTimeStart in batches. Sets nKernel, nTimeTx and
+// hashProofOfStake for the first kernel and time that meet the kernel's target. Gives up once the tip moves past
+// nHeightStart.
+bool FindStakeKernel(const std::vector<CStakeKernel>& vKernels, uint32_t nTimeStart, uint32_t nTimeEnd,
+                     int nHeightStart, size_t& nKernel, uint32_t& nTimeTx, uint256& hashProofOfStake);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStake>& stake);
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake, std::unique_ptr<CStake>& stake);
 
 // Get stake modifier checksum
 uint32_t GetStakeModifierChecksum(const CBlockIndex* pindex);
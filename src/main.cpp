@@ -23,6 +23,8 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "fs.h"
+#include "fs_utils.h"
 #include "ecdsa/blocksignature.h"
 #include "ecdsa/ecdsa.h"
 #include "init.h"
@@ -53,6 +55,7 @@
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/PublicCoin.h"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <thread>
@@ -268,6 +271,56 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex* pindex
   mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+void UpdateBlockDownloadWindow(CNodeState* state) {
+  if (state->nBlocksDelivered < 2 || state->dBlockBytesPerSec <= 0) {
+    // Not enough samples yet, so don't hold the peer back.
+    state->nBlockDownloadWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    return;
+  }
+  // Cover one round trip plus a few seconds of transfer at the rate this peer actually delivers.
+  double dSeconds = state->nPingUsecTime / 1e6 + BLOCK_DOWNLOAD_TARGET_SECONDS;
+  int nWindow = (int)ceil(state->dBlockBytesPerSec * dSeconds / std::max(state->dAvgBlockBytes, 1.0));
+  state->nBlockDownloadWindow =
+      std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min(nWindow, MAX_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
+// Requires cs_main. Account a requested block of nBytes arriving from nodeid, before it is marked as received.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, uint32_t nBytes) {
+  auto itInFlight = mapBlocksInFlight.find(hash);
+  if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) return;
+  CNodeState* state = State(nodeid);
+  if (state == nullptr) return;
+
+  // With several blocks pipelined, this one only started arriving after the previous one was done.
+  int64_t nNow = GetTimeMicros();
+  int64_t nStart = std::max(itInFlight->second.second->nTime, state->nLastBlockDelivered);
+  double dSeconds = std::max<int64_t>(nNow - nStart, 1000) / 1e6;
+  double dRate = nBytes / dSeconds;
+
+  if (state->nBlocksDelivered == 0) {
+    state->dAvgBlockBytes = nBytes;
+    state->dBlockBytesPerSec = dRate;
+  } else {
+    state->dAvgBlockBytes = 0.8 * state->dAvgBlockBytes + 0.2 * nBytes;
+    state->dBlockBytesPerSec = 0.8 * state->dBlockBytesPerSec + 0.2 * dRate;
+  }
+  state->nBlocksDelivered++;
+  state->nLastBlockDelivered = nNow;
+  UpdateBlockDownloadWindow(state);
+}
+
+/** Whether a block requested from another peer has been in flight long enough that nodeid, being much faster,
+ *  should ask for it too. Requires cs_main. */
+bool ShouldRerequestBlock(const CNodeState* state, const uint256& hash) {
+  auto itInFlight = mapBlocksInFlight.find(hash);
+  if (itInFlight == mapBlocksInFlight.end()) return false;
+  const CNodeState* stateOwner = State(itInFlight->second.first);
+  if (stateOwner == nullptr || stateOwner == state || stateOwner->nBlocksDelivered == 0) return false;
+  if (GetTimeMicros() - itInFlight->second.second->nTime < BLOCK_REREQUEST_MIN_AGE) return false;
+  return state->nBlocksDelivered > 0 && state->dBlockBytesPerSec > 2 * stateOwner->dBlockBytesPerSec;
+}
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
   CNodeState* state = State(nodeid);
@@ -393,6 +446,15 @@ void FindNextBlocksToDownload(NodeId nodeid, uint32_t count, std::vector<CBlockI
       } else if (waitingfor == -1) {
         // This is the first already-in-flight block.
         waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+        if (waitingfor != nodeid && pindex->nHeight <= nWindowEnd &&
+            ShouldRerequestBlock(state, pindex->GetBlockHash())) {
+          // It is holding up the download window and we are much faster than the peer it was asked from.
+          LogPrint(TessaLog::NET, "Re-requesting slow block %s from peer=%d (was peer=%d)\n",
+                   pindex->GetBlockHash().ToString(), nodeid, waitingfor);
+          waitingfor = nodeid;
+          vBlocks.push_back(pindex);
+          if (vBlocks.size() == count) { return; }
+        }
       }
     }
   }
@@ -410,6 +472,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) {
   for (const QueuedBlock& queue : state->vBlocksInFlight) {
     if (queue.pindex) stats.vHeightInFlight.push_back(queue.pindex->nHeight);
   }
+  stats.nBlocksDelivered = state->nBlocksDelivered;
+  stats.dBlockBytesPerSec = state->dBlockBytesPerSec;
+  stats.nBlockDownloadWindow = state->nBlockDownloadWindow;
   return true;
 }
 
@@ -967,6 +1032,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         return state.DoS(0, error("AcceptToMemoryPool : not enough fees %s, %d < %d", hash.ToString(), nFees, txMinFee),
                          REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+      // A full pool raises the bar: the fee must beat what was last evicted to make room
+      size_t nMaxMempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+      CAmount mempoolRejectFee = pool.GetMinFee(nMaxMempool) * nSize / 1000;
+      double dPriorityDelta = 0;
+      CAmount nFeeDelta = 0;
+      pool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+      if (!tx.IsZerocoinSpend() && mempoolRejectFee > 0 && nFees + nFeeDelta < mempoolRejectFee)
+        return state.DoS(0,
+                         error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d", hash.ToString(), nFees,
+                               mempoolRejectFee),
+                         REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
       // Require that free transactions have sufficient priority to be mined in the next block.
       if (tx.IsZerocoinMint()) {
         if (nFees < Params().Zerocoin_MintFee() * tx.GetZerocoinMintCount())
@@ -1003,6 +1080,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     if (fRejectInsaneFee && nFees > ::minRelayTxFee * 10000)
       return error("AcceptToMemoryPool: : insane fees %s, %d > %d", hash.ToString(), nFees, ::minRelayTxFee * 10000);
 
+    // Bound unconfirmed chains, which keeps the per-package bookkeeping in the pool cheap
+    std::set<uint256> setAncestors;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(tx, setAncestors, MEMPOOL_ANCESTOR_LIMIT, MEMPOOL_DESCENDANT_LIMIT, errString))
+      return state.DoS(0, error("AcceptToMemoryPool : %s %s", errString, hash.ToString()), REJECT_NONSTANDARD,
+                       "too-long-mempool-chain");
+
     // Check against previous transactions
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
     if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -1027,6 +1111,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // Store transaction in memory
     pool.addUnchecked(hash, entry);
+
+    // Make room if that pushed the pool over its limit; if tx itself was the cheapest it is refused
+    pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    if (!pool.exists(hash)) return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
   }
 
   SyncWithWallets(tx, nullptr);
@@ -1208,6 +1296,102 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
   return true;
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool() {
+  FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+  CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+  if (file.IsNull()) {
+    LogPrintf("%s : Failed to open mempool file from disk. Continuing anyway.\n", __func__);
+    return false;
+  }
+
+  int64_t nStart = GetTimeMillis();
+  uint32_t nAccepted = 0;
+  uint32_t nFailed = 0;
+  try {
+    uint64_t nVersion;
+    file >> nVersion;
+    if (nVersion != MEMPOOL_DUMP_VERSION) return error("%s : Unknown mempool.dat version %d", __func__, nVersion);
+
+    // Deltas first, so prioritised transactions get past the fee checks exactly as they did before the restart
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    file >> mapDeltas;
+    for (const auto& delta : mapDeltas)
+      mempool.PrioritiseTransaction(delta.first, delta.first.ToString(), delta.second.first, delta.second.second);
+
+    uint64_t nCount;
+    file >> nCount;
+    while (nCount--) {
+      CTransaction tx;
+      file >> tx;
+
+      CValidationState state;
+      bool fAccepted;
+      {
+        LOCK(cs_main);
+        fAccepted = AcceptToMemoryPool(mempool, state, tx, true, nullptr);
+      }
+      if (fAccepted)
+        ++nAccepted;
+      else
+        ++nFailed;
+      if (ShutdownRequested()) return false;
+    }
+  } catch (const std::exception& e) {
+    LogPrintf("%s : Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", __func__, e.what());
+    return false;
+  }
+
+  LogPrintf("%s : Imported %u mempool transactions from disk (%u failed) in %dms\n", __func__, nAccepted, nFailed,
+            GetTimeMillis() - nStart);
+  return true;
+}
+
+bool DumpMempool() {
+  int64_t nStart = GetTimeMillis();
+
+  // Snapshot under the lock, serialize and write outside it
+  std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+  std::vector<CTransaction> vtx;
+  {
+    LOCK(mempool.cs);
+    mapDeltas = mempool.mapDeltas;
+    // Fewest in-pool ancestors first, then oldest. Entry times only have second resolution, but a parent always has
+    // fewer ancestors than its children, so LoadMempool re-accepts it before them.
+    std::vector<const CTxMemPoolEntry*> vEntries;
+    vEntries.reserve(mempool.mapTx.size());
+    for (const auto& it : mempool.mapTx) vEntries.push_back(&it.second);
+    std::sort(vEntries.begin(), vEntries.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+      if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+      return a->GetTime() < b->GetTime();
+    });
+    vtx.reserve(vEntries.size());
+    for (const CTxMemPoolEntry* pentry : vEntries) vtx.push_back(pentry->GetTx());
+  }
+
+  fs::path pathMempool = GetDataDir() / "mempool.dat";
+  fs::path pathTmp = GetDataDir() / "mempool.dat.new";
+  FILE* filestr = fopen(pathTmp.string().c_str(), "wb");
+  CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+  if (file.IsNull()) return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+  try {
+    file << MEMPOOL_DUMP_VERSION;
+    file << mapDeltas;
+    file << (uint64_t)vtx.size();
+    for (const CTransaction& tx : vtx) file << tx;
+  } catch (const std::exception& e) { return error("%s : Serialize or I/O error - %s", __func__, e.what()); }
+  FileCommit(file.Get());
+  file.fclose();
+
+  if (!RenameOver(pathTmp, pathMempool)) return error("%s : Rename-into-place failed", __func__);
+
+  LogPrintf("%s : Dumped %u mempool transactions in %dms\n", __func__, vtx.size(), GetTimeMillis() - nStart);
+  return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow) {
   CBlockIndex* pindexSlow = nullptr;
@@ -2788,7 +2972,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
   // Check the merkle root.
   if (fCheckMerkleRoot) {
     bool mutated;
-    uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+    uint256 hashMerkleRoot2 = block.ComputeMerkleRoot(&mutated);
     if (block.hashMerkleRoot != hashMerkleRoot2)
       return state.DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"), REJECT_INVALID, "bad-txnmrklroot", true);
 
@@ -3249,6 +3433,65 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
   return true;
 }
 
+bool TestBlockHeadValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev,
+                           size_t nHeadTx) {
+  AssertLockHeld(cs_main);
+  assert(pindexPrev == chainActive.Tip());
+  assert(nHeadTx >= 1 && nHeadTx <= block.vtx.size());
+
+  CCoinsViewCache viewNew(gpCoinsTip);
+  CBlockIndex indexDummy(block);
+  indexDummy.pprev = pindexPrev;
+  indexDummy.nHeight = pindexPrev->nHeight + 1;
+
+  // Header, timestamp and the rules over the whole block, as CheckBlock and ContextualCheckBlock apply them
+  if (!ContextualCheckBlockHeader(block, state, pindexPrev)) return false;
+  if (!CheckBlockHeader(block, state, false))
+    return state.DoS(100, error("%s : CheckBlockHeader failed", __func__), REJECT_INVALID, "bad-header", true);
+  if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200))
+    return state.Invalid(error("%s : block timestamp too far in the future", __func__), REJECT_INVALID,
+                         "time-too-new");
+  if (::GetSerializeSize(block) > MAX_BLOCK_SIZE_CURRENT)
+    return state.DoS(100, error("%s : size limits failed", __func__), REJECT_INVALID, "bad-blk-length");
+  if (!block.vtx[0].IsCoinBase())
+    return state.DoS(100, error("%s : first tx is not coinbase", __func__), REJECT_INVALID, "bad-cb-missing");
+  if (block.IsProofOfStake()) {
+    if (block.vtx[0].vout.size() != 1 || !block.vtx[0].vout[0].IsEmpty())
+      return state.DoS(100, error("%s : coinbase output not empty for proof-of-stake block", __func__));
+    if (nHeadTx < 2 || !block.vtx[1].IsCoinStake())
+      return state.DoS(100, error("%s : second tx is not coinstake", __func__));
+  }
+  if (indexDummy.nHeight <= Params().LAST_POW_BLOCK() && block.IsProofOfStake())
+    return state.DoS(100, error("%s : PoS period not active", __func__), REJECT_INVALID, "PoS-early");
+  if (indexDummy.nHeight > Params().LAST_POW_BLOCK() && block.IsProofOfWork())
+    return state.DoS(100, error("%s : PoW period ended", __func__), REJECT_INVALID, "PoW-ended");
+  uint32_t nSigOps = 0;
+  for (const CTransaction& tx : block.vtx) nSigOps += GetLegacySigOpCount(tx);
+  if (nSigOps > MAX_BLOCK_SIGOPS_CURRENT)
+    return state.DoS(100, error("%s : out-of-bounds SigOpCount", __func__), REJECT_INVALID, "bad-blk-sigops", true);
+  if (!ContextualCheckBlock(block, state, pindexPrev)) return false;
+
+  // The head transactions themselves, including that their inputs are still unspent on chain
+  for (size_t i = 0; i < nHeadTx; i++) {
+    const CTransaction& tx = block.vtx[i];
+    assert(!tx.IsZerocoinSpend());
+    if (!CheckTransaction(tx, true, state)) return error("%s : CheckTransaction failed", __func__);
+    if (tx.IsCoinBase()) continue;
+    if (!viewNew.HaveInputs(tx))
+      return state.DoS(100, error("%s : inputs missing/spent", __func__), REJECT_INVALID,
+                       "bad-txns-inputs-missingorspent");
+    if (!CheckInputs(tx, state, viewNew, true, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG, false)) return false;
+  }
+
+  AccumulatorMap mapAccumulators(libzerocoin::gpZerocoinParams);
+  if (!ValidateAccumulatorCheckpoint(block, &indexDummy, mapAccumulators))
+    return state.DoS(100, error("%s : Failed to validate accumulator checkpoint", __func__), REJECT_INVALID,
+                     "bad-acc-checkpoint");
+  assert(state.IsValid());
+
+  return true;
+}
+
 bool static LoadBlockIndexDB(string& strError) {
   if (!gpBlockTreeDB->LoadBlockIndexGuts()) return false;
 
@@ -3729,7 +3972,7 @@ void static ProcessGetData(CNode* pfrom) {
               // Thus, the protocol spec specified allows for us to provide duplicate txn here,
               // however we MUST always provide at least what the remote peer needs
               for (auto& pair : merkleBlock.vMatchedTxn)
-                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                if (!pfrom->filterInventoryKnown.contains(pair.second))
                   pfrom->PushMessage("tx", block.vtx[pair.first]);
             }
             // else
@@ -4273,11 +4516,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
   else if (strCommand == "block" && !fImporting && !fReindex)  // Ignore blocks received while importing
   {
+    uint32_t nBlockBytes = vRecv.size();
     CBlock block;
     vRecv >> block;
     uint256 hashBlock = block.GetHash();
     CInv inv(MSG_BLOCK, hashBlock);
     LogPrint(TessaLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+    {
+      LOCK(cs_main);
+      UpdateBlockDownloadStats(pfrom->GetId(), hashBlock, nBlockBytes);
+    }
 
     // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
     if (!mapBlockIndex.count(block.hashPrevBlock)) {
@@ -4563,7 +4811,7 @@ bool ProcessMessages(CNode* pfrom) {
 
     // Checksum
     CDataStream& vRecv = msg.vRecv;
-    uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+    const uint256& hash = msg.GetMessageHash();
     uint32_t nChecksum = 0;
     memcpy(&nChecksum, &hash, sizeof(nChecksum));
     if (nChecksum != hdr.nChecksum) {
@@ -4719,39 +4967,44 @@ bool SendMessages(CNode* pto, bool fSendTrickle) {
     // Message: inventory
     //
     vector<CInv> vInv;
-    vector<CInv> vInvWait;
     {
       LOCK(pto->cs_inventory);
-      vInv.reserve(pto->vInventoryToSend.size());
-      vInvWait.reserve(pto->vInventoryToSend.size());
-      for (const CInv& inv : pto->vInventoryToSend) {
-        if (pto->setInventoryKnown.count(inv)) continue;
+      vInv.reserve(std::min<size_t>(1000, pto->vInventoryToSend.size() + pto->setInventoryTxToSend.size()));
 
-        // trickle out tx inv to protect privacy
-        if (inv.type == MSG_TX && !fSendTrickle) {
-          // 1/4 of tx invs blast to all immediately
-          static uint256 hashSalt;
-          if (hashSalt.IsNull()) hashSalt = GetRandHash();
-          uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
-          hashRand = Hash(BEGIN(hashRand), END(hashRand));
-          bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
-
-          if (fTrickleWait) {
-            vInvWait.push_back(inv);
-            continue;
-          }
+      for (const CInv& inv : pto->vInventoryToSend) {
+        if (pto->filterInventoryKnown.contains(inv.hash)) continue;
+        pto->filterInventoryKnown.insert(inv.hash);
+        vInv.push_back(inv);
+        if (vInv.size() >= 1000) {
+          pto->PushMessage("inv", vInv);
+          vInv.clear();
         }
-
-        // returns true if wasn't already contained in the set
-        if (pto->setInventoryKnown.insert(inv).second) {
-          vInv.push_back(inv);
+      }
+      pto->vInventoryToSend.clear();
+
+      // Transactions are trickled out in batches on a per-peer Poisson timer to
+      // protect privacy; outbound peers get announcements twice as often.
+      int64_t nNow = GetTimeMicros();
+      bool fSendTxInv = pto->fWhitelisted;
+      if (pto->nNextInvSend < nNow) {
+        fSendTxInv = true;
+        int64_t nInterval = (int64_t)INVENTORY_BROADCAST_INTERVAL * 1000000;
+        if (!pto->fInbound) nInterval /= 2;
+        pto->nNextInvSend = PoissonNextSend(nNow, nInterval);
+      }
+      if (fSendTxInv) {
+        for (const uint256& hash : pto->setInventoryTxToSend) {
+          // A peer may have announced it to us since it was queued
+          if (pto->filterInventoryKnown.contains(hash)) continue;
+          pto->filterInventoryKnown.insert(hash);
+          vInv.push_back(CInv(MSG_TX, hash));
           if (vInv.size() >= 1000) {
             pto->PushMessage("inv", vInv);
             vInv.clear();
           }
         }
+        pto->setInventoryTxToSend.clear();
       }
-      pto->vInventoryToSend = vInvWait;
     }
     if (!vInv.empty()) pto->PushMessage("inv", vInv);
 
@@ -4781,10 +5034,14 @@ bool SendMessages(CNode* pto, bool fSendTrickle) {
     // Message: getdata (blocks)
     //
     vector<CInv> vGetData;
-    if (!pto->fDisconnect && !pto->fClient && fFetch && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+    if (state.nPingUsecTime != pto->nPingUsecTime) {
+      state.nPingUsecTime = pto->nPingUsecTime;
+      UpdateBlockDownloadWindow(&state);
+    }
+    if (!pto->fDisconnect && !pto->fClient && fFetch && state.nBlocksInFlight < state.nBlockDownloadWindow) {
       vector<CBlockIndex*> vToDownload;
       NodeId staller = -1;
-      FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload,
+      FindNextBlocksToDownload(pto->GetId(), state.nBlockDownloadWindow - state.nBlocksInFlight, vToDownload,
                                staller);
       for (CBlockIndex* pindex : vToDownload) {
         vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
@@ -130,6 +130,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                       bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
+/** Re-validate and add the transactions saved in mempool.dat. Called from the import thread on startup. */
+bool LoadMempool();
+/** Write the mempool (and its prioritisation deltas) to mempool.dat. */
+bool DumpMempool();
+
 int GetInputAge(CTxIn& vin);
 
 struct CNodeStateStats {
@@ -137,6 +142,9 @@ struct CNodeStateStats {
   int nSyncHeight;
   int nCommonHeight;
   std::vector<int> vHeightInFlight;
+  int nBlocksDelivered;
+  double dBlockBytesPerSec;
+  int nBlockDownloadWindow;
 };
 
 CAmount GetMinRelayFee(const CTransaction& tx, uint32_t nBytes, bool fAllowFree);
@@ -253,6 +261,12 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
  * held) */
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true,
                        bool fCheckMerkleRoot = true);
+/**
+ * TestBlockValidity for a block whose transactions from nHeadTx on already passed it on this tip: the header, the
+ * block-wide limits and the first nHeadTx transactions (coinbase and coinstake) are checked in full, the rest not
+ * again. The head transactions must not be zerocoin spends.
+ */
+bool TestBlockHeadValidity(CValidationState& state, const CBlock& block, CBlockIndex* pindexPrev, size_t nHeadTx);
 
 /** Store block on disk. If dbp is provided, the file is known to already reside on disk */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** pindex, CDiskBlockPos* dbp = nullptr,
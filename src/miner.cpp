@@ -9,11 +9,13 @@
 
 #include "miner.h"
 #include "amount.h"
+#include "coin_constants.h"
+#include "crypto/hashargon2d.h"
 #include "ecdsa/key.h"
 #include "hash.h"
 #include "init.h"
 #include "kernel.h"  // mapHashedBlocks
-#include "main.h"    // for CBlockTemplate, updateMapZerocoinSpends
+#include "main.h"    // for CBlockTemplate
 #include "net.h"
 #include "pow.h"
 #include "primitives/block.h"
@@ -32,8 +34,12 @@
 #include "zerocoin/accumulators.h"
 
 #include "libzerocoin/CoinSpend.h"
-#include <cmath>  // for std::pow
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 using namespace std;
 using namespace ecdsa;
@@ -42,13 +48,33 @@ static std::condition_variable miner_interrupt_cond;
 static std::mutex cs_miner_interrupt;
 static std::atomic<bool> miner_interrupted(false);
 
-static void InterruptibleSleep(uint64_t n) {
-  bool ret = false;
+static uint64_t nStakerWakeups = 0;  //! bumped by WakeStaker, guarded by cs_miner_interrupt
+
+std::atomic<bool> fGenerateBitcoins(false);
+
+// Sleep up to n milliseconds unless a new tip or wallet change wakes the staker first. Returns whether one did.
+// nWakeSeen is the caller's count of wakeups seen, so every waiting thread sees every wakeup. A thread that isn't the
+// stake minter also returns as soon as setgenerate stops it.
+static bool WaitForStakeEvent(uint64_t n, uint64_t& nWakeSeen, bool fStakingThread) {
+  bool fWoken = false;
   {
     std::unique_lock<std::mutex> lock(cs_miner_interrupt);
-    ret = miner_interrupt_cond.wait_for(lock, std::chrono::milliseconds(n), []() -> bool { return miner_interrupted; });
+    miner_interrupt_cond.wait_for(lock, std::chrono::milliseconds(n), [&nWakeSeen, fStakingThread]() -> bool {
+      return miner_interrupted || nStakerWakeups != nWakeSeen || (!fStakingThread && !fGenerateBitcoins);
+    });
+    fWoken = (nStakerWakeups != nWakeSeen);
+    nWakeSeen = nStakerWakeups;
   }
-  interruption_point(ret);
+  interruption_point(miner_interrupted);
+  return fWoken;
+}
+
+void WakeStaker() {
+  {
+    std::lock_guard<std::mutex> lock(cs_miner_interrupt);
+    nStakerWakeups++;
+  }
+  miner_interrupt_cond.notify_all();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -56,54 +82,292 @@ static void InterruptibleSleep(uint64_t n) {
 // TessaMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan {
- public:
-  const CTransaction* ptx;
-  set<uint256> setDependsOn;
-  CAmount feeRate;
-  double dPriority;
-
-  COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0) {}
-};
-
 static uint64_t nLastBlockTx = 0;
 static uint64_t nLastBlockSize = 0;
 
 uint64_t getLastBlockTx() { return nLastBlockTx; }
 uint64_t getLastBlockSize() { return nLastBlockSize; }
 
-// We want to sort transactions by priority and fee rate, so:
-typedef std::tuple<double, CAmount, const CTransaction*> TxPriority;
-class TxPriorityCompare {
-  bool byFee;
+void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev) {
+  pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+
+  // Updating time can change work required on testnet:
+  if (Params().AllowMinDifficultyBlocks()) pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+}
+
+/**
+ * Keeps the transaction part of the next block ready between calls to CreateNewBlock. The body is built once
+ * per tip and then extended as transactions enter the mempool, so a call only validates what changed since the
+ * last one. It is rebuilt from scratch when the tip moves, when anything leaves the pool, when the size limits
+ * change, or when a full body has been turning better paying transactions away for a while.
+ * All state is only touched with cs_main and mempool.cs held.
+ */
+class CBlockAssembler : public CValidationInterface {
+ private:
+  uint256 hashTip;                         //! Tip the body was built on, null when stale
+  std::unique_ptr<CCoinsViewCache> pview;  //! gpCoinsTip plus the effects of the body
+  uint32_t nTransactionsUpdatedSeen;       //! mempool update counter the body accounts for
+  uint32_t nBlockMaxSize;
+  uint32_t nBlockPrioritySize;
+  int64_t nTimeBuilt;
+  bool fFull;       //! a transaction was turned away for lack of space since the last rebuild
+  bool fValidated;  //! the body passed TestBlockValidity on this tip
+
+  std::vector<CTransaction> vtx;
+  std::vector<CAmount> vTxFees;
+  std::vector<int64_t> vTxSigOps;
+  std::set<uint256> setInBlock;
+  std::vector<CBigNum> vBlockSerials;
+  uint64_t nBlockSize;
+  int nBlockSigOps;
+  CAmount nFees;
+
+  bool AddTx(const CTxMemPoolEntry& entry, int nHeight);
+  void Rebuild(const CBlockIndex* pindexPrev);
 
  public:
-  TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
+  CBlockAssembler()
+      : nTransactionsUpdatedSeen(0),
+        nBlockMaxSize(0),
+        nBlockPrioritySize(0),
+        nTimeBuilt(0),
+        fFull(false),
+        fValidated(false),
+        nBlockSize(0),
+        nBlockSigOps(0),
+        nFees(0) {}
+
+  /** Bring the body up to date for a block on top of pindexPrev. Returns true if it was already validated. */
+  bool Update(const CBlockIndex* pindexPrev, uint32_t nBlockMaxSizeIn, uint32_t nBlockPrioritySizeIn);
+  /** Append the body to a template that holds the coinbase (and coinstake) */
+  void AppendTo(CBlockTemplate& blocktemplate) const;
+  void SetValidated() { fValidated = true; }
+  void SetStale() { hashTip.SetNull(); }
+  bool Contains(const uint256& hash) const { return setInBlock.count(hash) != 0; }
+  uint64_t GetBlockSize() const { return nBlockSize; }
+  uint64_t GetBlockTx() const { return vtx.size(); }
+  CAmount GetFees() const { return nFees; }
+
+ protected:
+  void UpdatedBlockTip(const CBlockIndex* pindex) override;
+  void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override;
+  void BlockChecked(const CBlock& block, const CValidationState& state) override;
+};
 
-  bool operator()(const TxPriority& a, const TxPriority& b) {
-    if (byFee) {
-      if (get<1>(a) == get<1>(b)) return get<0>(a) < get<0>(b);
-      return get<1>(a) < get<1>(b);
-    } else {
-      if (get<0>(a) == get<0>(b)) return get<1>(a) < get<1>(b);
-      return get<0>(a) < get<0>(a);
+static CBlockAssembler blockAssembler;
+
+bool CBlockAssembler::AddTx(const CTxMemPoolEntry& entry, int nHeight) {
+  const CTransaction& tx = entry.GetTx();
+  if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) return false;
+
+  // Size limits
+  uint32_t nTxSize = entry.GetTxSize();
+  if (nBlockSize + nTxSize >= nBlockMaxSize) {
+    fFull = true;
+    return false;
+  }
+
+  // Legacy limits on sigOps:
+  const uint32_t nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+  uint32_t nTxSigOps = GetLegacySigOpCount(tx);
+  if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) {
+    fFull = true;
+    return false;
+  }
+
+  CCoinsViewCache& view = *pview;
+  if (!view.HaveInputs(tx)) return false;
+
+  // double check that there are no double spent ZKP spends in this block or tx
+  vector<CBigNum> vTxSerials;
+  if (tx.IsZerocoinSpend()) {
+    int nHeightTx = 0;
+    if (IsTransactionInChain(tx.GetHash(), nHeightTx)) return false;
+
+    for (const CTxIn& txIn : tx.vin) {
+      if (txIn.scriptSig.IsZerocoinSpend()) {
+        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+        if (!spend.HasValidSerial(libzerocoin::gpZerocoinParams)) return false;
+        if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber())) return false;
+        if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber())) return false;
+        vTxSerials.emplace_back(spend.getCoinSerialNumber());
+      }
     }
   }
-};
 
-void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev) {
-  pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+  CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
 
-  // Updating time can change work required on testnet:
-  if (Params().AllowMinDifficultyBlocks()) pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+  nTxSigOps += GetP2SHSigOpCount(tx, view);
+  if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) return false;
+
+  // Note that flags: we don't want to set mempool/IsStandard()
+  // policy here, but we still have to ensure that the block we
+  // create only contains transactions that are valid in new blocks.
+  CValidationState state;
+  if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) return false;
+
+  CTxUndo txundo;
+  UpdateCoins(tx, state, view, txundo, nHeight);
+
+  // Added
+  vtx.push_back(tx);
+  vTxFees.push_back(nTxFees);
+  vTxSigOps.push_back(nTxSigOps);
+  nBlockSize += nTxSize;
+  nBlockSigOps += nTxSigOps;
+  nFees += nTxFees;
+  setInBlock.insert(tx.GetHash());
+  fValidated = false;
+
+  for (const CBigNum& bnSerial : vTxSerials) vBlockSerials.emplace_back(bnSerial);
+  return true;
+}
+
+void CBlockAssembler::Rebuild(const CBlockIndex* pindexPrev) {
+  const int nHeight = pindexPrev->nHeight + 1;
+  bool fPrintPriority = GetBoolArg("-printpriority", false);
+  int64_t nStart = GetTimeMillis();
+
+  hashTip = pindexPrev->GetBlockHash();
+  pview.reset(new CCoinsViewCache(gpCoinsTip));
+  nTransactionsUpdatedSeen = mempool.GetTransactionsUpdated();
+  nTimeBuilt = GetTime();
+  fFull = false;
+  fValidated = false;
+  vtx.clear();
+  vTxFees.clear();
+  vTxSigOps.clear();
+  setInBlock.clear();
+  vBlockSerials.clear();
+  nBlockSize = 1000;
+  nBlockSigOps = 100;
+  nFees = 0;
+
+  // Priority area: the highest priority transactions without unconfirmed parents, regardless of fee
+  if (nBlockPrioritySize > 0) {
+    vector<std::pair<double, const CTxMemPoolEntry*> > vecPriority;
+    vecPriority.reserve(mempool.mapTx.size());
+    for (const auto& mi : mempool.mapTx) {
+      const CTxMemPoolEntry& entry = mi.second;
+      if (entry.GetCountWithAncestors() != 1 || entry.GetTx().IsZerocoinSpend()) continue;
+      if (!pview->HaveInputs(entry.GetTx())) continue;
+      double dPriority = pview->GetPriority(entry.GetTx(), nHeight);
+      CAmount nFeeDelta = 0;
+      mempool.ApplyDeltas(mi.first, dPriority, nFeeDelta);
+      vecPriority.push_back(std::make_pair(dPriority, &entry));
+    }
+    std::sort(vecPriority.begin(), vecPriority.end(),
+              [](const std::pair<double, const CTxMemPoolEntry*>& a,
+                 const std::pair<double, const CTxMemPoolEntry*>& b) { return a.first > b.first; });
+
+    for (const auto& priority : vecPriority) {
+      if (nBlockSize >= nBlockPrioritySize || !AllowFree(priority.first)) break;
+      if (nBlockSize + priority.second->GetTxSize() >= nBlockPrioritySize) continue;
+      if (AddTx(*priority.second, nHeight) && fPrintPriority) {
+        LogPrint(TessaLog::MINER, "priority %.1f fee %s txid %s\n", priority.first,
+                 FormatMoney(priority.second->GetModifiedFee()), priority.second->GetTx().GetHash().ToString());
+      }
+    }
+  }
+
+  // Fee area: walk the pool's ancestor score index, best package first, adding each transaction together with
+  // whatever it still needs from the pool. Zerocoin spends score highest and go first. Scores are not
+  // recomputed as ancestors land in the block, which can only make a package look worse than it is.
+  for (auto mi = mempool.setByAncestorScore.rbegin(); mi != mempool.setByAncestorScore.rend(); ++mi) {
+    if (nBlockSize + 1000 >= nBlockMaxSize) {
+      fFull = true;
+      break;
+    }
+    if (setInBlock.count(mi->second)) continue;
+    const CTxMemPoolEntry& entry = mempool.mapTx.at(mi->second);
+
+    std::set<uint256> setAncestors;
+    std::string errString;
+    mempool.CalculateMemPoolAncestors(entry.GetTx(), setAncestors, std::numeric_limits<uint64_t>::max(),
+                                      std::numeric_limits<uint64_t>::max(), errString);
+    vector<const CTxMemPoolEntry*> vPackage(1, &entry);
+    uint64_t nPackageSize = entry.GetTxSize();
+    for (const uint256& hashAncestor : setAncestors) {
+      if (setInBlock.count(hashAncestor)) continue;
+      vPackage.push_back(&mempool.mapTx.at(hashAncestor));
+      nPackageSize += vPackage.back()->GetTxSize();
+    }
+    if (nBlockSize + nPackageSize >= nBlockMaxSize) {
+      fFull = true;
+      continue;
+    }
+
+    // An ancestor always has fewer in-pool ancestors than its descendants, so this puts parents first
+    std::sort(vPackage.begin(), vPackage.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+      return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    for (const CTxMemPoolEntry* pentry : vPackage) {
+      if (!AddTx(*pentry, nHeight)) break;
+      if (fPrintPriority) {
+        LogPrint(TessaLog::MINER, "package fee rate %.0f fee %s txid %s\n", mi->first,
+                 FormatMoney(pentry->GetModifiedFee()), pentry->GetTx().GetHash().ToString());
+      }
+    }
+  }
+
+  LogPrint(TessaLog::MINER, "%s: rebuilt block body with %u txs (%u bytes) in %dms\n", __func__, vtx.size(),
+           nBlockSize, GetTimeMillis() - nStart);
+}
+
+bool CBlockAssembler::Update(const CBlockIndex* pindexPrev, uint32_t nBlockMaxSizeIn, uint32_t nBlockPrioritySizeIn) {
+  AssertLockHeld(cs_main);
+  AssertLockHeld(mempool.cs);
+
+  bool fRebuild = hashTip != pindexPrev->GetBlockHash() || nBlockMaxSizeIn != nBlockMaxSize ||
+                  nBlockPrioritySizeIn != nBlockPrioritySize;
+  // Something left the pool (or was added without us hearing of it), and may be in the body
+  fRebuild |= mempool.GetTransactionsUpdated() != nTransactionsUpdatedSeen;
+  // Give transactions that did not fit a chance to displace cheaper ones now and then
+  fRebuild |= fFull && GetTime() - nTimeBuilt >= BLOCK_TEMPLATE_REFRESH_INTERVAL;
+
+  if (fRebuild) {
+    nBlockMaxSize = nBlockMaxSizeIn;
+    nBlockPrioritySize = nBlockPrioritySizeIn;
+    Rebuild(pindexPrev);
+  }
+  return fValidated;
+}
+
+void CBlockAssembler::AppendTo(CBlockTemplate& blocktemplate) const {
+  blocktemplate.block.vtx.insert(blocktemplate.block.vtx.end(), vtx.begin(), vtx.end());
+  blocktemplate.vTxFees.insert(blocktemplate.vTxFees.end(), vTxFees.begin(), vTxFees.end());
+  blocktemplate.vTxSigOps.insert(blocktemplate.vTxSigOps.end(), vTxSigOps.begin(), vTxSigOps.end());
+}
+
+void CBlockAssembler::UpdatedBlockTip(const CBlockIndex* pindex) {
+  LOCK(cs_main);
+  SetStale();
+}
+
+void CBlockAssembler::SyncTransaction(const CTransaction& tx, const CBlock* pblock) {
+  // Transactions from connected blocks come with the new tip, which rebuilds the body anyway
+  if (pblock) return;
+  AssertLockHeld(cs_main);
+  LOCK(mempool.cs);
+  if (hashTip.IsNull() || hashTip != chainActive.Tip()->GetBlockHash()) return;
+
+  // The one update expected is tx entering the pool; anything else leaves the counter off and forces a rebuild
+  if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedSeen + 1) return;
+  auto it = mempool.mapTx.find(tx.GetHash());
+  if (it == mempool.mapTx.end()) return;
+  nTransactionsUpdatedSeen++;
+
+  // Only extend the body with transactions whose in-pool parents are already in it
+  for (const uint256& parent : mempool.mapLinks[it->first].parents) {
+    if (!setInBlock.count(parent)) return;
+  }
+  AddTx(it->second, chainActive.Height() + 1);
+}
+
+void CBlockAssembler::BlockChecked(const CBlock& block, const CValidationState& state) {
+  // One of ours (or anybody's) failed on this tip: do not trust the body without validating it again
+  LOCK(cs_main);
+  if (!state.IsValid() && block.hashPrevBlock == hashTip) fValidated = false;
 }
 
 std::pair<int, std::pair<uint256, uint256> > pCheckpointCache;
@@ -154,11 +418,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
   uint32_t nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
   nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
 
-  // Minimum block size you want to create; block will be filled with free transactions
-  // until there are no more or the block reaches this size:
-  uint32_t nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-  nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
   // Collect memory pool transactions into the block
   CAmount nFees = 0;
 
@@ -167,210 +426,15 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
     CBlockIndex* pindexPrev = chainActive.Tip();
     const int nHeight = pindexPrev->nHeight + 1;
-    CCoinsViewCache view(gpCoinsTip);
-
-    // Priority order to process transactions
-    list<COrphan> vOrphan;  // list memory doesn't move
-    map<uint256, vector<COrphan*> > mapDependers;
-    bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-    // This vector will be sorted into a priority queue:
-    vector<TxPriority> vecPriority;
-    vecPriority.reserve(mempool.mapTx.size());
-    for (auto& mi : mempool.mapTx) {
-      const CTransaction& tx = mi.second.GetTx();
-      if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) { continue; }
-
-      COrphan* porphan = nullptr;
-      double dPriority = 0;
-      CAmount nTotalIn = 0;
-      bool fMissingInputs = false;
-      uint256 txid = tx.GetHash();
-      for (const CTxIn& txin : tx.vin) {
-        // zerocoinspend has special vin
-        if (tx.IsZerocoinSpend()) {
-          nTotalIn = tx.GetZerocoinSpent();
-
-          // Give a high priority to zerocoinspends to get into the next block
-          // Priority = (age^6+100000)*amount - gives higher priority to zkps that have been in mempool long
-          // and higher priority to zkps that are large in value
-          int64_t nTimeSeen = GetAdjustedTime();
-          double nConfs = 100000;
-
-          // update MapZerocoinSpends if not seen, otherwise return nTimeSeen
-          updateMapZerocoinSpends(txid, nTimeSeen);
-
-          double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
-
-          // ZKP spends can have very large priority, use non-overflowing safe functions
-          dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
-          dPriority = double_safe_multiplication(dPriority, nTotalIn);
-
-          continue;
-        }
-
-        // Read prev transaction
-        if (!view.HaveCoins(txin.prevout.hash)) {
-          // This should never happen; all transactions in the memory
-          // pool should connect to either transactions in the chain
-          // or other transactions in the memory pool.
-          if (!mempool.mapTx.count(txin.prevout.hash)) {
-            LogPrintf("ERROR: mempool transaction missing input\n");
-            if (gArgs.IsArgSet("-debug")) assert("mempool transaction missing input" == 0);
-            fMissingInputs = true;
-            if (porphan) vOrphan.pop_back();
-            break;
-          }
-
-          // Has to wait for dependencies
-          if (!porphan) {
-            // Use list for automatic deletion
-            vOrphan.push_back(COrphan(&tx));
-            porphan = &vOrphan.back();
-          }
-          mapDependers[txin.prevout.hash].push_back(porphan);
-          porphan->setDependsOn.insert(txin.prevout.hash);
-          nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-          continue;
-        }
-
-        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-        assert(coins);
-
-        CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-        nTotalIn += nValueIn;
-
-        int nConf = nHeight - coins->nHeight;
-
-        // ZKP spends can have very large priority, use non-overflowing safe functions
-        dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-      }
-      if (fMissingInputs) continue;
-
-      // Priority is sum(valuein * age) / modified_txsize
-      uint32_t nTxSize = ::GetSerializeSize(tx);
-      dPriority = tx.ComputePriority(dPriority, nTxSize);
 
-      uint256 hash = tx.GetHash();
-      mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-      if (porphan) {
-        porphan->dPriority = dPriority;
-        porphan->feeRate = minTxFee;
-      } else
-        vecPriority.push_back(TxPriority(dPriority, minTxFee, &mi.second.GetTx()));
-    }
-
-    // Collect transactions into block
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    int nBlockSigOps = 100;
-    bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-    TxPriorityCompare comparer(fSortedByFee);
-    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-    vector<CBigNum> vBlockSerials;
-    vector<CBigNum> vTxSerials;
-    while (!vecPriority.empty()) {
-      // Take highest priority transaction off the priority queue:
-      double dPriority = get<0>(vecPriority.front());
-      CAmount feeRate = get<1>(vecPriority.front());
-      const CTransaction& tx = *(get<2>(vecPriority.front()));
-
-      std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-      vecPriority.pop_back();
-
-      // Size limits
-      uint32_t nTxSize = ::GetSerializeSize(tx);
-      if (nBlockSize + nTxSize >= nBlockMaxSize) continue;
-
-      // Legacy limits on sigOps:
-      uint32_t nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-      uint32_t nTxSigOps = GetLegacySigOpCount(tx);
-      if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) continue;
-
-      // Skip free transactions if we're past the minimum block size:
-      const uint256& hash = tx.GetHash();
-      double dPriorityDelta = 0;
-      CAmount nFeeDelta = 0;
-      mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-      if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) &&
-          (feeRate < minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-        continue;
-
-      // Prioritise by fee once past the priority size or we run out of high-priority
-      // transactions:
-      if (!fSortedByFee && ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-        fSortedByFee = true;
-        comparer = TxPriorityCompare(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-      }
-
-      if (!view.HaveInputs(tx)) continue;
-
-      // double check that there are no double spent ZKP spends in this block or tx
-      if (tx.IsZerocoinSpend()) {
-        int nHeightTx = 0;
-        if (IsTransactionInChain(tx.GetHash(), nHeightTx)) continue;
-
-        bool fDoubleSerial = false;
-        for (const CTxIn& txIn : tx.vin) {
-          if (txIn.scriptSig.IsZerocoinSpend()) {
-            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-            if (!spend.HasValidSerial(libzerocoin::gpZerocoinParams)) fDoubleSerial = true;
-            if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber())) fDoubleSerial = true;
-            if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber())) fDoubleSerial = true;
-            if (fDoubleSerial) break;
-            vTxSerials.emplace_back(spend.getCoinSerialNumber());
-          }
-        }
-        // This ZKP serial has already been included in the block, do not add this tx.
-        if (fDoubleSerial) continue;
-      }
-
-      CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-      nTxSigOps += GetP2SHSigOpCount(tx, view);
-      if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) continue;
-
-      // Note that flags: we don't want to set mempool/IsStandard()
-      // policy here, but we still have to ensure that the block we
-      // create only contains transactions that are valid in new blocks.
-      CValidationState state;
-      if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) continue;
-
-      CTxUndo txundo;
-      UpdateCoins(tx, state, view, txundo, nHeight);
-
-      // Added
-      pblock->vtx.push_back(tx);
-      pblocktemplate->vTxFees.push_back(nTxFees);
-      pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-      nBlockSize += nTxSize;
-      ++nBlockTx;
-      nBlockSigOps += nTxSigOps;
-      nFees += nTxFees;
-
-      for (const CBigNum& bnSerial : vTxSerials) vBlockSerials.emplace_back(bnSerial);
-
-      if (fPrintPriority) {
-        LogPrint(TessaLog::MINER, "priority %.1f fee %d txid %s\n", dPriority, feeRate, tx.GetHash().ToString());
-      }
-
-      // Add transactions that depend on this one to the priority queue
-      if (mapDependers.count(hash)) {
-        for (COrphan* porphan : mapDependers[hash]) {
-          if (!porphan->setDependsOn.empty()) {
-            porphan->setDependsOn.erase(hash);
-            if (porphan->setDependsOn.empty()) {
-              vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-              std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-          }
-        }
-      }
-    }
+    // Take the transactions from the live block body, which only validates what changed since the last call
+    static std::once_flag fRegistered;
+    std::call_once(fRegistered, []() { RegisterValidationInterface(&blockAssembler); });
+    bool fBodyValidated = blockAssembler.Update(pindexPrev, nBlockMaxSize, nBlockPrioritySize);
+    blockAssembler.AppendTo(*pblocktemplate);
+    nFees = blockAssembler.GetFees();
+    uint64_t nBlockSize = blockAssembler.GetBlockSize();
+    uint64_t nBlockTx = blockAssembler.GetBlockTx();
 
     if (fProofOfStake) {
       pblock->vtx[0].vin[0].scriptSig = CScript() << nHeight << OP_0;
@@ -432,12 +496,27 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     }
     pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
 
+    // A body that already passed on this tip only needs checking again if the coinstake spends what it spends, or
+    // is a zerocoin spend, whose serials are only checked against the body's by a full pass. The new header, coinbase
+    // and coinstake are checked every time.
+    const size_t nHeadTx = pblock->vtx.size() - nBlockTx;
+    bool fCheckBlock = !fBodyValidated;
+    for (size_t i = 1; !fCheckBlock && i < nHeadTx; i++) {
+      if (pblock->vtx[i].IsZerocoinSpend()) fCheckBlock = true;
+      for (const CTxIn& txin : pblock->vtx[i].vin) {
+        auto it = mempool.mapNextTx.find(txin.prevout);
+        if (it != mempool.mapNextTx.end() && blockAssembler.Contains(it->second.ptx->GetHash())) fCheckBlock = true;
+      }
+    }
     CValidationState state;
-    if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
+    if (fCheckBlock ? !TestBlockValidity(state, *pblock, pindexPrev, false, false)
+                    : !TestBlockHeadValidity(state, *pblock, pindexPrev, nHeadTx)) {
       LogPrintf("MINER CreateNewBlock() : TestBlockValidity failed\n");
+      blockAssembler.SetStale();
       mempool.clear();
       return nullptr;
     }
+    if (fCheckBlock) blockAssembler.SetValidated();
 
     //        if (pblock->IsZerocoinStake()) {
     //            CWalletTx wtx(pwalletMain, pblock->vtx[1]);
@@ -462,15 +541,192 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, uint32_t& nExt
   assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
   pblock->vtx[0] = txCoinbase;
-  pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+  pblock->hashMerkleRoot = pblock->ComputeMerkleRoot();
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
 // Internal miner
 //
-double dHashesPerSec = 0.0;
-int64_t nHPSTimerStart = 0;
+std::atomic<double> dHashesPerSec(0.0);
+std::atomic<int64_t> nHPSTimerStart(0);
+
+/**
+ * Proof-of-work search shared by the miner threads. The BitcoinMiner thread posts one header and target as a job and
+ * every worker hashes its own slice of the nonce space on a private copy, with its own Argon2 memory. While hashing,
+ * workers only read atomics: a new job id (new template, new time or new tip) or a claimed solution ends the slice.
+ */
+class CPowSearch : public CValidationInterface {
+ public:
+  ~CPowSearch() { Stop(); }
+
+  void Start(int nThreads);
+  void Stop();
+  int Threads() const { return nWorkers; }
+
+  /** Hand a new header to the workers, dropping whatever they were doing */
+  void Post(const CBlockHeader& header, const arith_uint256& target);
+  /** Stop hashing until the next Post */
+  void Cancel();
+  /** Wait up to nMilliseconds for the current job to end. Returns true and sets nNonce if it was solved */
+  bool Wait(int64_t nMilliseconds, uint32_t& nNonce);
+  /** Whether the current job ran through every slice without a solution, or was cancelled */
+  bool Ended();
+  /** Hashes computed since the last call */
+  uint64_t TakeHashes() { return nHashes.exchange(0); }
+
+  void UpdatedBlockTip(const CBlockIndex* pindex) override { Cancel(); }
+
+ private:
+  std::mutex cs;
+  std::condition_variable cond;
+  std::vector<std::thread> vWorkers;
+  std::atomic<int> nWorkers{0};
+  bool fStop = false;          //! guarded by cs
+  bool fJob = false;           //! guarded by cs
+  CBlockHeader header;         //! guarded by cs
+  arith_uint256 hashTarget;    //! guarded by cs
+  int nSlicesDone = 0;         //! guarded by cs
+  uint32_t nFoundNonce = 0;    //! guarded by cs
+
+  std::atomic<uint64_t> nJob{0};
+  std::atomic<bool> fFound{false};
+  std::atomic<uint64_t> nHashes{0};
+
+  void Worker(int nIndex);
+};
+
+static CPowSearch powSearch;
+
+void CPowSearch::Start(int nThreads) {
+  Stop();
+  static std::once_flag fRegistered;
+  std::call_once(fRegistered, [this]() { RegisterValidationInterface(this); });
+
+  std::lock_guard<std::mutex> lock(cs);
+  fStop = false;
+  fJob = false;
+  nWorkers = nThreads;
+  for (int i = 0; i < nThreads; i++) vWorkers.emplace_back(&CPowSearch::Worker, this, i);
+  LogPrint(TessaLog::MINER, "proof-of-work search started with %d threads\n", nThreads);
+}
+
+void CPowSearch::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(cs);
+    fStop = true;
+    fJob = false;
+    ++nJob;
+  }
+  cond.notify_all();
+  for (std::thread& worker : vWorkers) worker.join();
+  vWorkers.clear();
+  nWorkers = 0;
+}
+
+void CPowSearch::Post(const CBlockHeader& headerIn, const arith_uint256& target) {
+  {
+    std::lock_guard<std::mutex> lock(cs);
+    header = headerIn;
+    hashTarget = target;
+    fJob = true;
+    nSlicesDone = 0;
+    fFound = false;
+    ++nJob;
+  }
+  cond.notify_all();
+}
+
+void CPowSearch::Cancel() {
+  {
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fJob) return;
+    fJob = false;
+    ++nJob;
+  }
+  cond.notify_all();
+}
+
+bool CPowSearch::Wait(int64_t nMilliseconds, uint32_t& nNonce) {
+  std::unique_lock<std::mutex> lock(cs);
+  cond.wait_for(lock, std::chrono::milliseconds(nMilliseconds), [this]() -> bool {
+    return fStop || miner_interrupted || !fJob || fFound || nSlicesDone == nWorkers;
+  });
+  if (!fJob || !fFound) return false;
+  nNonce = nFoundNonce;
+  return true;
+}
+
+bool CPowSearch::Ended() {
+  std::lock_guard<std::mutex> lock(cs);
+  return !fJob || nSlicesDone == nWorkers;
+}
+
+void CPowSearch::Worker(int nIndex) {
+  SetThreadPriority(THREAD_PRIORITY_LOWEST);
+  RenameThread("tessa-pow");
+  ReserveArgon2Arena();
+
+  uint64_t nLastJob = 0;
+  while (true) {
+    CBlockHeader work;
+    arith_uint256 target;
+    uint64_t nThisJob;
+    {
+      std::unique_lock<std::mutex> lock(cs);
+      cond.wait(lock, [&]() -> bool { return fStop || (fJob && nJob != nLastJob); });
+      if (fStop) return;
+      work = header;
+      target = hashTarget;
+      nThisJob = nLastJob = nJob;
+    }
+
+    // Each worker owns a contiguous slice of the nonce range
+    uint32_t nSlice = MINER_NONCE_RANGE / nWorkers;
+    uint32_t nEnd = nSlice * (nIndex + 1);
+    uint64_t nDone = 0;
+    bool fSolved = false;
+    for (work.nNonce = nSlice * nIndex; work.nNonce < nEnd; ++work.nNonce) {
+      if (nJob.load(std::memory_order_relaxed) != nThisJob || fFound.load(std::memory_order_relaxed)) break;
+      uint256 hash = work.GetHash();
+      if (++nDone % 64 == 0) nHashes += 64;
+      if (UintToArith256(hash) <= target) {
+        fSolved = true;
+        break;
+      }
+    }
+    nHashes += nDone % 64;
+
+    {
+      std::lock_guard<std::mutex> lock(cs);
+      if (nJob != nThisJob) continue;
+      if (fSolved && !fFound) {
+        nFoundNonce = work.nNonce;
+        fFound = true;
+      }
+      ++nSlicesDone;
+    }
+    cond.notify_all();
+  }
+}
+
+// Fold the hashes done since the last call into the hashes/sec figure reported by getmininginfo
+static void UpdateHashMeter() {
+  int64_t nNow = GetTimeMillis();
+  if (nHPSTimerStart == 0) {
+    nHPSTimerStart = nNow;
+    powSearch.TakeHashes();
+    return;
+  }
+  if (nNow - nHPSTimerStart < 4000) return;
+  dHashesPerSec = 1000.0 * powSearch.TakeHashes() / (nNow - nHPSTimerStart);
+  nHPSTimerStart = nNow;
+  static int64_t nLogTime;
+  if (GetTime() - nLogTime > 30 * 60) {
+    nLogTime = GetTime();
+    LogPrint(TessaLog::MINER, "hashmeter %6.0f khash/s\n", dHashesPerSec / 1000.0);
+  }
+}
 
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake) {
   CPubKey pubkey;
@@ -506,6 +762,11 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
   // Process this block the same as if we had received it from another node
   CValidationState state;
   if (!ProcessNewBlock(state, nullptr, pblock)) {
+    {
+      // Do not hand out the same body again without validating it
+      LOCK(cs_main);
+      blockAssembler.SetStale();
+    }
     // if (pblock->IsZerocoinStake()) pwalletMain->zkpTracker->RemovePending(pblock->vtx[1].GetHash());
     return error("TessaMiner : ProcessNewBlock, block not accepted");
   }
@@ -515,7 +776,6 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
   return true;
 }
 
-bool fGenerateBitcoins = false;
 bool fMintableCoins = false;
 int nMintableLastCheck = 0;
 
@@ -530,8 +790,17 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake) {
   CReserveKey reservekey(pwallet);
   uint32_t nExtraNonce = 0;
 
-  while (fGenerateBitcoins || fProofOfStake) {
+  // A proof-of-work miner that moves on to staking still stops with setgenerate false
+  const bool fStakingThread = fProofOfStake;
+  uint64_t nWakeSeen = 0;
+  while (fGenerateBitcoins || fStakingThread) {
     if (fProofOfStake) {
+      gStaker.RegisterEvents();
+      static std::once_flag fWalletConnected;
+      std::call_once(fWalletConnected, [pwallet]() {
+        pwallet->NotifyStatusChanged.connect([](CCryptoKeyStore*) { WakeStaker(); });
+      });
+
       // control the amount of times the client will check for mintable coins
       if ((GetTime() - nMintableLastCheck > 5 * 60))  // 5 minute check time
       {
@@ -540,38 +809,24 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake) {
       }
 
       if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK()) {
-        InterruptibleSleep(5000);
+        WaitForStakeEvent(STAKE_IDLE_WAIT * 1000, nWakeSeen, fStakingThread);
         continue;
       }
 
-      // while (vNodes.empty() || pwallet->IsLocked() || !fMintableCoins || (pwallet->GetBalance() > 0 &&
-      // nReserveBalance >= pwallet->GetBalance())) {
-
-      while (pwallet->IsLocked() || !fMintableCoins ||
-             (pwallet->GetBalance() > 0 && getReserveBalance() >= pwallet->GetBalance())) {
+      if (pwallet->IsLocked() || !fMintableCoins ||
+          (pwallet->GetBalance() > 0 && getReserveBalance() >= pwallet->GetBalance())) {
         gStaker.setLastCoinStakeSearchInterval(0);
-        // Do a separate 1 minute check here to ensure fMintableCoins is updated
-        if (!fMintableCoins) {
-          if (GetTime() - nMintableLastCheck > 1 * 60)  // 1 minute check time
-          {
-            nMintableLastCheck = GetTime();
-            fMintableCoins = pwallet->MintableCoins();
-            std::cout << "Rechecking if Mintable : " << fMintableCoins << " " << GetTime() << "\n";
-          }
-        }
-        InterruptibleSleep(5000);
-        if (!fGenerateBitcoins && !fProofOfStake) continue;
+        // Nothing to stake until the wallet or the chain changes, or coins age into eligibility
+        bool fWoken = WaitForStakeEvent(STAKE_IDLE_WAIT * 1000, nWakeSeen, fStakingThread);
+        if (fWoken || !fMintableCoins) nMintableLastCheck = 0;
+        continue;
       }
 
-      if (mapHashedBlocks.count(
-              chainActive.Tip()->nHeight))  // search our map of hashed blocks, see if bestblock has been hashed yet
-      {
-        if (GetTime() - mapHashedBlocks[chainActive.Tip()->nHeight] <
-            max(pwallet->nHashInterval, (uint32_t)1))  // wait half of the nHashDrift with max wait of 3 minutes
-        {
-          InterruptibleSleep(5000);
-          continue;
-        }
+      // Sleep until the next kernel attempt can try something new, unless a new tip or wallet change comes first
+      int64_t nWait = gStaker.GetNextAttemptTime() - GetAdjustedTime();
+      if (nWait > 0) {
+        WaitForStakeEvent(std::min(nWait, STAKE_IDLE_WAIT) * 1000, nWakeSeen, fStakingThread);
+        continue;
       }
     }
 
@@ -616,78 +871,54 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake) {
     //
     int64_t nStart = GetTime();
     arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+    powSearch.Post(*pblock, hashTarget);
     while (true) {
-      uint32_t nHashesDone = 0;
-
-      uint256 hash;
-      while (true) {
-        hash = pblock->GetHash();
-        if (UintToArith256(hash) <= hashTarget) {
-          // Found a solution
-          SetThreadPriority(THREAD_PRIORITY_NORMAL);
-          LogPrint(TessaLog::MINER, "proof-of-work found : hash: %s  : target: %s\n", hash.GetHex(),
-                   hashTarget.GetHex());
-          ProcessBlockFound(pblock, *pwallet, reservekey);
-          SetThreadPriority(THREAD_PRIORITY_LOWEST);
-
-          // In regression test mode, stop mining after a block is found. This
-          // allows developers to controllably generate a block on demand.
-          if (Params().MineBlocksOnDemand()) {
-            miner_interrupted = true;
-            interruption_point(miner_interrupted);
-          }
-
-          break;
-        }
-        pblock->nNonce += 1;
-        nHashesDone += 1;
-        if ((pblock->nNonce & 0xFF) == 0) break;
-      }
-
-      // Meter hashes/sec
-      static int64_t nHashCounter;
-      if (nHPSTimerStart == 0) {
-        nHPSTimerStart = GetTimeMillis();
-        nHashCounter = 0;
-      } else
-        nHashCounter += nHashesDone;
-      if (GetTimeMillis() - nHPSTimerStart > 4000) {
-        static CCriticalSection cs;
-        {
-          LOCK(cs);
-          if (GetTimeMillis() - nHPSTimerStart > 4000) {
-            dHashesPerSec = 1000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart);
-            nHPSTimerStart = GetTimeMillis();
-            nHashCounter = 0;
-            static int64_t nLogTime;
-            if (GetTime() - nLogTime > 30 * 60) {
-              nLogTime = GetTime();
-              LogPrint(TessaLog::MINER, "hashmeter %6.0f khash/s\n", dHashesPerSec / 1000.0);
-            }
-          }
-        }
+      uint32_t nNonce;
+      bool fSolved = powSearch.Wait(MINER_POLL_INTERVAL, nNonce);
+      UpdateHashMeter();
+
+      if (fSolved) {
+        pblock->nNonce = nNonce;
+        uint256 hash = pblock->GetHash();
+        // Found a solution
+        SetThreadPriority(THREAD_PRIORITY_NORMAL);
+        LogPrint(TessaLog::MINER, "proof-of-work found : hash: %s  : target: %s\n", hash.GetHex(),
+                 hashTarget.GetHex());
+        ProcessBlockFound(pblock, *pwallet, reservekey);
+        SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+        // In regression test mode, stop mining after a block is found. This
+        // allows developers to controllably generate a block on demand.
+        if (Params().MineBlocksOnDemand()) fGenerateBitcoins = false;
+
+        break;
       }
 
       // Check for stop or if block needs to be rebuilt
       interruption_point(miner_interrupted);
+      if (!fGenerateBitcoins) break;
       // Regtest mode doesn't require peers
       if (vNodes.empty() && Params().MiningRequiresPeers()) break;
-      if (pblock->nNonce >= 0xffff0000) break;
+      if (powSearch.Ended()) break;
       if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60) break;
       if (pindexPrev != chainActive.Tip()) break;
 
-      // Update nTime every few seconds
+      // Move to the current time, which opens a fresh nonce range
+      uint32_t nTimePrev = pblock->nTime;
       UpdateTime(pblock, pindexPrev);
       if (Params().AllowMinDifficultyBlocks()) {
         // Changing pblock->nTime can change work required on testnet:
         hashTarget.SetCompact(pblock->nBits);
       }
+      if (pblock->nTime != nTimePrev) powSearch.Post(*pblock, hashTarget);
     }
+    powSearch.Cancel();
   }
 }
 void InterruptMiner() {
   miner_interrupted = true;
   miner_interrupt_cond.notify_all();
+  powSearch.Cancel();
 }
 
 void static ThreadBitcoinMiner(void* parg) {
@@ -706,9 +937,15 @@ void static ThreadBitcoinMiner(void* parg) {
 
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads) {
   static std::thread miner_thread;
-  fGenerateBitcoins = fGenerate;
 
-  /*
+  // Wind down a running miner before starting over with the new settings
+  fGenerateBitcoins = false;
+  powSearch.Stop();
+  WakeStaker();
+  if (miner_thread.joinable()) miner_thread.join();
+  dHashesPerSec = 0.0;
+  nHPSTimerStart = 0;
+
   if (nThreads < 0) {
     // In regtest threads defaults to 1
     if (Params().DefaultMinerThreads())
@@ -717,17 +954,13 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads) {
       nThreads = std::thread::hardware_concurrency();
   }
 
-  if (minerThreads != nullptr) {
-    minerThreads->interrupt_all();
-    delete minerThreads;
-    minerThreads = nullptr;
-  }
-  */
-
   if (nThreads == 0 || !fGenerate) return;
 
-  // Assume just 1 thread to get this going. TBD add loop later
+  // One thread builds templates and submits blocks, the search threads share its template
+  fGenerateBitcoins = true;
+  powSearch.Start(nThreads);
   auto bindMiner = std::bind(ThreadBitcoinMiner, pwallet);
   miner_thread = std::thread(&TraceThread<decltype(bindMiner)>, "miner", std::move(bindMiner));
-  miner_thread.detach();
 }
+
+int GetMinerThreads() { return powSearch.Threads(); }
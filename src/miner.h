@@ -8,6 +8,7 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include <atomic>
 #include <cstdint>
 
 class CBlock;
@@ -19,8 +20,10 @@ class CWallet;
 
 struct CBlockTemplate;
 
-/** Run the miner threads */
+/** Run the miner threads: one building templates and nThreads searching nonces (-1 for one per core) */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
+/** Number of proof-of-work search threads currently running */
+int GetMinerThreads();
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake);
@@ -31,10 +34,12 @@ void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
 
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
 void InterruptMiner();
+/** Wake the staking thread for a new tip or wallet change */
+void WakeStaker();
 uint64_t getLastBlockTx();
 uint64_t getLastBlockSize();
 
-extern double dHashesPerSec;
-extern int64_t nHPSTimerStart;
+extern std::atomic<double> dHashesPerSec;
+extern std::atomic<int64_t> nHPSTimerStart;
 
 #endif  // BITCOIN_MINER_H
@@ -52,6 +52,9 @@
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
+// Rewrite banlist.dat and drop banlist.log once the journal holds this many records
+#define BANLIST_JOURNAL_COMPACT_RECORDS 256
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -146,17 +149,34 @@ class CAddrDB {
   bool Read(CAddrMan& addr);
 };
 
-/** Access to the banlist database (banlist.dat) */
+/**
+ * Access to the banlist database (banlist.dat) and its journal (banlist.log).
+ * Single ban/unban changes are appended to the journal as self-checksummed
+ * records; Write() compacts everything into a fresh banlist.dat and drops the
+ * journal. Replaying the journal is idempotent, so a crash between the two
+ * steps is harmless, and a torn record at the tail is simply ignored.
+ */
 class CBanDB {
  private:
   fs::path pathBanlist;
+  fs::path pathJournal;
 
  public:
   CBanDB();
   bool Write(const banmap_t& banSet);
   bool Read(banmap_t& banSet);
+  //! Append a ban record, or an unban record if banEntry.nBanUntil is 0
+  bool Append(const CSubNet& subNet, const CBanEntry& banEntry, bool fSync);
+  //! Apply the journal on top of banSet, returns the number of records replayed. A torn or corrupt tail is cut off
+  //! so later appends follow the last good record; fTruncatedRet is false if that failed and the journal must go.
+  int Replay(banmap_t& banSet, bool& fTruncatedRet);
 };
 
+//! Serializes journal appends against compaction, so no record is dropped with the old journal
+static CCriticalSection cs_banJournal;
+//! Number of records in banlist.log since the last compaction
+static std::atomic<int> nBanJournalRecords{0};
+
 static void InterruptibleSleep(uint64_t n) {
   bool ret = false;
   {
@@ -539,12 +559,18 @@ void CNode::Ban(const CSubNet& subNet, const BanReason& banReason, int64_t banti
   banEntry.nBanUntil = (sinceUnixEpoch ? 0 : GetTime()) + bantimeoffset;
 
   {
-    LOCK(cs_setBanned);
-    if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
-      setBanned[subNet] = banEntry;
-      setBannedIsDirty = true;
-    } else
-      return;
+    // Bans and unbans reach the journal in the order they changed setBanned. Journal lock first, as in DumpBanlist.
+    LOCK(cs_banJournal);
+    {
+      LOCK(cs_setBanned);
+      if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
+        setBanned[subNet] = banEntry;
+        setBannedIsDirty = true;
+      } else
+        return;
+    }
+    // journal the ban, syncing to disk immediately if user requested it
+    CBanDB().Append(subNet, banEntry, banReason == BanReasonManuallyAdded);
   }
   uiInterface.BannedListChanged.fire();
   {
@@ -553,7 +579,6 @@ void CNode::Ban(const CSubNet& subNet, const BanReason& banReason, int64_t banti
       if (subNet.Match((CNetAddr)pnode->addr)) pnode->fDisconnect = true;
     }
   }
-  if (banReason == BanReasonManuallyAdded) DumpBanlist();  // store banlist to disk immediately if user requested ban
 }
 
 bool CNode::Unban(const CNetAddr& addr) {
@@ -563,12 +588,15 @@ bool CNode::Unban(const CNetAddr& addr) {
 
 bool CNode::Unban(const CSubNet& subNet) {
   {
-    LOCK(cs_setBanned);
-    if (!setBanned.erase(subNet)) return false;
-    setBannedIsDirty = true;
+    LOCK(cs_banJournal);
+    {
+      LOCK(cs_setBanned);
+      if (!setBanned.erase(subNet)) return false;
+      setBannedIsDirty = true;
+    }
+    CBanDB().Append(subNet, CBanEntry(), true);  // store unban to disk immediately
   }
   uiInterface.BannedListChanged.fire();
-  DumpBanlist();  // store banlist to disk immediately
   return true;
 }
 
@@ -738,19 +766,42 @@ int CNetMessage::readData(const char* pch, uint32_t nBytes) {
     vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
   }
 
+  // Hash the chunk while it is still hot in cache, so the message handler
+  // thread does not have to make a second full pass over large payloads.
+  hasher.Write((const uint8_t*)pch, nCopy);
   memcpy(&vRecv[nDataPos], pch, nCopy);
   nDataPos += nCopy;
 
   return nCopy;
 }
 
+const uint256& CNetMessage::GetMessageHash() const {
+  assert(complete());
+  if (data_hash.IsNull()) const_cast<CHash256&>(hasher).Finalize(data_hash.begin());
+  return data_hash;
+}
+
+// Fill in the checksum of a queued message; done lazily right before the first
+// byte goes out so that large payloads are hashed on the socket thread.
+static void SetMessageChecksum(CSerializeData& data) {
+  assert(data.size() >= CMessageHeader::HEADER_SIZE);
+  uint256 hash = Hash(data.begin() + CMessageHeader::HEADER_SIZE, data.end());
+  uint32_t nChecksum = 0;
+  memcpy(&nChecksum, &hash, sizeof(nChecksum));
+  memcpy(&data[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+}
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode) {
   std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
 
   while (it != pnode->vSendMsg.end()) {
-    const CSerializeData& data = *it;
+    CSerializeData& data = *it;
     assert(data.size() > pnode->nSendOffset);
+    if (!pnode->fSendChecksumSet) {
+      SetMessageChecksum(data);
+      pnode->fSendChecksumSet = true;
+    }
     int nBytes =
         send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
     if (nBytes > 0) {
@@ -760,6 +811,7 @@ void SocketSendData(CNode* pnode) {
       pnode->RecordBytesSent(nBytes);
       if (pnode->nSendOffset == data.size()) {
         pnode->nSendOffset = 0;
+        pnode->fSendChecksumSet = false;
         pnode->nSendSize -= data.size();
         it++;
       } else {
@@ -787,6 +839,12 @@ void SocketSendData(CNode* pnode) {
   pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
+int64_t PoissonNextSend(int64_t nNow, int64_t average_interval_micros) {
+  return nNow + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) *
+                              average_interval_micros * -1.0 +
+                          0.5);
+}
+
 static list<CNode*> vNodesDisconnected;
 
 void ThreadSocketHandler() {
@@ -1242,7 +1300,11 @@ void DumpAddresses() {
 
 void DumpData() {
   DumpAddresses();
-  DumpBanlist();
+  // Bans are journaled as they happen; only compact once the journal has grown
+  if (nBanJournalRecords >= BANLIST_JOURNAL_COMPACT_RECORDS)
+    DumpBanlist();
+  else
+    CNode::SweepBanned();
 }
 
 void static ProcessOneShot() {
@@ -1646,6 +1708,10 @@ void StartNode(CScheduler& scheduler) {
   CBanDB bandb;
   banmap_t banmap;
   if (!bandb.Read(banmap)) LogPrintf("Invalid or missing banlist.dat; recreating\n");
+  bool fJournalTruncated;
+  nBanJournalRecords = bandb.Replay(banmap, fJournalTruncated);
+  // A journal that could not be cut back to its last good record is folded into a fresh banlist.dat instead
+  if (!fJournalTruncated && !bandb.Write(banmap)) LogPrintf("Failed to compact banlist.log\n");
 
   CNode::SetBanned(banmap);         // thread save setter
   CNode::SetBannedSetDirty(false);  // no need to write down just read or nonexistent data
@@ -1715,7 +1781,8 @@ bool StopNode() {
     for (int i = 0; i < MAX_OUTBOUND_CONNECTIONS; i++) semOutbound->post();
 
   if (fAddressesInitialized) {
-    DumpData();
+    DumpAddresses();
+    DumpBanlist();
     fAddressesInitialized = false;
   }
 
@@ -1890,12 +1957,12 @@ bool CAddrDB::Write(const CAddrMan& addr) {
   uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
   ssPeers << hash;
 
-  // open output file, and associate with CAutoFile
-  fs::path pathAddr = GetDataDir() / "peers.dat";
-  FILE* file = fopen(pathAddr.string().c_str(), "wb");
+  // open temp output file, and associate with CAutoFile
+  fs::path pathTmp = GetDataDir() / tmpfn;
+  FILE* file = fopen(pathTmp.string().c_str(), "wb");
   CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
   if (fileout.IsNull()) {
-    LogPrintf("%s : Failed to open file %s", __func__, pathAddr.string());
+    LogPrintf("%s : Failed to open file %s", __func__, pathTmp.string());
     return true;
   }
 
@@ -1906,6 +1973,9 @@ bool CAddrDB::Write(const CAddrMan& addr) {
   FileCommit(fileout.Get());
   fileout.fclose();
 
+  // replace existing peers.dat, if any, with new peers.dat.XXXX so a crash never leaves a torn file
+  if (!RenameOver(pathTmp, pathAddr)) return error("%s : Rename-into-place failed", __func__);
+
   return true;
 }
 
@@ -1960,7 +2030,7 @@ uint32_t ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000
 uint32_t SendBufferSize() { return 1000 * GetArg("-maxsendbuffer", 1 * 1000); }
 
 CNode::CNode(SOCKET hSocketIn, CAddress addrIn, const std::string& addrNameIn, bool fInboundIn)
-    : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000) {
+    : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000), filterInventoryKnown(50000, 0.000001) {
   nServices = 0;
   hSocket = hSocketIn;
   nRecvVersion = INIT_PROTO_VERSION;
@@ -1984,11 +2054,12 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, const std::string& addrNameIn, b
   nRefCount = 0;
   nSendSize = 0;
   nSendOffset = 0;
+  fSendChecksumSet = false;
   hashContinue.SetNull();
   nStartingHeight = -1;
   fGetAddr = false;
   fRelayTxes = false;
-  setInventoryKnown.max_size(SendBufferSize() / 1000);
+  nNextInvSend = 0;
   pfilter = new CBloomFilter();
   nPingNonceSent = 0;
   nPingUsecStart = 0;
@@ -2083,21 +2154,16 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend) {
   uint32_t nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
   memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
 
-  // Set the checksum
-  uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-  uint32_t nChecksum = 0;
-  memcpy(&nChecksum, &hash, sizeof(nChecksum));
-  assert(ssSend.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-  memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
-
+  // The checksum is filled in by SocketSendData just before the message goes out
   LogPrint(TessaLog::NET, "(%d bytes) peer=%d\n", nSize, id);
 
   std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
   ssSend.GetAndClear(*it);
   nSendSize += (*it).size();
 
-  // If write queue empty, attempt "optimistic write"
-  if (it == vSendMsg.begin()) SocketSendData(this);
+  // If write queue empty, attempt "optimistic write". Large payloads are left to
+  // the socket thread so the caller does not pay for hashing them.
+  if (it == vSendMsg.begin() && nSize <= MAX_OPTIMISTIC_WRITE_SIZE) SocketSendData(this);
 
   LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -2106,7 +2172,10 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend) {
 // CBanDB
 //
 
-CBanDB::CBanDB() { pathBanlist = GetDataDir() / "banlist.dat"; }
+CBanDB::CBanDB() {
+  pathBanlist = GetDataDir() / "banlist.dat";
+  pathJournal = GetDataDir() / "banlist.log";
+}
 
 bool CBanDB::Write(const banmap_t& banSet) {
   // Generate random temporary filename
@@ -2139,9 +2208,96 @@ bool CBanDB::Write(const banmap_t& banSet) {
   // replace existing banlist.dat, if any, with new banlist.dat.XXXX
   if (!RenameOver(pathTmp, pathBanlist)) return error("%s: Rename-into-place failed", __func__);
 
+  // every journaled change is now part of banlist.dat
+  fs::remove(pathJournal);
+  nBanJournalRecords = 0;
+
+  return true;
+}
+
+bool CBanDB::Append(const CSubNet& subNet, const CBanEntry& banEntry, bool fSync) {
+  // record: magic, subnet, entry, then the first 4 bytes of the hash of all of that
+  CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+  ssRecord << FLATDATA(Params().MessageStart());
+  ssRecord << subNet;
+  ssRecord << banEntry;
+  uint256 hash = Hash(ssRecord.begin(), ssRecord.end());
+  uint32_t nChecksum = 0;
+  memcpy(&nChecksum, &hash, sizeof(nChecksum));
+  ssRecord << nChecksum;
+
+  LOCK(cs_banJournal);
+  FILE* file = fopen(pathJournal.string().c_str(), "ab");
+  CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+  if (fileout.IsNull()) return error("%s: Failed to open file %s", __func__, pathJournal.string());
+  try {
+    fileout.write(&ssRecord[0], ssRecord.size());
+  } catch (const std::exception& e) { return error("%s: I/O error - %s", __func__, e.what()); }
+  if (fSync) FileCommit(fileout.Get());
+  fileout.fclose();
+
+  nBanJournalRecords++;
   return true;
 }
 
+int CBanDB::Replay(banmap_t& banSet, bool& fTruncatedRet) {
+  fTruncatedRet = true;
+  FILE* file = fopen(pathJournal.string().c_str(), "rb");
+  CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+  if (filein.IsNull()) return 0;
+
+  vector<uint8_t> vchData(fs::file_size(pathJournal));
+  try {
+    if (!vchData.empty()) filein.read((char*)&vchData[0], vchData.size());
+  } catch (const std::exception& e) {
+    error("%s: I/O error - %s", __func__, e.what());
+    return 0;
+  }
+  filein.fclose();
+
+  CDataStream ssJournal(vchData, SER_DISK, CLIENT_VERSION);
+  int nRecords = 0;
+  size_t nGoodSize = 0;
+  while (!ssJournal.empty()) {
+    size_t nRecordStart = vchData.size() - ssJournal.size();
+    uint8_t pchMsgTmp[4];
+    CSubNet subNet;
+    CBanEntry banEntry;
+    uint32_t nChecksum = 0;
+    try {
+      ssJournal >> FLATDATA(pchMsgTmp) >> subNet >> banEntry;
+      size_t nRecordEnd = vchData.size() - ssJournal.size();
+      ssJournal >> nChecksum;
+      uint256 hash = Hash(vchData.begin() + nRecordStart, vchData.begin() + nRecordEnd);
+      if (memcmp(&hash, &nChecksum, sizeof(nChecksum)) != 0 ||
+          memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)) != 0)
+        break;
+    } catch (const std::exception&) {
+      // torn write at the tail of the journal
+      break;
+    }
+    if (banEntry.nBanUntil == 0)
+      banSet.erase(subNet);
+    else
+      banSet[subNet] = banEntry;
+    nRecords++;
+    nGoodSize = vchData.size() - ssJournal.size();
+  }
+
+  if (nGoodSize < vchData.size()) {
+    // Records appended after the garbage would never be replayed, so cut it off before anything is appended
+    LogPrintf("%s: Dropping %u trailing bytes of %s\n", __func__, vchData.size() - nGoodSize, pathJournal.string());
+    file = fopen(pathJournal.string().c_str(), "rb+");
+    fTruncatedRet = file != nullptr && TruncateFile(file, nGoodSize);
+    if (file != nullptr) {
+      FileCommit(file);
+      fclose(file);
+    }
+  }
+
+  return nRecords;
+}
+
 bool CBanDB::Read(banmap_t& banSet) {
   // open input file, and associate with CAutoFile
   FILE* file = fopen(pathBanlist.string().c_str(), "rb");
@@ -2205,14 +2361,17 @@ void SaveJsonBanlist(banmap_t& banmap) {
 void DumpBanlist() {
   CNode::SweepBanned();  // clean unused entries (if bantime has expired)
 
-  if (!CNode::BannedSetIsDirty()) return;
+  if (!CNode::BannedSetIsDirty() && nBanJournalRecords == 0) return;
 
   int64_t nStart = GetTimeMillis();
 
   CBanDB bandb;
   banmap_t banmap;
-  CNode::GetBanned(banmap);
-  if (bandb.Write(banmap)) { CNode::SetBannedSetDirty(false); }
+  {
+    LOCK(cs_banJournal);
+    CNode::GetBanned(banmap);
+    if (bandb.Write(banmap)) { CNode::SetBannedSetDirty(false); }
+  }
 
   SaveJsonBanlist(banmap);
 
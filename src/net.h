@@ -46,6 +46,8 @@ static const uint32_t MAX_INV_SZ = 50000;
 static const uint32_t MAX_ADDR_TO_SEND = 100;
 /** Maximum length of incoming protocol messages (no message over 2 MiB is currently acceptable). */
 static const uint32_t MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
+/** Largest payload that is checksummed and sent directly from the caller's thread */
+static const uint32_t MAX_OPTIMISTIC_WRITE_SIZE = 64 * 1024;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
 /** -upnp default */
@@ -80,6 +82,8 @@ void StartNode(CScheduler& scheduler);
 bool StopNode();
 void InterruptNode();
 void SocketSendData(CNode* pnode);
+/** Return a timestamp in the future (in microseconds) for exponentially distributed events. */
+int64_t PoissonNextSend(int64_t nNow, int64_t average_interval_micros);
 
 // Signals for message handling
 struct CNodeSignals {
@@ -179,6 +183,11 @@ class CNetMessage {
 
   int64_t nTime;  // time (in microseconds) of message receipt.
 
+ private:
+  CHash256 hasher;            // checksum of the payload, fed as data arrives
+  mutable uint256 data_hash;  // finalized hasher output, null until requested
+
+ public:
   CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn) {
     hdrbuf.resize(24);
     in_data = false;
@@ -197,6 +206,9 @@ class CNetMessage {
     vRecv.SetVersion(nVersionIn);
   }
 
+  //! Double-SHA256 of the payload, only valid once complete()
+  const uint256& GetMessageHash() const;
+
   int readHeader(const char* pch, uint32_t nBytes);
   int readData(const char* pch, uint32_t nBytes);
 };
@@ -258,6 +270,7 @@ class CNode {
   CDataStream ssSend;
   size_t nSendSize;    // total size of all vSendMsg entries
   size_t nSendOffset;  // offset inside the first vSendMsg already sent
+  bool fSendChecksumSet;  // header checksum of the first vSendMsg has been filled in
   uint64_t nSendBytes;
   std::deque<CSerializeData> vSendMsg;
   CCriticalSection cs_vSend;
@@ -333,9 +346,14 @@ class CNode {
   std::set<uint256> setKnown;
 
   // inventory based relay
-  mruset<CInv> setInventoryKnown;
+  CRollingBloomFilter filterInventoryKnown;
+  // Set of transaction ids we still have to announce, batched until nNextInvSend.
+  // They are sorted by txid so the announcement order does not leak arrival order.
+  std::set<uint256> setInventoryTxToSend;
+  // Non-transaction inventory (blocks etc), announced on the next SendMessages pass
   std::vector<CInv> vInventoryToSend;
   CCriticalSection cs_inventory;
+  int64_t nNextInvSend;
   std::multimap<int64_t, CInv> mapAskFor;
   std::vector<uint256> vBlockRequested;
 
@@ -411,14 +429,18 @@ class CNode {
   void AddInventoryKnown(const CInv& inv) {
     {
       LOCK(cs_inventory);
-      setInventoryKnown.insert(inv);
+      filterInventoryKnown.insert(inv.hash);
     }
   }
 
   void PushInventory(const CInv& inv) {
     {
       LOCK(cs_inventory);
-      if (!setInventoryKnown.count(inv)) vInventoryToSend.push_back(inv);
+      if (inv.type == MSG_TX) {
+        if (!filterInventoryKnown.contains(inv.hash)) setInventoryTxToSend.insert(inv.hash);
+      } else {
+        vInventoryToSend.push_back(inv);
+      }
     }
   }
 
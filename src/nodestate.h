@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "coin_constants.h"
 #include "netbase.h"
 
 class CBlockIndex;
@@ -63,6 +64,18 @@ struct CNodeState {
   int nBlocksInFlight;
   //! Whether we consider this a preferred download peer.
   bool fPreferredDownload;
+  //! Number of blocks this peer delivered that we had requested from it.
+  int nBlocksDelivered;
+  //! Moving average of the serialized size of delivered blocks.
+  double dAvgBlockBytes;
+  //! Moving average of observed block download throughput, in bytes per second.
+  double dBlockBytesPerSec;
+  //! Time (in microseconds) the last requested block arrived from this peer, or 0.
+  int64_t nLastBlockDelivered;
+  //! Last measured ping round-trip time (in microseconds).
+  int64_t nPingUsecTime;
+  //! How many blocks we are currently willing to have in flight from this peer.
+  int nBlockDownloadWindow;
 
   CNodeState() {
     fCurrentlyConnected = false;
@@ -75,6 +88,12 @@ struct CNodeState {
     nStallingSince = 0;
     nBlocksInFlight = 0;
     fPreferredDownload = false;
+    nBlocksDelivered = 0;
+    dAvgBlockBytes = 0;
+    dBlockBytesPerSec = 0;
+    nLastBlockDelivered = 0;
+    nPingUsecTime = 0;
+    nBlockDownloadWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
   }
 };
 }  // namespace
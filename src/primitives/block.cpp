@@ -7,7 +7,10 @@
 
 #include "primitives/block.h"
 
+#include "checkqueue.h"
+#include "coin_constants.h"
 #include "crypto/hashargon2d.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "script/sign.h"
 #include "script/standard.h"
@@ -15,6 +18,9 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <mutex>
+#include <thread>
+
 uint256 CBlockHeader::GetHash() const {
 #ifndef POWARGON
   return Hash(BEGIN(nHeaderVersion), END(nAccumulatorCheckpoint));
@@ -62,17 +68,24 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const {
   vMerkleTree.clear();
   vMerkleTree.reserve(vtx.size() * 2 + 16);  // Safe upper bound for the number of total nodes.
   for (const auto& it : vtx) { vMerkleTree.push_back(it.GetHash()); }
+  static_assert(sizeof(uint256) == 32, "merkle levels are hashed as packed 64-byte pairs");
   int j = 0;
   bool mutated = false;
   for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2) {
-    for (int i = 0; i < nSize; i += 2) {
-      int i2 = std::min(i + 1, nSize - 1);
-      if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j + i] == vMerkleTree[j + i2]) {
-        // Two identical hashes at the end of the list at a particular level.
-        mutated = true;
-      }
-      vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j + i]), END(vMerkleTree[j + i]), BEGIN(vMerkleTree[j + i2]),
-                                 END(vMerkleTree[j + i2])));
+    if (nSize % 2 == 0 && vMerkleTree[j + nSize - 2] == vMerkleTree[j + nSize - 1]) {
+      // Two identical hashes at the end of the list at a particular level.
+      mutated = true;
+    }
+    // Each pair of neighbouring nodes is one 64-byte message, so a level is hashed in one batch
+    int nPairs = nSize / 2;
+    vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+    SHA256D64(vMerkleTree[j + nSize].begin(), vMerkleTree[j].begin(), nPairs);
+    if (nSize % 2) {
+      // An odd node out is paired with itself
+      unsigned char pair[64];
+      memcpy(pair, vMerkleTree[j + nSize - 1].begin(), 32);
+      memcpy(pair + 32, vMerkleTree[j + nSize - 1].begin(), 32);
+      SHA256D64(vMerkleTree[j + nSize + nPairs].begin(), pair, 1);
     }
     j += nSize;
   }
@@ -80,6 +93,110 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const {
   return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
+// Hash a merkle level of n nodes in place into the level above and return its size. Same rules as BuildMerkleTree: an
+// odd node out is paired with itself, and two identical nodes ending an even level are a mutation.
+static size_t ReduceMerkleLevel(uint256* level, size_t n, bool* mutated) {
+  if (mutated && n % 2 == 0 && level[n - 2] == level[n - 1]) *mutated = true;
+  size_t nPairs = n / 2;
+  SHA256D64(level[0].begin(), level[0].begin(), nPairs);
+  if (n % 2) {
+    unsigned char pair[64];
+    memcpy(pair, level[n - 1].begin(), 32);
+    memcpy(pair + 32, level[n - 1].begin(), 32);
+    SHA256D64(level[nPairs].begin(), pair, 1);
+  }
+  return nPairs + n % 2;
+}
+
+/** A power-of-two subtree of a big block's merkle tree, hashed in place up to its root by a merkle worker */
+struct CMerkleSubtree {
+  uint256* pLeaves = nullptr;
+  int nHeight = 0;
+
+  bool operator()() {
+    size_t n = (size_t)1 << nHeight;
+    for (int l = 0; l < nHeight; l++) n = ReduceMerkleLevel(pLeaves, n, nullptr);
+    return true;
+  }
+  void swap(CMerkleSubtree& other) {
+    std::swap(pLeaves, other.pLeaves);
+    std::swap(nHeight, other.nHeight);
+  }
+};
+
+/**
+ * Workers for the subtrees of big blocks, started on first use and kept for the life of the process. One block is
+ * hashed at a time; the thread computing it joins in as the master of the queue.
+ */
+class CMerkleWorkers {
+  std::vector<std::thread> threads;
+
+ public:
+  CCheckQueue<CMerkleSubtree> queue{1};
+  std::mutex cs;
+  const size_t nThreads;
+
+  CMerkleWorkers() : nThreads(std::max(std::thread::hardware_concurrency(), 1U)) {
+    for (size_t i = 1; i < nThreads; i++) threads.emplace_back([this]() {
+      RenameThread("tessa-merkle");
+      queue.Thread();
+    });
+  }
+  ~CMerkleWorkers() {
+    queue.Interrupt();
+    for (std::thread& thread : threads) thread.join();
+  }
+};
+
+static CMerkleWorkers& MerkleWorkers() {
+  static CMerkleWorkers workers;
+  return workers;
+}
+
+uint256 CBlock::ComputeMerkleRoot(bool* fMutated) const {
+  // Any tree built for an earlier vtx is stale now, GetMerkleBranch rebuilds it when asked
+  vMerkleTree.clear();
+
+  std::vector<uint256> hashes(vtx.size());
+  for (size_t i = 0; i < vtx.size(); i++) hashes[i] = vtx[i].GetHash();
+  size_t n = hashes.size();
+  bool mutated = false;
+
+  // Big blocks are split into equal power-of-two subtrees, one per merkle worker and at least two. Their roots are
+  // inner nodes of the whole tree, so the levels above finish it as usual. Only the last subtree holds the end of
+  // each of its levels, so it alone checks for mutation, and it is raised to full height by pairing a lone node with
+  // itself like any level. A block arriving while the workers hash another is done serially here instead.
+  if (n >= MERKLE_PARALLEL_MIN_LEAVES) {
+    CMerkleWorkers& workers = MerkleWorkers();
+    std::unique_lock<std::mutex> lock(workers.cs, std::try_to_lock);
+    if (lock.owns_lock()) {
+      size_t nSplit = std::max<size_t>(workers.nThreads, 2);
+      int nHeight = 0;
+      while (((size_t)1 << nHeight) * nSplit < n) nHeight++;
+      size_t nChunk = (size_t)1 << nHeight;
+      size_t nChunks = (n + nChunk - 1) / nChunk;
+
+      std::vector<CMerkleSubtree> vSubtrees(nChunks - 1);
+      for (size_t c = 0; c + 1 < nChunks; c++) {
+        vSubtrees[c].pLeaves = &hashes[c * nChunk];
+        vSubtrees[c].nHeight = nHeight;
+      }
+      CCheckQueueControl<CMerkleSubtree> control(&workers.queue);
+      control.Add(vSubtrees);
+      size_t m = n - (nChunks - 1) * nChunk;
+      for (int l = 0; l < nHeight; l++) m = ReduceMerkleLevel(&hashes[(nChunks - 1) * nChunk], m, &mutated);
+      control.Wait();
+
+      for (size_t c = 1; c < nChunks; c++) hashes[c] = hashes[c * nChunk];
+      n = nChunks;
+    }
+  }
+
+  while (n > 1) n = ReduceMerkleLevel(hashes.data(), n, &mutated);
+  if (fMutated) *fMutated = mutated;
+  return n ? hashes[0] : uint256();
+}
+
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const {
   if (vMerkleTree.empty()) BuildMerkleTree();
   std::vector<uint256> vMerkleBranch;
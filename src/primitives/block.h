@@ -135,6 +135,10 @@ class CBlock : public CBlockHeader {
   // merkle root).
   uint256 BuildMerkleTree(bool* mutated = nullptr) const;
 
+  // Compute only the merkle root, with the same mutation check as BuildMerkleTree. Does not keep the tree, and hashes
+  // the subtrees of big blocks on several threads.
+  uint256 ComputeMerkleRoot(bool* mutated = nullptr) const;
+
   std::vector<uint256> GetMerkleBranch(int nIndex) const;
   static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
   std::string ToString() const;
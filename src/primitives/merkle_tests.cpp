@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include "coin_constants.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+
+#include <thread>
+#include <vector>
+
+/** A block of n transactions told apart by their lock time */
+static CBlock MakeBlock(size_t n) {
+  CBlock block;
+  for (size_t i = 0; i < n; i++) {
+    CMutableTransaction tx;
+    tx.nLockTime = i;
+    block.vtx.push_back(CTransaction(tx));
+  }
+  return block;
+}
+
+TEST_CASE("merkle_parallel_matches_serial") {
+  // BuildMerkleTree hashes every level serially. ComputeMerkleRoot splits blocks from MERKLE_PARALLEL_MIN_LEAVES
+  // leaves into subtrees on the merkle workers, with a partial last subtree whenever the count isn't a multiple of
+  // the subtree size.
+  const size_t nMin = MERKLE_PARALLEL_MIN_LEAVES;
+  for (size_t n : {nMin - 1, nMin, nMin + 1, nMin + 3, nMin * 3 / 2 + 1, nMin * 2 - 1, nMin * 2 + 1, nMin * 5 + 7}) {
+    CBlock block = MakeBlock(n);
+    bool fMutatedSerial = true, fMutatedParallel = true;
+    uint256 hashSerial = block.BuildMerkleTree(&fMutatedSerial);
+    REQUIRE(block.ComputeMerkleRoot(&fMutatedParallel) == hashSerial);
+    REQUIRE(!fMutatedSerial);
+    REQUIRE(!fMutatedParallel);
+  }
+}
+
+TEST_CASE("merkle_parallel_mutation") {
+  // A duplicated last transaction is caught whichever path hashes the block
+  for (size_t n : {MERKLE_PARALLEL_MIN_LEAVES, MERKLE_PARALLEL_MIN_LEAVES * 3 + 2}) {
+    CBlock block = MakeBlock(n - 1);
+    block.vtx.push_back(block.vtx.back());
+    bool fMutatedSerial = false, fMutatedParallel = false;
+    uint256 hashSerial = block.BuildMerkleTree(&fMutatedSerial);
+    REQUIRE(block.ComputeMerkleRoot(&fMutatedParallel) == hashSerial);
+    REQUIRE(fMutatedSerial);
+    REQUIRE(fMutatedParallel);
+  }
+}
+
+TEST_CASE("merkle_parallel_concurrent_blocks") {
+  // Blocks hashed at the same time share the workers or fall back to the serial path, with the same roots
+  std::vector<CBlock> vBlocks;
+  std::vector<uint256> vExpected;
+  for (size_t i = 0; i < 4; i++) {
+    vBlocks.push_back(MakeBlock(MERKLE_PARALLEL_MIN_LEAVES * 2 + 2 * i + 1));
+    vExpected.push_back(vBlocks.back().BuildMerkleTree());
+  }
+  std::vector<uint256> vRoots(vBlocks.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < vBlocks.size(); i++)
+    threads.emplace_back([&vBlocks, &vRoots, i]() {
+      for (int j = 0; j < 8; j++) vRoots[i] = vBlocks[i].ComputeMerkleRoot();
+    });
+  for (std::thread& thread : threads) thread.join();
+  REQUIRE(vRoots == vExpected);
+}
+
+int main(int argc, char* argv[]) {
+  int result = Catch::Session().run(argc, argv);
+  return result;
+}
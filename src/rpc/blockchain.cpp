@@ -189,14 +189,15 @@ UniValue mempoolToJSON(bool fVerbose = false) {
       info.push_back(std::make_pair("height", (int)e.GetHeight()));
       info.push_back(std::make_pair("startingpriority", e.GetPriority(e.GetHeight())));
       info.push_back(std::make_pair("currentpriority", e.GetPriority(chainActive.Height())));
-      const CTransaction& tx = e.GetTx();
-      set<string> setDepends;
-      for (const CTxIn& txin : tx.vin) {
-        if (mempool.exists(txin.prevout.hash)) setDepends.insert(txin.prevout.hash.ToString());
-      }
+      info.push_back(std::make_pair("descendantcount", (int64_t)e.GetCountWithDescendants()));
+      info.push_back(std::make_pair("descendantsize", (int64_t)e.GetSizeWithDescendants()));
+      info.push_back(std::make_pair("descendantfees", ValueFromAmount(e.GetModFeesWithDescendants())));
+      info.push_back(std::make_pair("ancestorcount", (int64_t)e.GetCountWithAncestors()));
+      info.push_back(std::make_pair("ancestorsize", (int64_t)e.GetSizeWithAncestors()));
+      info.push_back(std::make_pair("ancestorfees", ValueFromAmount(e.GetModFeesWithAncestors())));
 
       UniValue depends(UniValue::VARR);
-      for (const string& dep : setDepends) { depends.push_back(dep); }
+      for (const uint256& parent : mempool.mapLinks[hash].parents) { depends.push_back(parent.ToString()); }
 
       info.push_back(std::make_pair("depends", depends));
       o.push_back(std::make_pair(hash.ToString(), info));
@@ -238,6 +239,12 @@ UniValue getrawmempool(const UniValue& params, bool fHelp) {
         "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
         "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
         "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+        "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+        "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+        "    \"descendantfees\" : n,   (numeric) modified fees of in-mempool descendants (including this one)\n"
+        "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+        "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+        "    \"ancestorfees\" : n,     (numeric) modified fees of in-mempool ancestors (including this one)\n"
         "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
         "        \"transactionid\",    (string) parent transaction id\n"
         "       ... ]\n"
@@ -757,7 +764,10 @@ UniValue mempoolInfoToJSON() {
   UniValue ret(UniValue::VOBJ);
   ret.push_back(std::make_pair("size", (int64_t)mempool.size()));
   ret.push_back(std::make_pair("bytes", (int64_t)mempool.GetTotalTxSize()));
-  // ret.push_back(std::make_pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+  ret.push_back(std::make_pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+  size_t nMaxMempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+  ret.push_back(std::make_pair("maxmempool", (int64_t)nMaxMempool));
+  ret.push_back(std::make_pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(nMaxMempool))));
 
   return ret;
 }
@@ -772,6 +782,9 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp) {
         "{\n"
         "  \"size\": xxxxx                (numeric) Current tx count\n"
         "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+        "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+        "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+        "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee per kB for tx to be accepted\n"
         "}\n"
 
         "\nExamples:\n" +
@@ -49,6 +49,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {{"stop", 0},
                                                      {"listtransactions", 1},
                                                      {"listtransactions", 2},
                                                      {"listtransactions", 3},
+                                                     {"listtransactions", 4},
                                                      {"listaccounts", 0},
                                                      {"listaccounts", 1},
                                                      {"walletpassphrase", 1},
@@ -66,6 +67,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {{"stop", 0},
                                                      {"listunspent", 1},
                                                      {"listunspent", 2},
                                                      {"listunspent", 3},
+                                                     {"listunspent", 4},
                                                      {"getblock", 1},
                                                      {"getblockheader", 1},
                                                      {"gettransaction", 1},
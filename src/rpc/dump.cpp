@@ -93,8 +93,6 @@ UniValue importprivkey(const UniValue& params, bool fHelp) {
         HelpExampleCli("importprivkey", "\"mykey\" \"testing\" false") + "\nAs a JSON-RPC call\n" +
         HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", false"));
 
-  LOCK2(cs_main, pwalletMain->cs_wallet);
-
   EnsureWalletIsUnlocked();
 
   string strSecret = params[0].get_str();
@@ -112,22 +110,25 @@ UniValue importprivkey(const UniValue& params, bool fHelp) {
   assert(key.VerifyPubKey(pubkey));
   CKeyID vchAddress = pubkey.GetID();
   {
-    pwalletMain->MarkDirty();
+    LOCK2(cs_main, pwalletMain->cs_wallet);
     pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
     // Don't throw error in case a key is already there
     if (pwalletMain->HaveKey(vchAddress)) return NullUniValue;
 
+    pwalletMain->MarkDirty();
+
     pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
 
     if (!pwalletMain->AddKeyPubKey(key, pubkey)) throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
 
     // whenever a key is imported, we need to scan the whole chain
     pwalletMain->nTimeFirstKey = 1;  // 0 would be considered 'no value'
-
-    if (fRescan) { pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true); }
   }
 
+  // The rescan takes the locks itself, only while it adds what it found
+  if (fRescan) { pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true); }
+
   return NullUniValue;
 }
 
@@ -151,8 +152,6 @@ UniValue importaddress(const UniValue& params, bool fHelp) {
         HelpExampleCli("importaddress", "\"myaddress\" \"testing\" false") + "\nAs a JSON-RPC call\n" +
         HelpExampleRpc("importaddress", "\"myaddress\", \"testing\", false"));
 
-  LOCK2(cs_main, pwalletMain->cs_wallet);
-
   CScript script;
   CTxDestination address;
 
@@ -174,6 +173,7 @@ UniValue importaddress(const UniValue& params, bool fHelp) {
   if (params.size() > 2) fRescan = params[2].get_bool();
 
   {
+    LOCK2(cs_main, pwalletMain->cs_wallet);
     if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
       throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
 
@@ -186,11 +186,12 @@ UniValue importaddress(const UniValue& params, bool fHelp) {
     pwalletMain->MarkDirty();
 
     if (!pwalletMain->AddWatchOnly(script)) throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+  }
 
-    if (fRescan) {
-      pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-      pwalletMain->ReacceptWalletTransactions();
-    }
+  // The rescan takes the locks itself, only while it adds what it found
+  if (fRescan) {
+    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+    pwalletMain->ReacceptWalletTransactions();
   }
 
   return NullUniValue;
@@ -222,6 +222,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp) {
         "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see "
         "getgenerate or setgenerate calls)\n"
         "  \"hashespersec\": n          (numeric) The hashes per second of the generation, or 0 if no generation.\n"
+        "  \"minerthreads\": n          (numeric) The number of threads searching for proof-of-work\n"
         "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
         "  \"testnet\": true|false      (boolean) If using testnet or not\n"
         "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
@@ -246,6 +247,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp) {
   if (!WalletDisabled()) {
     obj.push_back(std::make_pair("generate", getgenerate(params, false)));
     obj.push_back(std::make_pair("hashespersec", gethashespersec(params, false)));
+    obj.push_back(std::make_pair("minerthreads", GetMinerThreads()));
   }
   return obj;
 }
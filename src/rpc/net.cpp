@@ -105,7 +105,10 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp) {
         "    \"inflight\": [\n"
         "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
         "       ...\n"
-        "    ]\n"
+        "    ],\n"
+        "    \"blocksdelivered\": n,      (numeric) The number of requested blocks this peer has delivered\n"
+        "    \"blockdownloadrate\": n,    (numeric) Observed block download throughput in bytes per second\n"
+        "    \"blockwindow\": n,          (numeric) The number of blocks we allow in flight from this peer\n"
         "  }\n"
         "  ,...\n"
         "]\n"
@@ -150,6 +153,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp) {
       UniValue heights(UniValue::VARR);
       for (int height : statestats.vHeightInFlight) { heights.push_back(height); }
       obj.push_back(std::make_pair("inflight", heights));
+      obj.push_back(std::make_pair("blocksdelivered", statestats.nBlocksDelivered));
+      obj.push_back(std::make_pair("blockdownloadrate", statestats.dBlockBytesPerSec));
+      obj.push_back(std::make_pair("blockwindow", statestats.nBlockDownloadWindow));
     }
     obj.push_back(std::make_pair("whitelisted", stats.fWhitelisted));
 
@@ -29,6 +29,7 @@
 #include <univalue/univalue.h>
 
 #include <cstdint>
+#include <limits>
 
 using namespace ecdsa;
 using namespace std;
@@ -189,9 +190,9 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp) {
 }
 
 UniValue listunspent(const UniValue& params, bool fHelp) {
-  if (fHelp || params.size() > 4)
+  if (fHelp || params.size() > 5)
     throw runtime_error(
-        "listunspent ( minconf maxconf  [\"address\",...] )\n"
+        "listunspent ( minconf maxconf  [\"address\",...] watchonlyconfig options )\n"
         "\nReturns array of unspent transaction outputs\n"
         "with between minconf and maxconf (inclusive) confirmations.\n"
         "Optionally filter to only include txouts paid to specified addresses.\n"
@@ -208,6 +209,14 @@ UniValue listunspent(const UniValue& params, bool fHelp) {
         "    ]\n"
         "4. watchonlyconfig  (numberic, optional, default=1) 1 = list regular unspent transactions, 2 = list only "
         "watchonly transactions,  3 = list all unspent transactions (including watchonly)\n"
+        "5. options          (object, optional) Return one page of the outputs, filtered by the options\n"
+        "    {\n"
+        "      \"count\": n,          (numeric, optional, default=100) The most outputs to return\n"
+        "      \"cursor\": \"...\",     (string, optional) Continue from the \"next\" of the previous page\n"
+        "      \"minamount\": x.xxx,  (numeric, optional) Only outputs of at least this amount\n"
+        "      \"maxamount\": x.xxx,  (numeric, optional) Only outputs of at most this amount\n"
+        "      \"account\": \"...\",    (string, optional) Only outputs to addresses of this account\n"
+        "    }\n"
 
         "\nResult\n"
         "[                   (array of json object)\n"
@@ -222,9 +231,11 @@ UniValue listunspent(const UniValue& params, bool fHelp) {
         "  }\n"
         "  ,...\n"
         "]\n"
+        "With options, an object: {\"unspent\": [...], \"next\": \"cursor\"}, next being null on the last page\n"
 
         "\nExamples\n" +
         HelpExampleCli("listunspent", "") +
+        HelpExampleCli("listunspent", "1 9999999 [] 1 \"{\\\"count\\\":500}\"") +
         HelpExampleCli(
             "listunspent",
             "6 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"") +
@@ -232,7 +243,7 @@ UniValue listunspent(const UniValue& params, bool fHelp) {
             "listunspent",
             "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\""));
 
-  RPCTypeCheck(params, {UniValue::VNUM, UniValue::VNUM, UniValue::VARR, UniValue::VNUM});
+  RPCTypeCheck(params, {UniValue::VNUM, UniValue::VNUM, UniValue::VARR, UniValue::VNUM, UniValue::VOBJ});
 
   int nMinDepth = 1;
   if (params.size() > 0) nMinDepth = params[0].get_int();
@@ -260,20 +271,77 @@ UniValue listunspent(const UniValue& params, bool fHelp) {
     if (nWatchonlyConfig > 3 || nWatchonlyConfig < 1) nWatchonlyConfig = 1;
   }
 
-  UniValue results(UniValue::VARR);
-  vector<COutput> vecOutputs;
+  bool fPaged = params.size() > 4;
+  size_t nCount = 100;
+  bool fAfter = false;
+  COutPoint outpointAfter;
+  CAmount nMinAmount = 0;
+  CAmount nMaxAmount = std::numeric_limits<CAmount>::max();
+  bool fAccount = false;
+  string strAccount;
+  if (fPaged) {
+    const UniValue& options = params[4];
+    RPCTypeCheckObj(options,
+                    {{"count", UniValue::VNUM}, {"cursor", UniValue::VSTR}, {"minamount", UniValue::VNUM},
+                     {"maxamount", UniValue::VNUM}, {"account", UniValue::VSTR}},
+                    true);
+    if (!options["count"].isNull()) {
+      if (options["count"].get_int() < 1) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+      nCount = options["count"].get_int();
+    }
+    if (!options["cursor"].isNull()) {
+      // The outpoint the previous page ended with, as txid:vout
+      const string& strCursor = options["cursor"].get_str();
+      size_t nColon = strCursor.find(':');
+      int64_t n;
+      if (nColon != 64 || !IsHex(strCursor.substr(0, 64)) || !ParseInt64(strCursor.substr(65), &n) || n < 0 ||
+          n > std::numeric_limits<uint32_t>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+      outpointAfter = COutPoint(uint256S(strCursor.substr(0, 64)), n);
+      fAfter = true;
+    }
+    if (!options["minamount"].isNull()) nMinAmount = AmountFromValue(options["minamount"]);
+    if (!options["maxamount"].isNull()) nMaxAmount = AmountFromValue(options["maxamount"]);
+    if (!options["account"].isNull()) {
+      fAccount = true;
+      strAccount = options["account"].get_str();
+    }
+  }
+
   assert(pwalletMain != nullptr);
   LOCK2(cs_main, pwalletMain->cs_wallet);
-  pwalletMain->AvailableCoins(vecOutputs, false, nullptr, false, ALL_COINS, false, nWatchonlyConfig);
-  for (const COutput& out : vecOutputs) {
-    if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth) continue;
 
-    if (setAddress.size()) {
+  auto fInclude = [&](const COutput& out) {
+    if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth) return false;
+
+    CAmount nValue = out.tx->vout[out.i].nValue;
+    if (nValue < nMinAmount || nValue > nMaxAmount) return false;
+
+    if (setAddress.size() || fAccount) {
       CTxDestination address;
-      if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) continue;
+      if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) return false;
 
-      if (!setAddress.count(address)) continue;
+      if (setAddress.size() && !setAddress.count(address)) return false;
+      if (fAccount) {
+        const auto mi = pwalletMain->mapAddressBook.find(address);
+        if (mi == pwalletMain->mapAddressBook.end() || mi->second.name != strAccount) return false;
+      }
     }
+    return true;
+  };
+
+  vector<COutput> vecOutputs;
+  bool fMore = false;
+  if (fPaged) {
+    fMore = pwalletMain->AvailableCoinsAfter(vecOutputs, fAfter ? &outpointAfter : nullptr, nCount,
+                                             nWatchonlyConfig, fInclude);
+  } else {
+    pwalletMain->AvailableCoins(vecOutputs, false, nullptr, false, ALL_COINS, false, nWatchonlyConfig);
+  }
+
+  UniValue results(UniValue::VARR);
+  for (const COutput& out : vecOutputs) {
+    if (!fPaged && !fInclude(out)) continue;
 
     CAmount nValue = out.tx->vout[out.i].nValue;
     const CScript& pk = out.tx->vout[out.i].scriptPubKey;
@@ -302,7 +370,17 @@ UniValue listunspent(const UniValue& params, bool fHelp) {
     results.push_back(entry);
   }
 
-  return results;
+  if (!fPaged) return results;
+
+  UniValue ret(UniValue::VOBJ);
+  ret.push_back(std::make_pair("unspent", results));
+  if (fMore) {
+    const COutput& last = vecOutputs.back();
+    ret.push_back(std::make_pair("next", strprintf("%s:%u", last.tx->GetHash().GetHex(), last.i)));
+  } else {
+    ret.push_back(std::make_pair("next", NullUniValue));
+  }
+  return ret;
 }
 
 UniValue createrawtransaction(const UniValue& params, bool fHelp) {
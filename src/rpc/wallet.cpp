@@ -27,6 +27,8 @@
 #include "wallet_externs.h"
 
 #include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <thread>
 
 #include "libzerocoin/PrivateCoin.h"
@@ -104,8 +106,6 @@ UniValue getnewaddress(const UniValue& params, bool fHelp) {
   string strAccount;
   if (params.size() > 0) strAccount = AccountFromValue(params[0]);
 
-  if (!pwalletMain->IsLocked()) pwalletMain->TopUpKeyPool();
-
   // Generate a new key that is added to wallet
   CPubKey newKey;
   if (!pwalletMain->GetKeyFromPool(newKey))
@@ -190,8 +190,6 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp) {
 
   LOCK2(cs_main, pwalletMain->cs_wallet);
 
-  if (!pwalletMain->IsLocked()) pwalletMain->TopUpKeyPool();
-
   CReserveKey reservekey(pwalletMain);
   CPubKey vchPubKey;
   if (!reservekey.GetReservedKey(vchPubKey))
@@ -1198,8 +1196,27 @@ static void MaybePushAddress(UniValue& entry, const CTxDestination& dest) {
     entry.push_back(std::make_pair("address", EncodeDestination(dest)));
 }
 
+/** Server-side filter of listtransactions pages, checked before an entry is built */
+struct CListTxFilter {
+  bool fAddress = false;
+  string strAddress;
+  bool fCategory = false;
+  string strCategory;
+  CAmount nMinAmount = 0;
+  CAmount nMaxAmount = std::numeric_limits<CAmount>::max();
+
+  bool Matches(const CTxDestination& dest, const string& strEntryCategory, CAmount nAmount) const {
+    if (fAddress && (std::holds_alternative<CNoDestination>(dest) || EncodeDestination(dest) != strAddress))
+      return false;
+    if (fCategory && strEntryCategory != strCategory) return false;
+    nAmount = std::llabs(nAmount);
+    return nAmount >= nMinAmount && nAmount <= nMaxAmount;
+  }
+};
+
+/** An entry the filter rejects is left as a null placeholder, so entries keep their place for paging */
 void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, bool fLong, UniValue& ret,
-                      const isminefilter& filter) {
+                      const isminefilter& filter, const CListTxFilter* pTxFilter = nullptr) {
   CAmount nFee;
   string strSentAccount;
   list<COutputEntry> listReceived;
@@ -1212,15 +1229,19 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
 
   // Sent
   if ((!listSent.empty() || nFee != 0) && (fAllAccounts || strAccount == strSentAccount)) {
+    std::map<std::string, std::string>::const_iterator it = wtx.mapValue.find("DS");
+    const string strCategory = (it != wtx.mapValue.end() && it->second == "1") ? "darksent" : "send";
     for (const COutputEntry& s : listSent) {
+      if (pTxFilter && !pTxFilter->Matches(s.destination, strCategory, s.amount)) {
+        ret.push_back(NullUniValue);
+        continue;
+      }
       UniValue entry(UniValue::VOBJ);
       if (involvesWatchonly || (::IsMine(*pwalletMain, s.destination) & ISMINE_WATCH_ONLY))
         entry.push_back(std::make_pair("involvesWatchonly", true));
       entry.push_back(std::make_pair("account", strSentAccount));
       MaybePushAddress(entry, s.destination);
-      std::map<std::string, std::string>::const_iterator it = wtx.mapValue.find("DS");
-      entry.push_back(
-          std::make_pair("category", (it != wtx.mapValue.end() && it->second == "1") ? "darksent" : "send"));
+      entry.push_back(std::make_pair("category", strCategory));
       entry.push_back(std::make_pair("amount", ValueFromAmount(-s.amount)));
       entry.push_back(std::make_pair("vout", s.vout));
       entry.push_back(std::make_pair("fee", ValueFromAmount(-nFee)));
@@ -1235,21 +1256,25 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
       string account;
       if (pwalletMain->mapAddressBook.count(r.destination)) account = pwalletMain->mapAddressBook[r.destination].name;
       if (fAllAccounts || (account == strAccount)) {
-        UniValue entry(UniValue::VOBJ);
-        if (involvesWatchonly || (::IsMine(*pwalletMain, r.destination) & ISMINE_WATCH_ONLY))
-          entry.push_back(std::make_pair("involvesWatchonly", true));
-        entry.push_back(std::make_pair("account", account));
-        MaybePushAddress(entry, r.destination);
+        string strCategory = "receive";
         if (wtx.IsCoinBase()) {
           if (wtx.GetDepthInMainChain() < 1)
-            entry.push_back(std::make_pair("category", "orphan"));
+            strCategory = "orphan";
           else if (wtx.GetBlocksToMaturity() > 0)
-            entry.push_back(std::make_pair("category", "immature"));
+            strCategory = "immature";
           else
-            entry.push_back(std::make_pair("category", "generate"));
-        } else {
-          entry.push_back(std::make_pair("category", "receive"));
+            strCategory = "generate";
+        }
+        if (pTxFilter && !pTxFilter->Matches(r.destination, strCategory, r.amount)) {
+          ret.push_back(NullUniValue);
+          continue;
         }
+        UniValue entry(UniValue::VOBJ);
+        if (involvesWatchonly || (::IsMine(*pwalletMain, r.destination) & ISMINE_WATCH_ONLY))
+          entry.push_back(std::make_pair("involvesWatchonly", true));
+        entry.push_back(std::make_pair("account", account));
+        MaybePushAddress(entry, r.destination);
+        entry.push_back(std::make_pair("category", strCategory));
         entry.push_back(std::make_pair("amount", ValueFromAmount(r.amount)));
         entry.push_back(std::make_pair("vout", r.vout));
         if (fLong) WalletTxToJSON(wtx, entry);
@@ -1259,10 +1284,15 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
   }
 }
 
-void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, UniValue& ret) {
+void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, UniValue& ret,
+                   const CListTxFilter* pTxFilter = nullptr) {
   bool fAllAccounts = (strAccount == string("*"));
 
   if (fAllAccounts || acentry.strAccount == strAccount) {
+    if (pTxFilter && !pTxFilter->Matches(CNoDestination(), "move", acentry.nCreditDebit)) {
+      ret.push_back(NullUniValue);
+      return;
+    }
     UniValue entry(UniValue::VOBJ);
     entry.push_back(std::make_pair("account", acentry.strAccount));
     entry.push_back(std::make_pair("category", "move"));
@@ -1275,9 +1305,9 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
 }
 
 UniValue listtransactions(const UniValue& params, bool fHelp) {
-  if (fHelp || params.size() > 4)
+  if (fHelp || params.size() > 5)
     throw runtime_error(
-        "listtransactions ( \"account\" count from includeWatchonly)\n"
+        "listtransactions ( \"account\" count from includeWatchonly options )\n"
         "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account "
         "'account'.\n"
 
@@ -1289,6 +1319,14 @@ UniValue listtransactions(const UniValue& params, bool fHelp) {
         "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
         "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see "
         "'importaddress')\n"
+        "5. options        (object, optional) Page back through the history, filtered by the options\n"
+        "    {\n"
+        "      \"cursor\": \"...\",     (string, optional) Continue from the \"next\" of the previous page\n"
+        "      \"address\": \"...\",    (string, optional) Only entries for this address\n"
+        "      \"category\": \"...\",   (string, optional) Only entries of this category\n"
+        "      \"minamount\": x.xxx,  (numeric, optional) Only entries of at least this absolute amount\n"
+        "      \"maxamount\": x.xxx,  (numeric, optional) Only entries of at most this absolute amount\n"
+        "    }\n"
 
         "\nResult:\n"
         "[\n"
@@ -1340,6 +1378,8 @@ UniValue listtransactions(const UniValue& params, bool fHelp) {
         "                                          negative amounts).\n"
         "  }\n"
         "]\n"
+        "With options, an object: {\"transactions\": [...], \"next\": \"cursor\"}, next being null once the oldest\n"
+        "entry was returned. Entries arriving after the first page don't shift the pages that follow it.\n"
 
         "\nExamples:\n"
         "\nList the most recent 10 transactions in the systems\n" +
@@ -1363,10 +1403,78 @@ UniValue listtransactions(const UniValue& params, bool fHelp) {
   if (nCount < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
   if (nFrom < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-  UniValue ret(UniValue::VARR);
-
   const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
 
+  if (params.size() > 4) {
+    const UniValue& options = params[4].get_obj();
+    if (nCount < 1) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+    RPCTypeCheckObj(options,
+                    {{"cursor", UniValue::VSTR}, {"address", UniValue::VSTR}, {"category", UniValue::VSTR},
+                     {"minamount", UniValue::VNUM}, {"maxamount", UniValue::VNUM}},
+                    true);
+    CListTxFilter txFilter;
+    if (!options["address"].isNull()) {
+      txFilter.fAddress = true;
+      txFilter.strAddress = options["address"].get_str();
+    }
+    if (!options["category"].isNull()) {
+      txFilter.fCategory = true;
+      txFilter.strCategory = options["category"].get_str();
+    }
+    if (!options["minamount"].isNull()) txFilter.nMinAmount = AmountFromValue(options["minamount"]);
+    if (!options["maxamount"].isNull()) txFilter.nMaxAmount = AmountFromValue(options["maxamount"]);
+
+    // The cursor names the first entry not returned yet: the nOrderPos of its transaction or accounting entry, and
+    // its place among the entries that one makes. Items are visited newest first from there.
+    int64_t nCursorPos = std::numeric_limits<int64_t>::max();
+    int64_t nCursorEntry = 0;
+    if (!options["cursor"].isNull()) {
+      const string& strCursor = options["cursor"].get_str();
+      size_t nColon = strCursor.find(':');
+      if (nColon == string::npos || !ParseInt64(strCursor.substr(0, nColon), &nCursorPos) ||
+          !ParseInt64(strCursor.substr(nColon + 1), &nCursorEntry) || nCursorEntry < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+
+    UniValue transactions(UniValue::VARR);
+    UniValue next;
+    for (auto it = CWallet::TxItems::const_reverse_iterator(txOrdered.upper_bound(nCursorPos));
+         it != txOrdered.rend() && next.isNull(); ++it) {
+      UniValue entries(UniValue::VARR);
+      CWalletTx* const pwtx = (*it).second.first;
+      if (pwtx != nullptr) ListTransactions(*pwtx, strAccount, 0, true, entries, filter, &txFilter);
+      CAccountingEntry* const pacentry = (*it).second.second;
+      if (pacentry != nullptr) AcentryToJSON(*pacentry, strAccount, entries, &txFilter);
+
+      for (size_t i = (it->first == nCursorPos ? nCursorEntry : 0); i < entries.size(); i++) {
+        if (entries[i].isNull()) continue;
+        if (nFrom > 0) {
+          nFrom--;
+          continue;
+        }
+        if ((int)transactions.size() == nCount) {
+          next = strprintf("%d:%u", it->first, i);
+          break;
+        }
+        transactions.push_back(entries[i]);
+      }
+    }
+
+    // Return oldest to newest, as without options
+    vector<UniValue> arrTmp = transactions.getValues();
+    std::reverse(arrTmp.begin(), arrTmp.end());
+    transactions.clear();
+    transactions.setArray();
+    transactions.push_backV(arrTmp);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(std::make_pair("transactions", transactions));
+    ret.push_back(std::make_pair("next", next));
+    return ret;
+  }
+
+  UniValue ret(UniValue::VARR);
+
   // iterate backwards until we have nCount items to return:
   for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
     CWalletTx* const pwtx = (*it).second.first;
@@ -1549,8 +1657,8 @@ UniValue listsinceblock(const UniValue& params, bool fHelp) {
 
   UniValue transactions(UniValue::VARR);
 
-  for (auto& it : pwalletMain->mapWallet) {
-    CWalletTx tx = it.second;
+  for (const auto& it : pwalletMain->mapWallet) {
+    const CWalletTx& tx = it.second;
     if (depth == -1 || tx.GetDepthInMainChain(false) < depth) ListTransactions(tx, "*", 0, true, transactions, filter);
   }
 
@@ -1721,7 +1829,7 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp) {
   if (!pwalletMain->Unlock(strWalletPass, anonymizeOnly))
     throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
-  pwalletMain->TopUpKeyPool();
+  pwalletMain->TopUpKeyPoolInBackground();
 
   int64_t nSleepTime = params[1].get_int64();
   LOCK(cs_nWalletUnlockTime);
@@ -16,29 +16,55 @@
 using namespace std;
 using namespace ecdsa;
 
-//! Tessa Stake
-bool CStake::SetInput(CTransaction txPrev, uint32_t n) {
-  this->txFrom = txPrev;
-  this->nPosition = n;
+// Find an output and the active chain block that holds it. The coins view and block index answer this for an output
+// unspent at the tip; only one that is spent there, e.g. staked on a fork, needs its transaction read back.
+static bool FindStakeOutput(const COutPoint& prevout, CTxOut& txout, CBlockIndex*& pindexFrom) {
+  LOCK(cs_main);
+  pindexFrom = nullptr;
+  const CCoins* coins = gpCoinsTip->AccessCoins(prevout.hash);
+  if (coins && coins->IsAvailable(prevout.n)) {
+    txout = coins->vout[prevout.n];
+    pindexFrom = chainActive[coins->nHeight];
+    return true;
+  }
+
+  uint256 hashBlock;
+  CTransaction txPrev;
+  if (!GetTransaction(prevout.hash, txPrev, hashBlock, true) || prevout.n >= txPrev.vout.size()) {
+    LogPrintf("%s : failed to find tx %s\n", __func__, prevout.hash.GetHex());
+    return false;
+  }
+  txout = txPrev.vout[prevout.n];
+  // If the index is in the chain, then set it as the "index from"
+  auto mi = mapBlockIndex.find(hashBlock);
+  if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) pindexFrom = mi->second;
   return true;
 }
 
-bool CStake::GetTxFrom(CTransaction& tx) {
-  tx = txFrom;
+//! Tessa Stake
+bool CStake::SetInput(const CTransaction& txPrev, uint32_t n) {
+  this->prevout = COutPoint(txPrev.GetHash(), n);
+  this->txout = txPrev.vout[n];
+  this->pindexFrom = nullptr;
   return true;
 }
 
+bool CStake::SetInput(const COutPoint& prevoutIn) {
+  this->prevout = prevoutIn;
+  return FindStakeOutput(prevout, txout, pindexFrom);
+}
+
 bool CStake::CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut) {
-  txIn = CTxIn(txFrom.GetHash(), nPosition);
+  txIn = CTxIn(prevout.hash, prevout.n);
   return true;
 }
 
-CAmount CStake::GetValue() { return txFrom.vout[nPosition].nValue; }
+CAmount CStake::GetValue() { return txout.nValue; }
 
 bool CStake::CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, CAmount nTotal) {
   vector<valtype> vSolutions;
   txnouttype whichType;
-  CScript scriptPubKeyKernel = txFrom.vout[nPosition].scriptPubKey;
+  CScript scriptPubKeyKernel = txout.scriptPubKey;
   if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
     LogPrintf("CreateCoinStake : failed to parse kernel\n");
     return false;
@@ -68,13 +94,11 @@ bool CStake::CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, CAmount nTotal
 }
 
 bool CStake::GetModifier(uint64_t& nStakeModifier) {
-  int nStakeModifierHeight = 0;
-  int64_t nStakeModifierTime = 0;
   GetIndexFrom();
   if (!pindexFrom) return error("%s: failed to get index from", __func__);
 
-  if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime,
-                              false))
+  const CBlockIndex* pindexModifier;
+  if (!GetKernelStakeModifier(pindexFrom, nStakeModifier, pindexModifier))
     return error("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
 
   return true;
@@ -83,23 +107,15 @@ bool CStake::GetModifier(uint64_t& nStakeModifier) {
 CDataStream CStake::GetUniqueness() {
   // The unique identifier for a Tessa stake is the outpoint
   CDataStream ss(SER_NETWORK, 0);
-  ss << nPosition << txFrom.GetHash();
+  ss << prevout.n << prevout.hash;
   return ss;
 }
 
 // The block that the UTXO was added to the chain
 CBlockIndex* CStake::GetIndexFrom() {
-  uint256 hashBlock;
-  CTransaction tx;
-  if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
-    // If the index is in the chain, then set it as the "index from"
-    if (mapBlockIndex.count(hashBlock)) {
-      CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
-      if (chainActive.Contains(pindex)) pindexFrom = pindex;
-    }
-  } else {
-    LogPrintf("%s : failed to find tx %s\n", __func__, txFrom.GetHash().GetHex());
+  if (!pindexFrom) {
+    CTxOut txoutFound;
+    FindStakeOutput(prevout, txoutFound, pindexFrom);
   }
-
   return pindexFrom;
 }
@@ -20,16 +20,18 @@ class CDataStream;
 class CStake {
  private:
   CBlockIndex* pindexFrom;
-  CTransaction txFrom;
-  uint32_t nPosition;
+  COutPoint prevout;
+  CTxOut txout;
 
  public:
   CStake() { this->pindexFrom = nullptr; }
 
-  bool SetInput(CTransaction txPrev, uint32_t n);
+  bool SetInput(const CTransaction& txPrev, uint32_t n);
+  // Look the output up in the chain state, as when validating a coinstake that spends it
+  bool SetInput(const COutPoint& prevoutIn);
 
   CBlockIndex* GetIndexFrom();
-  bool GetTxFrom(CTransaction& tx);
+  const CTxOut& GetTxOut() const { return txout; }
   CAmount GetValue();
   bool GetModifier(uint64_t& nStakeModifier);
   CDataStream GetUniqueness();
@@ -1,8 +1,21 @@
 #include "staker.h"
+#include "blockmap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "coin_constants.h"
+#include "main.h"
+#include "miner.h"
+#include "output.h"
 #include "pow.h"
+#include "timedata.h"
+#include "util.h"
+#include "utiltime.h"
 #include "wallet/wallet.h"
 #include "wallet/wallettx.h"
 
+#include <limits>
+#include <mutex>
+
 CStaker gStaker;
 
 bool CStaker::FindStake(int64_t time, CBlockIndex* pindexPrev, CBlock* pblock, CWallet* pwallet) {
@@ -25,3 +38,191 @@ bool CStaker::FindStake(int64_t time, CBlockIndex* pindexPrev, CBlock* pblock, C
   }
   return fStakeFound;
 }
+
+void CStaker::UpdateCandidates(CWallet* pwallet) {
+  AssertLockHeld(cs_main);
+  std::vector<COutput> vCoins;
+  pwallet->AvailableCoins(vCoins, true, nullptr, false, STAKABLE_COINS);
+
+  std::map<COutPoint, CStakeCandidate> mapUpdated;
+  for (const COutput& out : vCoins) {
+    COutPoint prevout(out.tx->GetHash(), out.i);
+    auto it = mapCandidates.find(prevout);
+    if (it != mapCandidates.end() && chainActive.Contains(it->second.pindexFrom)) {
+      mapUpdated.insert(*it);
+      continue;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) continue;
+
+    CStakeCandidate candidate;
+    candidate.nValue = out.tx->vout[out.i].nValue;
+    // if zerocoinspend, then use the block time
+    candidate.nTxTime = out.tx->IsZerocoinSpend() ? mi->second->GetBlockTime() : out.tx->GetTxTime();
+    candidate.fCoinStake = out.tx->IsCoinStake();
+    candidate.pindexFrom = mi->second;
+    mapUpdated.emplace(prevout, candidate);
+  }
+  mapCandidates.swap(mapUpdated);
+
+  {
+    LOCK(pwallet->cs_wallet);
+    nWalletTxCandidates = pwallet->mapWallet.size();
+  }
+  pwalletCandidates = pwallet;
+  fCandidatesDirty = false;
+  LogPrint(TessaLog::MINER, "%s: %u stake candidates\n", __func__, mapCandidates.size());
+}
+
+void CStaker::RegisterEvents() {
+  static std::once_flag fRegistered;
+  std::call_once(fRegistered, [this]() { RegisterValidationInterface(this); });
+}
+
+void CStaker::UpdatedBlockTip(const CBlockIndex* pindex) {
+  // a new tip opens a new search epoch, try it right away
+  nNextAttemptTime = 0;
+  WakeStaker();
+}
+
+void CStaker::SyncTransaction(const CTransaction& tx, const CBlock* pblock) {
+  LOCK(cs_main);
+  // spent candidates drop out right away, outputs of ours are picked up once confirmed
+  for (const CTxIn& txin : tx.vin) mapCandidates.erase(txin.prevout);
+  if (pblock && pwalletCandidates && pwalletCandidates->IsMine(tx)) {
+    fCandidatesDirty = true;
+    nNextAttemptTime = 0;
+    WakeStaker();
+  }
+}
+
+bool CStaker::FindKernel(CWallet* pwallet, uint32_t nBits, CAmount nTargetAmount, uint32_t& nTimeTx,
+                         COutPoint& prevout, uint256& hashProofOfStake) {
+  nNextAttemptTime = std::numeric_limits<int64_t>::max();
+  if (!GetBoolArg("-stake", true)) return false;
+  RegisterEvents();
+
+  arith_uint256 bnTargetPerCoinDay;
+  bnTargetPerCoinDay.SetCompact(nBits);
+
+  // Collect the kernels of the eligible candidates under cs_main and hash them without holding it. Kernels already
+  // tried in this epoch only need the timestamps that entered the drift window since, new ones need all of them.
+  // The search stops at the first hit, so kernels and timestamps only count as tried once a search comes up empty.
+  std::vector<CStakeKernel> vKernels, vNewKernels;
+  std::vector<COutPoint> vPrevouts, vNewPrevouts;
+  uint32_t nTimeStart, nTimeNew, nTimeEnd, nEpoch;
+  int nHeightStart;
+  {
+    LOCK(cs_main);
+    bool fWalletChanged;
+    {
+      LOCK(pwallet->cs_wallet);
+      fWalletChanged = pwallet != pwalletCandidates || pwallet->mapWallet.size() != nWalletTxCandidates;
+    }
+    if (fCandidatesDirty || fWalletChanged) UpdateCandidates(pwallet);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    nHeightStart = pindexTip->nHeight;
+    if (hashSearchTip != pindexTip->GetBlockHash() || nSearchBits != nBits) {
+      hashSearchTip = pindexTip->GetBlockHash();
+      nSearchBits = nBits;
+      nSearchEpoch++;
+      nSearchedTime = 0;
+    }
+    nEpoch = nSearchEpoch;
+
+    // only try times the block can carry: past the median time past and within the hash drift from now
+    nTimeStart = std::max<int64_t>(nTimeTx, pindexTip->GetMedianTimePast()) + 1;
+    nTimeNew = std::max(nTimeStart, nSearchedTime + 1);
+    nTimeEnd = nTimeTx + STAKE_HASH_DRIFT;
+
+    CAmount nAmountSelected = 0;
+    int64_t nNow = GetAdjustedTime();
+    int64_t nNextEligibleTime = std::numeric_limits<int64_t>::max();
+    for (auto& entry : mapCandidates) {
+      CStakeCandidate& candidate = entry.second;
+      if (!chainActive.Contains(candidate.pindexFrom)) {
+        // reorganized away, the wallet knows where it confirmed again
+        fCandidatesDirty = true;
+        continue;
+      }
+      if (pwallet->IsLockedCoin(entry.first.hash, entry.first.n)) continue;
+
+      // make sure not to outrun target amount
+      if (nAmountSelected + candidate.nValue > nTargetAmount) continue;
+
+      // check for min age
+      int64_t nEligibleTime = std::max(candidate.nTxTime + Params().StakeMinAge(),
+                                       candidate.pindexFrom->GetBlockTime() + Params().StakeMinAge() - 1);
+      if (nNow - candidate.nTxTime < Params().StakeMinAge() ||
+          candidate.pindexFrom->GetBlockTime() + Params().StakeMinAge() > nTimeStart) {
+        nNextEligibleTime = std::min(nNextEligibleTime, nEligibleTime);
+        continue;
+      }
+
+      // check that it is matured
+      int nDepth = nHeightStart - candidate.pindexFrom->nHeight + 1;
+      if (nDepth < (candidate.fCoinStake ? Params().COINBASE_MATURITY() : 10)) continue;
+
+      nAmountSelected += candidate.nValue;
+
+      // the modifier only needs looking up again while it can still change with the tip
+      const CBlockIndex* pindexModifier = candidate.pindexModifier;
+      if (!pindexModifier || !chainActive.Contains(pindexModifier) || pindexModifier->nHeight >= nHeightStart) {
+        uint64_t nStakeModifier = 0;
+        if (!GetKernelStakeModifier(candidate.pindexFrom, nStakeModifier, candidate.pindexModifier)) continue;
+        CStakeKernel kernel(nStakeModifier, candidate.pindexFrom->GetBlockTime(), entry.first);
+        if (memcmp(kernel.data(), candidate.kernel.data(), CStakeKernel::SIZE) != 0) {
+          candidate.kernel = kernel;
+          candidate.nSearchEpoch = 0;
+        }
+      }
+
+      // weight is equal to coin amount
+      candidate.kernel.bnTarget = (arith_uint256(candidate.nValue) / 100) * bnTargetPerCoinDay;
+      if (candidate.nSearchEpoch == nSearchEpoch) {
+        vKernels.push_back(candidate.kernel);
+        vPrevouts.push_back(entry.first);
+      } else {
+        vNewKernels.push_back(candidate.kernel);
+        vNewPrevouts.push_back(entry.first);
+      }
+    }
+
+    // the next timestamp enters the window a second after the last one tried
+    int64_t nNextTime = (vKernels.empty() && vNewKernels.empty()) ? std::numeric_limits<int64_t>::max()
+                                                                   : (int64_t)nTimeEnd + 1 - STAKE_HASH_DRIFT;
+    nNextAttemptTime = std::min(nNextTime, nNextEligibleTime);
+  }
+  if (vKernels.empty() && vNewKernels.empty()) return false;
+
+  int64_t nStart = GetTimeMillis();
+  size_t nKernel = 0;
+  bool fFound = false;
+  if (FindStakeKernel(vNewKernels, nTimeStart, nTimeEnd, nHeightStart, nKernel, nTimeTx, hashProofOfStake)) {
+    prevout = vNewPrevouts[nKernel];
+    fFound = true;
+  } else if (FindStakeKernel(vKernels, nTimeNew, nTimeEnd, nHeightStart, nKernel, nTimeTx, hashProofOfStake)) {
+    prevout = vPrevouts[nKernel];
+    fFound = true;
+  }
+  LogPrint(TessaLog::MINER, "%s: hashed %u new and %u known kernels in %dms\n", __func__, vNewKernels.size(),
+           vKernels.size(), GetTimeMillis() - nStart);
+
+  {
+    LOCK(cs_main);
+    if (!fFound && nSearchEpoch == nEpoch) {
+      // every kernel was hashed over the whole window: mark it all tried. After a hit the rest was skipped, and the
+      // stake may yet fail, so the next search goes over the same ground.
+      for (const COutPoint& prevoutNew : vNewPrevouts) {
+        auto it = mapCandidates.find(prevoutNew);
+        if (it != mapCandidates.end()) it->second.nSearchEpoch = nEpoch;
+      }
+      nSearchedTime = std::max(nSearchedTime, nTimeEnd);
+    }
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime();  // store a time stamp of when we last hashed on this block
+  }
+  return fFound;
+}
@@ -1,6 +1,12 @@
 #pragma once
+#include "amount.h"
+#include "kernel.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <map>
 
 class CWallet;
 class CBlock;
@@ -12,11 +18,31 @@ class CBlockIndex;
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
-class CStaker {
+// A wallet output that may stake, kept across staking rounds together with its precomputed kernel
+struct CStakeCandidate {
+  CAmount nValue = 0;
+  int64_t nTxTime = 0;  //! time the min age is measured from
+  bool fCoinStake = false;
+  const CBlockIndex* pindexFrom = nullptr;
+  //! block the kernel's modifier was taken from, null until the modifier is final
+  const CBlockIndex* pindexModifier = nullptr;
+  CStakeKernel kernel;
+  //! search epoch whose earlier timestamps the kernel has already been tried against
+  uint32_t nSearchEpoch = 0;
+};
+
+class CStaker : public CValidationInterface {
  public:
   CStaker() {
     nLastCoinStakeSearchInterval = 0;
     init = false;
+    pwalletCandidates = nullptr;
+    nWalletTxCandidates = 0;
+    fCandidatesDirty = true;
+    nSearchBits = 0;
+    nSearchEpoch = 0;
+    nSearchedTime = 0;
+    nNextAttemptTime = 0;
   }
 
   void setLastCoinStakeSearchInterval(int64_t t) { nLastCoinStakeSearchInterval = t; }
@@ -34,7 +60,40 @@ class CStaker {
 
   bool FindStake(int64_t time, CBlockIndex* Tip, CBlock* pblock, CWallet* pwallet);
 
+  // Hash the kernels of the wallet's eligible stake candidates, up to nTargetAmount in value, against the times
+  // after nTimeTx. On success sets nTimeTx, the kernel's prevout and hashProofOfStake.
+  bool FindKernel(CWallet* pwallet, uint32_t nBits, CAmount nTargetAmount, uint32_t& nTimeTx, COutPoint& prevout,
+                  uint256& hashProofOfStake);
+
+  // Start listening for new tips and wallet transactions, which wake the staking thread
+  void RegisterEvents();
+
+  // Adjusted time at which another kernel search can try something new: the next timestamp entering the hash
+  // drift window or a candidate reaching the min age. 0 when a search is due now, max when only events can help.
+  int64_t GetNextAttemptTime() const { return nNextAttemptTime; }
+
+ protected:
+  void UpdatedBlockTip(const CBlockIndex* pindex) override;
+  void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override;
+
  private:
+  // Refresh the candidate set from the wallet's stakable coins, keeping the cached kernels of known outputs
+  void UpdateCandidates(CWallet* pwallet);
+
+  //! Stake candidates by outpoint, guarded by cs_main
+  std::map<COutPoint, CStakeCandidate> mapCandidates;
+  CWallet* pwalletCandidates;
+  size_t nWalletTxCandidates;  //! wallet size the candidates were collected at
+  bool fCandidatesDirty;
+
+  //! What the kernels have been hashed against so far: the tip and target of the current search epoch and the
+  //! last timestamp tried in it, guarded by cs_main
+  uint256 hashSearchTip;
+  uint32_t nSearchBits;
+  uint32_t nSearchEpoch;
+  uint32_t nSearchedTime;
+  std::atomic<int64_t> nNextAttemptTime;
+
   std::set<std::pair<COutPoint, uint32_t> > setStakeSeen;
   int64_t nLastCoinStakeSearchTime;
   int64_t nLastCoinStakeSearchInterval;
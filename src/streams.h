@@ -249,6 +249,49 @@ class CDataStream {
   }
 };
 
+/** Read-only stream over a buffer it does not own, such as a value in an LMDB map.
+ *
+ * Unserializes straight out of the borrowed bytes without copying them first, so it must not outlive them.
+ */
+class CSpanReader {
+ private:
+  const char* pbegin;
+  const char* pend;
+  int nType;
+  int nVersion;
+
+ public:
+  CSpanReader(const void* pdata, size_t nSize, int nTypeIn, int nVersionIn)
+      : pbegin((const char*)pdata), pend((const char*)pdata + nSize), nType(nTypeIn), nVersion(nVersionIn) {}
+
+  size_t size() const { return pend - pbegin; }
+  bool empty() const { return pbegin == pend; }
+  bool eof() const { return empty(); }
+  const char* data() const { return pbegin; }
+
+  int GetType() const { return nType; }
+  int GetVersion() const { return nVersion; }
+
+  CSpanReader& read(char* pch, size_t nSize) {
+    if (nSize > size()) throw std::ios_base::failure("CSpanReader::read() : end of data");
+    if (nSize) memcpy(pch, pbegin, nSize);
+    pbegin += nSize;
+    return (*this);
+  }
+
+  CSpanReader& ignore(size_t nSize) {
+    if (nSize > size()) throw std::ios_base::failure("CSpanReader::ignore() : end of data");
+    pbegin += nSize;
+    return (*this);
+  }
+
+  template <typename T> CSpanReader& operator>>(T& obj) {
+    // Unserialize from this stream
+    ::Unserialize(*this, obj);
+    return (*this);
+  }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -17,28 +17,89 @@
 #include "streams.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utiltime.h"
 #include "validationstate.h"
 #include "version.h"
 #include <algorithm>
+#include <cmath>
 #include <deque>
+#include <limits>
 #include <random>
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0) {
+namespace {
+/** Bytes the allocator really hands out for a request of alloc bytes (16-byte granularity, one word of header) */
+inline size_t MallocUsage(size_t alloc) {
+  if (alloc == 0) return 0;
+  return ((alloc + sizeof(void*) + 15) >> 4) << 4;
+}
+
+/** Heap usage of a node of a std::map/std::set holding T: the value plus parent/left/right pointers and color */
+template <typename T> inline size_t TreeNodeUsage() { return MallocUsage(sizeof(T) + 4 * sizeof(void*)); }
+
+size_t TransactionUsage(const CTransaction& tx) {
+  size_t nUsage = MallocUsage(tx.vin.capacity() * sizeof(CTxIn)) + MallocUsage(tx.vout.capacity() * sizeof(CTxOut));
+  for (const CTxIn& txin : tx.vin) nUsage += MallocUsage(txin.scriptSig.capacity());
+  for (const CTxOut& txout : tx.vout) nUsage += MallocUsage(txout.scriptPubKey.capacity());
+  return nUsage;
+}
+}  // namespace
+
+CTxMemPoolEntry::CTxMemPoolEntry()
+    : nFee(0),
+      nTxSize(0),
+      nModSize(0),
+      nUsageSize(0),
+      nTime(0),
+      dPriority(0.0),
+      nFeeDelta(0),
+      nCountWithDescendants(1),
+      nSizeWithDescendants(0),
+      nModFeesWithDescendants(0),
+      nCountWithAncestors(1),
+      nSizeWithAncestors(0),
+      nModFeesWithAncestors(0) {
   nHeight = MEMPOOL_HEIGHT;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority,
                                  uint32_t _nHeight)
-    : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight) {
+    : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0) {
   nTxSize = ::GetSerializeSize(tx);
 
   nModSize = tx.CalculateModifiedSize(nTxSize);
+  nUsageSize = TransactionUsage(tx);
+
+  nCountWithDescendants = nCountWithAncestors = 1;
+  nSizeWithDescendants = nSizeWithAncestors = nTxSize;
+  nModFeesWithDescendants = nModFeesWithAncestors = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other) { *this = other; }
 
+void CTxMemPoolEntry::UpdateFeeDelta(CAmount feeDelta) {
+  nModFeesWithDescendants += feeDelta - nFeeDelta;
+  nModFeesWithAncestors += feeDelta - nFeeDelta;
+  nFeeDelta = feeDelta;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount) {
+  nSizeWithDescendants += modifySize;
+  assert(int64_t(nSizeWithDescendants) > 0);
+  nModFeesWithDescendants += modifyFee;
+  nCountWithDescendants += modifyCount;
+  assert(int64_t(nCountWithDescendants) > 0);
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount) {
+  nSizeWithAncestors += modifySize;
+  assert(int64_t(nSizeWithAncestors) > 0);
+  nModFeesWithAncestors += modifyFee;
+  nCountWithAncestors += modifyCount;
+  assert(int64_t(nCountWithAncestors) > 0);
+}
+
 double CTxMemPoolEntry::GetPriority(uint32_t currentHeight) const {
   CAmount nValueIn = tx.GetValueOut() + nFee;
   double deltaPriority = ((double)(currentHeight - nHeight) * nValueIn) / nModSize;
@@ -203,7 +264,14 @@ class CMinerPolicyEstimator {
   }
 };
 
-CTxMemPool::CTxMemPool(const CAmount& _minRelayFee) : nTransactionsUpdated(0), minRelayFee(_minRelayFee) {
+CTxMemPool::CTxMemPool(const CAmount& _minRelayFee)
+    : nTransactionsUpdated(0),
+      minRelayFee(_minRelayFee),
+      totalTxSize(0),
+      cachedInnerUsage(0),
+      lastRollingFeeUpdate(GetTime()),
+      blockSinceLastRollingFeeBump(false),
+      rollingMinimumFeeRate(0) {
   // Sanity checks off by default for performance, because otherwise
   // accepting transactions becomes O(N^2) where N is the number
   // of transactions in the pool
@@ -241,23 +309,214 @@ void CTxMemPool::AddTransactionsUpdated(uint32_t n) {
   nTransactionsUpdated += n;
 }
 
+double CTxMemPool::DescendantScore(const CTxMemPoolEntry& entry) {
+  // Zerocoin spends pay no fee but are given priority into blocks, so never evict them ahead of paying transactions
+  if (entry.GetTx().IsZerocoinSpend()) return std::numeric_limits<double>::max();
+  // A parent is worth keeping as long as its best descendant package pays for it
+  return std::max(entry.GetFeeRate(), entry.GetDescendantFeeRate());
+}
+
+double CTxMemPool::AncestorScore(const CTxMemPoolEntry& entry) {
+  if (entry.GetTx().IsZerocoinSpend()) return std::numeric_limits<double>::max();
+  // A child is only as attractive as the cheapest of itself and the package it needs mined along with it
+  return std::min(entry.GetFeeRate(), entry.GetAncestorFeeRate());
+}
+
+void CTxMemPool::IndexEntry(const_txiter it) {
+  setByDescendantScore.insert(std::make_pair(DescendantScore(it->second), it->first));
+  setByAncestorScore.insert(std::make_pair(AncestorScore(it->second), it->first));
+  setByEntryTime.insert(std::make_pair(it->second.GetTime(), it->first));
+}
+
+void CTxMemPool::UnindexEntry(const_txiter it) {
+  setByDescendantScore.erase(std::make_pair(DescendantScore(it->second), it->first));
+  setByAncestorScore.erase(std::make_pair(AncestorScore(it->second), it->first));
+  setByEntryTime.erase(std::make_pair(it->second.GetTime(), it->first));
+}
+
+void CTxMemPool::UpdateDescendants(txiter it, int64_t modifySize, CAmount modifyFee, int64_t modifyCount) {
+  setByDescendantScore.erase(std::make_pair(DescendantScore(it->second), it->first));
+  it->second.UpdateDescendantState(modifySize, modifyFee, modifyCount);
+  setByDescendantScore.insert(std::make_pair(DescendantScore(it->second), it->first));
+}
+
+void CTxMemPool::UpdateAncestors(txiter it, int64_t modifySize, CAmount modifyFee, int64_t modifyCount) {
+  setByAncestorScore.erase(std::make_pair(AncestorScore(it->second), it->first));
+  it->second.UpdateAncestorState(modifySize, modifyFee, modifyCount);
+  setByAncestorScore.insert(std::make_pair(AncestorScore(it->second), it->first));
+}
+
+void CTxMemPool::CollectAncestors(const std::set<uint256>& setParents, std::set<uint256>& setAncestors) const {
+  std::vector<uint256> vToVisit(setParents.begin(), setParents.end());
+  while (!vToVisit.empty()) {
+    uint256 hash = vToVisit.back();
+    vToVisit.pop_back();
+    if (!setAncestors.insert(hash).second) continue;
+    auto itLinks = mapLinks.find(hash);
+    if (itLinks == mapLinks.end()) continue;
+    for (const uint256& parent : itLinks->second.parents) {
+      if (!setAncestors.count(parent)) vToVisit.push_back(parent);
+    }
+  }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const {
+  LOCK(cs);
+  std::vector<uint256> vToVisit(1, hash);
+  while (!vToVisit.empty()) {
+    uint256 hashVisit = vToVisit.back();
+    vToVisit.pop_back();
+    if (!setDescendants.insert(hashVisit).second) continue;
+    auto itLinks = mapLinks.find(hashVisit);
+    if (itLinks == mapLinks.end()) continue;
+    for (const uint256& child : itLinks->second.children) {
+      if (!setDescendants.count(child)) vToVisit.push_back(child);
+    }
+  }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors,
+                                           uint64_t limitAncestorCount, uint64_t limitDescendantCount,
+                                           std::string& errString) const {
+  LOCK(cs);
+  std::set<uint256> setParents;
+  if (!tx.IsZerocoinSpend()) {
+    for (const CTxIn& txin : tx.vin) {
+      if (mapTx.count(txin.prevout.hash)) setParents.insert(txin.prevout.hash);
+    }
+  }
+  CollectAncestors(setParents, setAncestors);
+
+  if (setAncestors.size() + 1 > limitAncestorCount) {
+    errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+    return false;
+  }
+  for (const uint256& hashAncestor : setAncestors) {
+    const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+    if (ancestor.GetCountWithDescendants() + 1 > limitDescendantCount) {
+      errString = strprintf("too many descendants for tx %s [limit: %u]", hashAncestor.ToString(),
+                            limitDescendantCount);
+      return false;
+    }
+  }
+  return true;
+}
+
+void CTxMemPool::LinkEntry(const uint256& parent, const uint256& child) {
+  if (mapLinks[parent].children.insert(child).second) cachedInnerUsage += TreeNodeUsage<uint256>();
+  if (mapLinks[child].parents.insert(parent).second) cachedInnerUsage += TreeNodeUsage<uint256>();
+}
+
+void CTxMemPool::RecalculatePackageState(txiter it) {
+  UnindexEntry(it);
+  CTxMemPoolEntry& entry = it->second;
+
+  std::set<uint256> setAncestors;
+  CollectAncestors(mapLinks[it->first].parents, setAncestors);
+  entry.UpdateAncestorState(entry.GetTxSize() - entry.GetSizeWithAncestors(),
+                            entry.GetModifiedFee() - entry.GetModFeesWithAncestors(),
+                            1 - (int64_t)entry.GetCountWithAncestors());
+  for (const uint256& hashAncestor : setAncestors) {
+    const CTxMemPoolEntry& ancestor = mapTx.at(hashAncestor);
+    entry.UpdateAncestorState(ancestor.GetTxSize(), ancestor.GetModifiedFee(), 1);
+  }
+
+  std::set<uint256> setDescendants;
+  CalculateDescendants(it->first, setDescendants);
+  setDescendants.erase(it->first);
+  entry.UpdateDescendantState(entry.GetTxSize() - entry.GetSizeWithDescendants(),
+                              entry.GetModifiedFee() - entry.GetModFeesWithDescendants(),
+                              1 - (int64_t)entry.GetCountWithDescendants());
+  for (const uint256& hashDescendant : setDescendants) {
+    const CTxMemPoolEntry& descendant = mapTx.at(hashDescendant);
+    entry.UpdateDescendantState(descendant.GetTxSize(), descendant.GetModifiedFee(), 1);
+  }
+  IndexEntry(it);
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry) {
   // Add to memory pool without checking anything.
   // Used by main.cpp AcceptToMemoryPool(), which DOES do
   // all the appropriate checks.
   LOCK(cs);
   {
-    mapTx[hash] = entry;
-    const CTransaction& tx = mapTx[hash].GetTx();
+    if (mapTx.count(hash)) return true;
+    txiter it = mapTx.insert(std::make_pair(hash, entry)).first;
+    CTxMemPoolEntry& newEntry = it->second;
+    auto itDelta = mapDeltas.find(hash);
+    if (itDelta != mapDeltas.end() && itDelta->second.second) newEntry.UpdateFeeDelta(itDelta->second.second);
+
+    const CTransaction& tx = newEntry.GetTx();
+    mapLinks[hash];
+    cachedInnerUsage += TreeNodeUsage<std::pair<const uint256, TxLinks> >();
     if (!tx.IsZerocoinSpend()) {
-      for (uint32_t i = 0; i < tx.vin.size(); i++) mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+      for (uint32_t i = 0; i < tx.vin.size(); i++) {
+        mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+        if (mapTx.count(tx.vin[i].prevout.hash)) LinkEntry(tx.vin[i].prevout.hash, hash);
+      }
+    }
+    // Spenders can already be in the pool when a disconnected block's transaction comes back
+    for (uint32_t i = 0; i < tx.vout.size(); i++) {
+      auto itNext = mapNextTx.find(COutPoint(hash, i));
+      if (itNext != mapNextTx.end()) LinkEntry(hash, itNext->second.ptx->GetHash());
+    }
+
+    std::set<uint256> setAncestors;
+    CollectAncestors(mapLinks[hash].parents, setAncestors);
+    if (mapLinks[hash].children.empty()) {
+      // Common case: a new leaf. Every ancestor gains exactly this one descendant.
+      for (const uint256& hashAncestor : setAncestors) {
+        txiter itAncestor = mapTx.find(hashAncestor);
+        UpdateDescendants(itAncestor, newEntry.GetTxSize(), newEntry.GetModifiedFee(), 1);
+        newEntry.UpdateAncestorState(itAncestor->second.GetTxSize(), itAncestor->second.GetModifiedFee(), 1);
+      }
+      IndexEntry(it);
+    } else {
+      // Descendants may already count some of our ancestors through another path, so recompute from scratch
+      std::set<uint256> setAffected;
+      CalculateDescendants(hash, setAffected);
+      setAffected.insert(setAncestors.begin(), setAncestors.end());
+      for (const uint256& hashAffected : setAffected) RecalculatePackageState(mapTx.find(hashAffected));
     }
+
     nTransactionsUpdated++;
-    totalTxSize += entry.GetTxSize();
+    totalTxSize += newEntry.GetTxSize();
+    cachedInnerUsage += newEntry.DynamicMemoryUsage();
   }
   return true;
 }
 
+void CTxMemPool::removeUnchecked(txiter it) {
+  const uint256 hash = it->first;
+  const CTxMemPoolEntry& entry = it->second;
+
+  // The entry is distinct from everything already in its ancestors' and descendants' packages, so subtracting
+  // it is exact
+  auto itLinks = mapLinks.find(hash);
+  std::set<uint256> setAncestors;
+  CollectAncestors(itLinks->second.parents, setAncestors);
+  for (const uint256& hashAncestor : setAncestors)
+    UpdateDescendants(mapTx.find(hashAncestor), -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee(), -1);
+  std::set<uint256> setDescendants;
+  CalculateDescendants(hash, setDescendants);
+  setDescendants.erase(hash);
+  for (const uint256& hashDescendant : setDescendants)
+    UpdateAncestors(mapTx.find(hashDescendant), -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee(), -1);
+
+  for (const uint256& parent : itLinks->second.parents) mapLinks[parent].children.erase(hash);
+  for (const uint256& child : itLinks->second.children) mapLinks[child].parents.erase(hash);
+  cachedInnerUsage -= 2 * (itLinks->second.parents.size() + itLinks->second.children.size()) * TreeNodeUsage<uint256>();
+  cachedInnerUsage -= TreeNodeUsage<std::pair<const uint256, TxLinks> >();
+  mapLinks.erase(itLinks);
+
+  for (const CTxIn& txin : entry.GetTx().vin) mapNextTx.erase(txin.prevout);
+  UnindexEntry(it);
+  totalTxSize -= entry.GetTxSize();
+  cachedInnerUsage -= entry.DynamicMemoryUsage();
+  mapTx.erase(it);
+  nTransactionsUpdated++;
+}
+
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive) {
   // Remove transaction from memory pool
   {
@@ -278,21 +537,14 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
     while (!txToRemove.empty()) {
       uint256 hash = txToRemove.front();
       txToRemove.pop_front();
-      if (!mapTx.count(hash)) continue;
-      const CTransaction& tx = mapTx[hash].GetTx();
+      auto itEntry = mapTx.find(hash);
+      if (itEntry == mapTx.end()) continue;
       if (fRecursive) {
-        for (uint32_t i = 0; i < tx.vout.size(); i++) {
-          auto it = mapNextTx.find(COutPoint(hash, i));
-          if (it == mapNextTx.end()) continue;
-          txToRemove.push_back(it->second.ptx->GetHash());
-        }
+        const std::set<uint256>& setChildren = mapLinks[hash].children;
+        txToRemove.insert(txToRemove.end(), setChildren.begin(), setChildren.end());
       }
-      for (const CTxIn& txin : tx.vin) mapNextTx.erase(txin.prevout);
-
-      removed.push_back(tx);
-      totalTxSize -= mapTx[hash].GetTxSize();
-      mapTx.erase(hash);
-      nTransactionsUpdated++;
+      removed.push_back(itEntry->second.GetTx());
+      removeUnchecked(itEntry);
     }
   }
 }
@@ -342,8 +594,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, uint32_t n
   LOCK(cs);
   std::vector<CTxMemPoolEntry> entries;
   for (const CTransaction& tx : vtx) {
-    uint256 hash = tx.GetHash();
-    if (mapTx.count(hash)) entries.push_back(mapTx[hash]);
+    const_txiter it = mapTx.find(tx.GetHash());
+    if (it != mapTx.end()) entries.push_back(it->second);
   }
   minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
   for (const CTransaction& tx : vtx) {
@@ -352,13 +604,22 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, uint32_t n
     removeConflicts(tx, conflicts);
     ClearPrioritisation(tx.GetHash());
   }
+  blockSinceLastRollingFeeBump = true;
 }
 
 void CTxMemPool::clear() {
   LOCK(cs);
   mapTx.clear();
   mapNextTx.clear();
+  mapLinks.clear();
+  setByDescendantScore.clear();
+  setByAncestorScore.clear();
+  setByEntryTime.clear();
   totalTxSize = 0;
+  cachedInnerUsage = 0;
+  lastRollingFeeUpdate = GetTime();
+  blockSinceLastRollingFeeBump = false;
+  rollingMinimumFeeRate = 0;
   ++nTransactionsUpdated;
 }
 
@@ -369,6 +630,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const {
            (uint32_t)mapNextTx.size());
 
   uint64_t checkTotal = 0;
+  uint64_t innerUsage = 0;
 
   CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
 
@@ -377,6 +639,44 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const {
   for (auto& it : mapTx) {
     uint32_t i = 0;
     checkTotal += it.second.GetTxSize();
+    innerUsage += it.second.DynamicMemoryUsage();
+    assert(setByDescendantScore.count(std::make_pair(DescendantScore(it.second), it.first)));
+    assert(setByAncestorScore.count(std::make_pair(AncestorScore(it.second), it.first)));
+
+    // Links must match the inputs, and the cached package aggregates what the links imply
+    auto itLinks = mapLinks.find(it.first);
+    assert(itLinks != mapLinks.end());
+    innerUsage += TreeNodeUsage<std::pair<const uint256, TxLinks> >() +
+                  (itLinks->second.parents.size() + itLinks->second.children.size()) * TreeNodeUsage<uint256>();
+    std::set<uint256> setParentsCheck;
+    if (!it.second.GetTx().IsZerocoinSpend()) {
+      for (const CTxIn& txin : it.second.GetTx().vin) {
+        if (mapTx.count(txin.prevout.hash)) setParentsCheck.insert(txin.prevout.hash);
+      }
+    }
+    assert(setParentsCheck == itLinks->second.parents);
+    std::set<uint256> setAncestors;
+    CollectAncestors(itLinks->second.parents, setAncestors);
+    uint64_t nSizeCheck = it.second.GetTxSize();
+    CAmount nFeesCheck = it.second.GetModifiedFee();
+    for (const uint256& hashAncestor : setAncestors) {
+      nSizeCheck += mapTx.find(hashAncestor)->second.GetTxSize();
+      nFeesCheck += mapTx.find(hashAncestor)->second.GetModifiedFee();
+    }
+    assert(it.second.GetCountWithAncestors() == setAncestors.size() + 1);
+    assert(it.second.GetSizeWithAncestors() == nSizeCheck);
+    assert(it.second.GetModFeesWithAncestors() == nFeesCheck);
+    std::set<uint256> setDescendants;
+    CalculateDescendants(it.first, setDescendants);
+    nSizeCheck = 0;
+    nFeesCheck = 0;
+    for (const uint256& hashDescendant : setDescendants) {
+      nSizeCheck += mapTx.find(hashDescendant)->second.GetTxSize();
+      nFeesCheck += mapTx.find(hashDescendant)->second.GetModifiedFee();
+    }
+    assert(it.second.GetCountWithDescendants() == setDescendants.size());
+    assert(it.second.GetSizeWithDescendants() == nSizeCheck);
+    assert(it.second.GetModFeesWithDescendants() == nFeesCheck);
     const CTransaction& tx = it.second.GetTx();
     bool fDependsWait = false;
     for (const CTxIn& txin : tx.vin) {
@@ -433,6 +733,82 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const {
   }
 
   assert(totalTxSize == checkTotal);
+  assert(innerUsage == cachedInnerUsage);
+  assert(setByDescendantScore.size() == mapTx.size());
+  assert(setByAncestorScore.size() == mapTx.size());
+  assert(setByEntryTime.size() == mapTx.size());
+  assert(mapLinks.size() == mapTx.size());
+}
+
+size_t CTxMemPool::DynamicMemoryUsage() const {
+  LOCK(cs);
+  return mapTx.size() * TreeNodeUsage<std::pair<const uint256, CTxMemPoolEntry> >() +
+         mapNextTx.size() * TreeNodeUsage<std::pair<const COutPoint, CInPoint> >() +
+         (setByDescendantScore.size() + setByAncestorScore.size()) * TreeNodeUsage<TxScore>() +
+         setByEntryTime.size() * TreeNodeUsage<std::pair<int64_t, uint256> >() +
+         mapDeltas.size() * TreeNodeUsage<std::pair<const uint256, std::pair<double, CAmount> > >() + cachedInnerUsage;
+}
+
+CAmount CTxMemPool::GetMinFee(size_t sizelimit) const {
+  LOCK(cs);
+  if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0) return (CAmount)rollingMinimumFeeRate;
+
+  int64_t nNow = GetTime();
+  if (nNow > lastRollingFeeUpdate + 10) {
+    double halflife = ROLLING_FEE_HALFLIFE;
+    size_t nUsage = DynamicMemoryUsage();
+    if (nUsage < sizelimit / 4)
+      halflife /= 4;
+    else if (nUsage < sizelimit / 2)
+      halflife /= 2;
+
+    rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (nNow - lastRollingFeeUpdate) / halflife);
+    lastRollingFeeUpdate = nNow;
+
+    if (rollingMinimumFeeRate < (double)minRelayFee / 2) {
+      rollingMinimumFeeRate = 0;
+      return 0;
+    }
+  }
+  return std::max((CAmount)rollingMinimumFeeRate, minRelayFee);
+}
+
+void CTxMemPool::trackPackageRemoved(double dFeeRate) {
+  AssertLockHeld(cs);
+  if (dFeeRate > rollingMinimumFeeRate) {
+    rollingMinimumFeeRate = dFeeRate;
+    blockSinceLastRollingFeeBump = false;
+  }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvEvicted) {
+  LOCK(cs);
+
+  uint32_t nTxnRemoved = 0;
+  double dMaxFeeRateRemoved = 0;
+  while (!setByDescendantScore.empty() && DynamicMemoryUsage() > sizelimit) {
+    // The lowest descendant score is the package (entry plus everything spending it) worth least to keep
+    auto itLowest = setByDescendantScore.begin();
+    // A replacement has to pay for the bandwidth of what was evicted, so bump the floor by the relay fee
+    if (itLowest->first < std::numeric_limits<double>::max()) {
+      double dRemovedRate = mapTx.at(itLowest->second).GetDescendantFeeRate() + minRelayFee;
+      trackPackageRemoved(dRemovedRate);
+      dMaxFeeRateRemoved = std::max(dMaxFeeRateRemoved, dRemovedRate);
+    }
+
+    // Copy, as the entry (and the reference into it) goes away during remove()
+    CTransaction tx = mapTx.at(itLowest->second).GetTx();
+    std::list<CTransaction> removed;
+    remove(tx, removed, true);
+    nTxnRemoved += removed.size();
+    if (pvEvicted) {
+      for (const CTransaction& txRemoved : removed) pvEvicted->push_back(txRemoved.GetHash());
+    }
+  }
+
+  if (dMaxFeeRateRemoved > 0)
+    LogPrint(TessaLog::MEMPOOL, "Removed %u txn, rolling minimum fee bumped to %s per kB\n", nTxnRemoved,
+             FormatMoney((CAmount)dMaxFeeRateRemoved));
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid) {
@@ -503,6 +879,23 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string& strHash
     std::pair<double, CAmount>& deltas = mapDeltas[hash];
     deltas.first += dPriorityDelta;
     deltas.second += nFeeDelta;
+
+    // Re-score the entry and every package it belongs to
+    txiter it = mapTx.find(hash);
+    if (it != mapTx.end() && nFeeDelta) {
+      UnindexEntry(it);
+      it->second.UpdateFeeDelta(deltas.second);
+      IndexEntry(it);
+
+      std::set<uint256> setAncestors;
+      CollectAncestors(mapLinks[hash].parents, setAncestors);
+      for (const uint256& hashAncestor : setAncestors) UpdateDescendants(mapTx.find(hashAncestor), 0, nFeeDelta, 0);
+      std::set<uint256> setDescendants;
+      CalculateDescendants(hash, setDescendants);
+      setDescendants.erase(hash);
+      for (const uint256& hashDescendant : setDescendants)
+        UpdateAncestors(mapTx.find(hashDescendant), 0, nFeeDelta, 0);
+    }
   }
   LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
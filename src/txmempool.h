@@ -9,6 +9,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -37,9 +38,20 @@ class CTxMemPoolEntry {
   CAmount nFee;      //! Cached to avoid expensive parent-transaction lookups
   size_t nTxSize;    //! ... and avoid recomputing tx size
   size_t nModSize;   //! ... and modified size for priority
+  size_t nUsageSize; //! ... and total heap usage of the transaction
   int64_t nTime;     //! Local time when entering the mempool
   double dPriority;  //! Priority when entering the mempool
   uint32_t nHeight;  //! Chain height when entering the mempool
+  CAmount nFeeDelta;  //! Fee adjustment from PrioritiseTransaction
+
+  // Package aggregates over this entry and all its in-pool descendants (resp. ancestors), including itself.
+  // Maintained incrementally by CTxMemPool as entries come and go.
+  uint64_t nCountWithDescendants;
+  uint64_t nSizeWithDescendants;
+  CAmount nModFeesWithDescendants;
+  uint64_t nCountWithAncestors;
+  uint64_t nSizeWithAncestors;
+  CAmount nModFeesWithAncestors;
 
  public:
   CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, uint32_t _nHeight);
@@ -50,6 +62,23 @@ class CTxMemPoolEntry {
   double GetPriority(uint32_t currentHeight) const;
   CAmount GetFee() const { return nFee; }
   size_t GetTxSize() const { return nTxSize; }
+  size_t DynamicMemoryUsage() const { return nUsageSize; }
+  CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+  //! Modified fee per 1000 bytes, the unit used for eviction, block assembly and the rolling minimum fee
+  double GetFeeRate() const { return nTxSize ? (double)GetModifiedFee() * 1000 / nTxSize : 0; }
+
+  uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+  uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+  CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+  double GetDescendantFeeRate() const { return (double)nModFeesWithDescendants * 1000 / nSizeWithDescendants; }
+  uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+  uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+  CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+  double GetAncestorFeeRate() const { return (double)nModFeesWithAncestors * 1000 / nSizeWithAncestors; }
+
+  void UpdateFeeDelta(CAmount feeDelta);
+  void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+  void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
   int64_t GetTime() const { return nTime; }
   uint32_t GetHeight() const { return nHeight; }
 };
@@ -85,6 +114,16 @@ class CInPoint {
  * as are non-standard transactions.
  */
 class CTxMemPool {
+ public:
+  /** In-pool parents (transactions this one spends) and children (transactions spending this one) */
+  struct TxLinks {
+    std::set<uint256> parents;
+    std::set<uint256> children;
+  };
+  typedef std::map<uint256, CTxMemPoolEntry>::iterator txiter;
+  typedef std::map<uint256, CTxMemPoolEntry>::const_iterator const_txiter;
+  typedef std::pair<double, uint256> TxScore;
+
  private:
   bool fSanityCheck;  //! Normally false, true if -checkmempool or -regtest
   uint32_t nTransactionsUpdated;
@@ -92,13 +131,43 @@ class CTxMemPool {
 
   CAmount minRelayFee;  //! Passed to constructor to avoid dependency on main
   uint64_t totalTxSize;  //! sum of all mempool tx' byte sizes
+  uint64_t cachedInnerUsage;  //! sum of dynamic memory usage of all the entries (NOT the maps themselves)
+
+  mutable int64_t lastRollingFeeUpdate;
+  mutable bool blockSinceLastRollingFeeBump;
+  mutable double rollingMinimumFeeRate;  //! fee per kB needed to enter a full pool, decays exponentially
+
+  void trackPackageRemoved(double dFeeRate);
+
+  void IndexEntry(const_txiter it);
+  void UnindexEntry(const_txiter it);
+  void UpdateDescendants(txiter it, int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+  void UpdateAncestors(txiter it, int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+  void RecalculatePackageState(txiter it);
+  void CollectAncestors(const std::set<uint256>& setParents, std::set<uint256>& setAncestors) const;
+  void LinkEntry(const uint256& parent, const uint256& child);
+  void removeUnchecked(txiter it);
 
  public:
+  /** Half-life in seconds of the rolling minimum fee once blocks keep being found */
+  static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
   mutable CCriticalSection cs;
   std::map<uint256, CTxMemPoolEntry> mapTx;
   std::map<COutPoint, CInPoint> mapNextTx;
   std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+  // Secondary indexes over mapTx, maintained by the pool: read them under cs, never modify them directly.
+  std::map<uint256, TxLinks> mapLinks;
+  //! Eviction order, lowest first: max(own, with-descendants) fee rate. Zerocoin spends sort last.
+  std::set<TxScore> setByDescendantScore;
+  //! Block assembly order, highest last: min(own, with-ancestors) fee rate. Zerocoin spends sort last.
+  std::set<TxScore> setByAncestorScore;
+  std::set<std::pair<int64_t, uint256> > setByEntryTime;
+
+  static double DescendantScore(const CTxMemPoolEntry& entry);
+  static double AncestorScore(const CTxMemPoolEntry& entry);
+
   CTxMemPool(const CAmount& _minRelayFee);
   ~CTxMemPool();
 
@@ -138,6 +207,32 @@ class CTxMemPool {
     return totalTxSize;
   }
 
+  /** Approximate heap usage of the pool, which is what -maxmempool limits */
+  size_t DynamicMemoryUsage() const;
+
+  /**
+   * The minimum fee per kB to get into a pool of at most sizelimit bytes. Rises when transactions are
+   * evicted and decays back to zero (with a shorter half-life the emptier the pool) once blocks are found.
+   */
+  CAmount GetMinFee(size_t sizelimit) const;
+
+  /**
+   * Evict the lowest fee rate transactions, together with everything spending them, until the pool
+   * uses at most sizelimit bytes. Hashes of evicted transactions are appended to pvEvicted if given.
+   */
+  void TrimToSize(size_t sizelimit, std::vector<uint256>* pvEvicted = nullptr);
+
+  /**
+   * Collect the in-pool ancestors of tx, which need not be in the pool itself. Returns false, with a
+   * reason in errString, if tx would have more than limitAncestorCount ancestors (counting itself) or
+   * would push any ancestor past limitDescendantCount descendants (counting that ancestor).
+   */
+  bool CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors,
+                                 uint64_t limitAncestorCount, uint64_t limitDescendantCount,
+                                 std::string& errString) const;
+  /** Add hash and all its in-pool descendants to setDescendants */
+  void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
   bool exists(uint256 hash) {
     LOCK(cs);
     return (mapTx.count(hash) != 0);
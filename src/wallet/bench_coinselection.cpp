@@ -0,0 +1,68 @@
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Times coin selection over synthetic wallets of growing size: sorting the candidates, the branch and bound
+// search alone, the knapsack alone, and both chained as CWallet::SelectCoinsMinConf does.
+
+#include "coin_constants.h"
+#include "coinselection.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static std::vector<CSelectionCoin> MakeWallet(size_t nCoins, std::mt19937_64& rng) {
+  // Values spread log-uniformly between a cent and a thousand coins, the way payments and change pile up
+  std::uniform_real_distribution<double> dist(std::log(double(COINCENT)), std::log(1000.0 * COIN));
+  std::vector<CSelectionCoin> vCoins;
+  vCoins.reserve(nCoins);
+  for (uint32_t i = 0; i < nCoins; i++) {
+    CAmount nValue = CAmount(std::exp(dist(rng)));
+    vCoins.push_back(CSelectionCoin{nValue, nValue, i});
+  }
+  return vCoins;
+}
+
+template <typename F> static double TimeMs(int nRuns, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < nRuns; i++) f(i);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / nRuns;
+}
+
+int main() {
+  std::mt19937_64 rng(42);
+  const int nRuns = 20;
+
+  printf("%8s %10s %10s %14s %10s %10s\n", "coins", "sort ms", "bnb ms", "changeless", "knap ms", "both ms");
+  for (size_t nCoins : {1000, 10000, 50000, 100000}) {
+    std::vector<CSelectionCoin> vWallet = MakeWallet(nCoins, rng);
+    std::vector<CAmount> vTargets;
+    std::uniform_int_distribution<CAmount> targetDist(COIN, 500 * COIN);
+    for (int i = 0; i < nRuns; i++) vTargets.push_back(targetDist(rng));
+
+    std::vector<CSelectionCoin> vSorted;
+    double dSort = TimeMs(nRuns, [&](int) {
+      vSorted = vWallet;
+      SortSelectionCoins(vSorted);
+    });
+
+    std::vector<char> vfSelected;
+    CAmount nValue;
+    int nChangeless = 0;
+    double dBnB = TimeMs(nRuns, [&](int i) {
+      if (SelectCoinsBnB(vSorted, vTargets[i], COIN_SELECTION_CHANGE_COST, vfSelected, nValue)) nChangeless++;
+    });
+    double dKnapsack = TimeMs(nRuns, [&](int i) { SelectCoinsKnapsack(vSorted, vTargets[i], vfSelected, nValue); });
+    double dBoth = TimeMs(nRuns, [&](int i) {
+      if (!SelectCoinsBnB(vSorted, vTargets[i], COIN_SELECTION_CHANGE_COST, vfSelected, nValue))
+        SelectCoinsKnapsack(vSorted, vTargets[i], vfSelected, nValue);
+    });
+
+    printf("%8zu %10.3f %10.3f %11d/%-2d %10.3f %10.3f\n", nCoins, dSort, dBnB, nChangeless, nRuns, dKnapsack, dBoth);
+  }
+  return 0;
+}
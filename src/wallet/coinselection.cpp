@@ -0,0 +1,183 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinselection.h"
+#include "coin_constants.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+void SortSelectionCoins(std::vector<CSelectionCoin>& vCoins) {
+  std::sort(vCoins.begin(), vCoins.end(), [](const CSelectionCoin& a, const CSelectionCoin& b) {
+    return a.nEffectiveValue > b.nEffectiveValue;
+  });
+}
+
+bool SelectCoinsBnB(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTarget, const CAmount& nCostOfChange,
+                    std::vector<char>& vfSelected, CAmount& nValueRet) {
+  vfSelected.assign(vCoins.size(), false);
+  nValueRet = 0;
+
+  CAmount nAvailable = 0;
+  for (const CSelectionCoin& coin : vCoins) nAvailable += coin.nEffectiveValue;
+  if (nAvailable < nTarget) return false;
+
+  // vfPath holds the include/omit decision for each coin on the current branch
+  std::vector<char> vfPath;
+  vfPath.reserve(vCoins.size());
+  CAmount nSelected = 0;
+  CAmount nBestExcess = std::numeric_limits<CAmount>::max();
+  std::vector<char> vfBest;
+
+  for (uint32_t nTries = 0; nTries < COIN_SELECTION_BNB_TRIES; nTries++) {
+    bool fBacktrack = false;
+    if (nSelected + nAvailable < nTarget || nSelected > nTarget + nCostOfChange) {
+      // The rest of the coins cannot reach the target, or this branch already overshoots the window
+      fBacktrack = true;
+    } else if (nSelected >= nTarget) {
+      CAmount nExcess = nSelected - nTarget;
+      if (nExcess < nBestExcess) {
+        nBestExcess = nExcess;
+        vfBest = vfPath;
+        if (nExcess == 0) break;
+      }
+      fBacktrack = true;
+    }
+
+    if (fBacktrack) {
+      // Walk back to the last coin included and try the branch without it
+      while (!vfPath.empty() && !vfPath.back()) {
+        vfPath.pop_back();
+        nAvailable += vCoins[vfPath.size()].nEffectiveValue;
+      }
+      if (vfPath.empty()) break;  // Every branch was explored
+      vfPath.back() = false;
+      nSelected -= vCoins[vfPath.size() - 1].nEffectiveValue;
+    } else {
+      const CSelectionCoin& coin = vCoins[vfPath.size()];
+      nAvailable -= coin.nEffectiveValue;
+      // Including a coin equal to one just omitted leads to a branch already explored
+      if (!vfPath.empty() && !vfPath.back() && coin.nEffectiveValue == vCoins[vfPath.size() - 1].nEffectiveValue) {
+        vfPath.push_back(false);
+      } else {
+        vfPath.push_back(true);
+        nSelected += coin.nEffectiveValue;
+      }
+    }
+  }
+
+  if (vfBest.empty()) return false;
+  for (uint32_t i = 0; i < vfBest.size(); i++) {
+    if (!vfBest[i]) continue;
+    vfSelected[i] = true;
+    nValueRet += vCoins[i].nValue;
+  }
+  return true;
+}
+
+static void ApproximateBestSubset(const std::vector<CSelectionCoin>& vCoins, size_t nFirst,
+                                  const CAmount& nTotalLower, const CAmount& nTarget, std::vector<char>& vfBest,
+                                  CAmount& nBest, int iterations = 1000) {
+  const size_t nCoins = vCoins.size() - nFirst;
+  std::vector<char> vfIncluded;
+
+  vfBest.assign(nCoins, true);
+  nBest = nTotalLower;
+
+  FastRandomContext insecure_rand;
+
+  for (int nRep = 0; nRep < iterations && nBest != nTarget; nRep++) {
+    vfIncluded.assign(nCoins, false);
+    CAmount nTotal = 0;
+    bool fReachedTarget = false;
+    for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
+      for (size_t i = 0; i < nCoins; i++) {
+        // The solver here uses a randomized algorithm,
+        // the randomness serves no real security purpose but is just
+        // needed to prevent degenerate behavior and it is important
+        // that the rng is fast. We do not use a constant random sequence,
+        // because there may be some privacy improvement by making
+        // the selection random.
+        if (nPass == 0 ? insecure_rand.randbool() & 1 : !vfIncluded[i]) {
+          nTotal += vCoins[nFirst + i].nEffectiveValue;
+          vfIncluded[i] = true;
+          if (nTotal >= nTarget) {
+            fReachedTarget = true;
+            if (nTotal < nBest) {
+              nBest = nTotal;
+              vfBest = vfIncluded;
+            }
+            nTotal -= vCoins[nFirst + i].nEffectiveValue;
+            vfIncluded[i] = false;
+          }
+        }
+      }
+    }
+  }
+}
+
+bool SelectCoinsKnapsack(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTarget,
+                         std::vector<char>& vfSelected, CAmount& nValueRet) {
+  vfSelected.assign(vCoins.size(), false);
+  nValueRet = 0;
+
+  // Coins below nTarget + COINCENT are the tail of the sorted list; the one just before it is the lowest larger
+  const auto itLower = std::partition_point(vCoins.begin(), vCoins.end(), [&](const CSelectionCoin& coin) {
+    return coin.nEffectiveValue >= nTarget + COINCENT;
+  });
+  const size_t nLower = itLower - vCoins.begin();
+  const bool fLowestLarger = nLower > 0;
+
+  const auto itExact = std::partition_point(
+      itLower, vCoins.end(), [&](const CSelectionCoin& coin) { return coin.nEffectiveValue > nTarget; });
+  if (itExact != vCoins.end() && itExact->nEffectiveValue == nTarget) {
+    vfSelected[itExact - vCoins.begin()] = true;
+    nValueRet = itExact->nValue;
+    return true;
+  }
+
+  CAmount nTotalLower = 0;
+  for (size_t i = nLower; i < vCoins.size(); i++) nTotalLower += vCoins[i].nEffectiveValue;
+
+  if (nTotalLower == nTarget) {
+    for (size_t i = nLower; i < vCoins.size(); i++) {
+      vfSelected[i] = true;
+      nValueRet += vCoins[i].nValue;
+    }
+    return true;
+  }
+
+  if (nTotalLower < nTarget) {
+    // there is no input larger than nTarget, we looked at everything possible and didn't find anything, no luck
+    if (!fLowestLarger) return false;
+    vfSelected[nLower - 1] = true;
+    nValueRet = vCoins[nLower - 1].nValue;
+    return true;
+  }
+
+  // Solve subset sum by stochastic approximation
+  std::vector<char> vfBest;
+  CAmount nBest;
+
+  ApproximateBestSubset(vCoins, nLower, nTotalLower, nTarget, vfBest, nBest, 1000);
+  if (nBest != nTarget && nTotalLower >= nTarget + COINCENT)
+    ApproximateBestSubset(vCoins, nLower, nTotalLower, nTarget + COINCENT, vfBest, nBest, 1000);
+
+  // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+  //                                   or the next bigger coin is closer), return the bigger coin
+  if (fLowestLarger &&
+      ((nBest != nTarget && nBest < nTarget + COINCENT) || vCoins[nLower - 1].nEffectiveValue <= nBest)) {
+    vfSelected[nLower - 1] = true;
+    nValueRet = vCoins[nLower - 1].nValue;
+  } else {
+    for (size_t i = 0; i < vfBest.size(); i++) {
+      if (!vfBest[i]) continue;
+      vfSelected[nLower + i] = true;
+      nValueRet += vCoins[nLower + i].nValue;
+    }
+  }
+  return true;
+}
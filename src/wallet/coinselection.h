@@ -0,0 +1,36 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "amount.h"
+
+#include <cstdint>
+#include <vector>
+
+/** A coin offered to the selection, with its value net of the fee it costs to spend */
+struct CSelectionCoin {
+  CAmount nValue;
+  CAmount nEffectiveValue;
+  uint32_t nPos;  //! Position of the coin in the caller's list
+};
+
+/** Sort coins by descending effective value, the order both solvers below expect */
+void SortSelectionCoins(std::vector<CSelectionCoin>& vCoins);
+
+/**
+ * Depth-first branch and bound search for coins whose effective value lands within nCostOfChange above nTarget,
+ * so the transaction needs no change output. Of the solutions met, the one leaving the least excess is kept.
+ * vCoins must be sorted and hold positive effective values only; gives up after COIN_SELECTION_BNB_TRIES steps.
+ */
+bool SelectCoinsBnB(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTarget, const CAmount& nCostOfChange,
+                    std::vector<char>& vfSelected, CAmount& nValueRet);
+
+/**
+ * The original knapsack: a coin matching nTarget exactly, else every smaller coin if they add up to it, else a
+ * stochastic approximation of the best subset of the smaller coins, or the smallest larger coin when that is closer.
+ */
+bool SelectCoinsKnapsack(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTarget,
+                         std::vector<char>& vfSelected, CAmount& nValueRet);
@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include "coin_constants.h"
+#include "wallet/coinselection.h"
+
+#include <vector>
+
+static std::vector<CSelectionCoin> MakeCoins(const std::vector<CAmount>& vValues) {
+  std::vector<CSelectionCoin> vCoins;
+  for (uint32_t i = 0; i < vValues.size(); i++) vCoins.push_back(CSelectionCoin{vValues[i], vValues[i], i});
+  SortSelectionCoins(vCoins);
+  return vCoins;
+}
+
+static CAmount SelectedValue(const std::vector<CSelectionCoin>& vCoins, const std::vector<char>& vfSelected) {
+  CAmount nValue = 0;
+  for (size_t i = 0; i < vCoins.size(); i++)
+    if (vfSelected[i]) nValue += vCoins[i].nValue;
+  return nValue;
+}
+
+TEST_CASE("bnb_exact_match") {
+  std::vector<CSelectionCoin> vCoins = MakeCoins({1 * COIN, 2 * COIN, 3 * COIN, 4 * COIN});
+  std::vector<char> vfSelected;
+  CAmount nValue;
+
+  REQUIRE(SelectCoinsBnB(vCoins, 5 * COIN, 0, vfSelected, nValue));
+  REQUIRE(nValue == 5 * COIN);
+  REQUIRE(SelectedValue(vCoins, vfSelected) == nValue);
+
+  REQUIRE(SelectCoinsBnB(vCoins, 10 * COIN, 0, vfSelected, nValue));
+  REQUIRE(nValue == 10 * COIN);
+
+  // An excess within the cost of change is accepted, and the smallest one found is kept
+  REQUIRE(SelectCoinsBnB(vCoins, 5 * COIN - COINCENT, COIN_SELECTION_CHANGE_COST, vfSelected, nValue));
+  REQUIRE(nValue == 5 * COIN);
+}
+
+TEST_CASE("bnb_no_solution") {
+  std::vector<CSelectionCoin> vCoins = MakeCoins({4 * COIN, 4 * COIN, 9 * COIN});
+  std::vector<char> vfSelected;
+  CAmount nValue;
+
+  // Not enough in total
+  REQUIRE(!SelectCoinsBnB(vCoins, 18 * COIN, COIN_SELECTION_CHANGE_COST, vfSelected, nValue));
+  REQUIRE(nValue == 0);
+  // Every subset misses the window above the target
+  REQUIRE(!SelectCoinsBnB(vCoins, 6 * COIN, COIN_SELECTION_CHANGE_COST, vfSelected, nValue));
+  REQUIRE(!SelectCoinsBnB(vCoins, 5 * COIN, COIN_SELECTION_CHANGE_COST, vfSelected, nValue));
+  REQUIRE(SelectedValue(vCoins, vfSelected) == 0);
+  // No coins at all
+  REQUIRE(!SelectCoinsBnB(std::vector<CSelectionCoin>(), COIN, COIN_SELECTION_CHANGE_COST, vfSelected, nValue));
+}
+
+TEST_CASE("bnb_tries_limit") {
+  // Thirty distinct even coins and a single odd one. The only sets summing to the odd target hold the odd coin and
+  // the fifteen smallest even ones, which the search, taking the largest coins first, reaches last.
+  std::vector<CAmount> vValues;
+  for (int i = 0; i < 30; i++) vValues.push_back(1000 * COIN + 2 * i);
+  vValues.push_back(1);
+  CAmount nTarget = 1;
+  for (int i = 0; i < 15; i++) nTarget += vValues[i];
+  std::vector<CSelectionCoin> vCoins = MakeCoins(vValues);
+  std::vector<char> vfSelected;
+  CAmount nValue;
+
+  REQUIRE(!SelectCoinsBnB(vCoins, nTarget, 0, vfSelected, nValue));
+
+  // The same set with a solution among the first branches is found well within the limit
+  REQUIRE(SelectCoinsBnB(vCoins, nTarget + 2 * 15 * 15, 0, vfSelected, nValue));
+  REQUIRE(nValue == nTarget + 2 * 15 * 15);
+}
+
+TEST_CASE("knapsack_exact_match") {
+  std::vector<CSelectionCoin> vCoins = MakeCoins({1 * COIN, 2 * COIN, 5 * COIN, 10 * COIN, 20 * COIN});
+  std::vector<char> vfSelected;
+  CAmount nValue;
+
+  // A single coin of the target value
+  REQUIRE(SelectCoinsKnapsack(vCoins, 5 * COIN, vfSelected, nValue));
+  REQUIRE(nValue == 5 * COIN);
+  REQUIRE(SelectedValue(vCoins, vfSelected) == nValue);
+  // Every coin below the target adds up to it
+  std::vector<CSelectionCoin> vSmall = MakeCoins({1 * COIN, 2 * COIN, 3 * COIN});
+  REQUIRE(SelectCoinsKnapsack(vSmall, 6 * COIN, vfSelected, nValue));
+  REQUIRE(nValue == 6 * COIN);
+  // A subset of the smaller coins matching the target is preferred to the next larger coin
+  REQUIRE(SelectCoinsKnapsack(vCoins, 3 * COIN, vfSelected, nValue));
+  REQUIRE(nValue == 3 * COIN);
+}
+
+TEST_CASE("knapsack_no_solution") {
+  std::vector<CSelectionCoin> vCoins = MakeCoins({1 * COIN, 2 * COIN, 3 * COIN});
+  std::vector<char> vfSelected;
+  CAmount nValue;
+
+  REQUIRE(!SelectCoinsKnapsack(vCoins, 7 * COIN, vfSelected, nValue));
+  REQUIRE(SelectedValue(vCoins, vfSelected) == 0);
+  REQUIRE(!SelectCoinsKnapsack(std::vector<CSelectionCoin>(), COIN, vfSelected, nValue));
+
+  // Short of an exact subset, the smallest larger coin is taken
+  std::vector<CSelectionCoin> vLarger = MakeCoins({1 * COIN, 50 * COIN, 80 * COIN});
+  REQUIRE(SelectCoinsKnapsack(vLarger, 40 * COIN, vfSelected, nValue));
+  REQUIRE(nValue == 50 * COIN);
+}
+
+int main(int argc, char* argv[]) {
+  int result = Catch::Session().run(argc, argv);
+  return result;
+}
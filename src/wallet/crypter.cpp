@@ -5,7 +5,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypter.h"
+#include "coin_constants.h"
 #include "crypto/aes.h"
+#include "crypto/argon2/argon2.h"
+#include "crypto/common.h"
 #include "crypto/sha512.h"
 #include "hash.h"
 #include "init.h"
@@ -14,14 +17,30 @@
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 
 #include "wallet/wallet.h"
 #include "wallet/wallettx.h"
 #include "wallet_externs.h"
 
+#include <thread>
+
 using namespace std;
 using namespace ecdsa;
 
+void CMasterKey::SetArgon2idParameters(uint32_t nMemoryKiB, uint32_t nLanes) {
+  vchOtherDerivationParameters.resize(8);
+  WriteLE32(&vchOtherDerivationParameters[0], nMemoryKiB);
+  WriteLE32(&vchOtherDerivationParameters[4], nLanes);
+}
+
+bool CMasterKey::GetArgon2idParameters(uint32_t &nMemoryKiB, uint32_t &nLanes) const {
+  if (vchOtherDerivationParameters.size() != 8) return false;
+  nMemoryKiB = ReadLE32(&vchOtherDerivationParameters[0]);
+  nLanes = ReadLE32(&vchOtherDerivationParameters[4]);
+  return true;
+}
+
 int CCrypter::BytesToKeySHA512AES(const std::vector<uint8_t> &chSalt, const SecureString &strKeyData, int count,
                                   uint8_t *key, uint8_t *iv) const {
   // This mimics the behavior of openssl's EVP_BytesToKey with an aes256cbc
@@ -45,13 +64,55 @@ int CCrypter::BytesToKeySHA512AES(const std::vector<uint8_t> &chSalt, const Secu
   return WALLET_CRYPTO_KEY_SIZE;
 }
 
+int CCrypter::BytesToKeyArgon2id(const std::vector<uint8_t> &chSalt, const SecureString &strKeyData, uint32_t nPasses,
+                                 uint32_t nMemoryKiB, uint32_t nLanes, uint8_t *key, uint8_t *iv) const {
+  // One Argon2id output covers both the key and the IV. The lanes are filled on as many threads.
+  if (!key || !iv) return 0;
+
+  uint8_t buf[WALLET_CRYPTO_KEY_SIZE + WALLET_CRYPTO_IV_SIZE];
+  int ret = argon2id_hash_raw(nPasses, nMemoryKiB, nLanes, strKeyData.data(), strKeyData.size(), chSalt.data(),
+                              chSalt.size(), buf, sizeof(buf));
+  if (ret != ARGON2_OK) {
+    LogPrintf("%s: Argon2id failed: %s\n", __func__, argon2_error_message(ret));
+    return 0;
+  }
+
+  memcpy(key, buf, WALLET_CRYPTO_KEY_SIZE);
+  memcpy(iv, buf + WALLET_CRYPTO_KEY_SIZE, WALLET_CRYPTO_IV_SIZE);
+  memory_cleanse(buf, sizeof(buf));
+  return WALLET_CRYPTO_KEY_SIZE;
+}
+
 bool CCrypter::SetKeyFromPassphrase(const SecureString &strKeyData, const std::vector<uint8_t> &chSalt,
                                     const uint32_t nRounds, const uint32_t nDerivationMethod) {
   if (nRounds < 1 || chSalt.size() != WALLET_CRYPTO_SALT_SIZE) return false;
 
   int i = 0;
-  if (nDerivationMethod == 0) i = BytesToKeySHA512AES(chSalt, strKeyData, nRounds, vchKey.data(), vchIV.data());
+  if (nDerivationMethod == WALLET_DERIVATION_SHA512)
+    i = BytesToKeySHA512AES(chSalt, strKeyData, nRounds, vchKey.data(), vchIV.data());
+
+  if (i != (int)WALLET_CRYPTO_KEY_SIZE) {
+    memory_cleanse(vchKey.data(), vchKey.size());
+    memory_cleanse(vchIV.data(), vchIV.size());
+    return false;
+  }
+
+  fKeySet = true;
+  return true;
+}
 
+bool CCrypter::SetKeyFromPassphrase(const SecureString &strKeyData, const CMasterKey &kMasterKey) {
+  if (kMasterKey.nDerivationMethod != WALLET_DERIVATION_ARGON2ID)
+    return SetKeyFromPassphrase(strKeyData, kMasterKey.vchSalt, kMasterKey.nDeriveIterations,
+                                kMasterKey.nDerivationMethod);
+
+  uint32_t nMemoryKiB, nLanes;
+  if (kMasterKey.nDeriveIterations < 1 || kMasterKey.vchSalt.size() != WALLET_CRYPTO_SALT_SIZE ||
+      !kMasterKey.GetArgon2idParameters(nMemoryKiB, nLanes))
+    return false;
+
+  int i = BytesToKeyArgon2id(kMasterKey.vchSalt, strKeyData, kMasterKey.nDeriveIterations, nMemoryKiB, nLanes,
+                             vchKey.data(), vchIV.data());
   if (i != (int)WALLET_CRYPTO_KEY_SIZE) {
     memory_cleanse(vchKey.data(), vchKey.size());
     memory_cleanse(vchIV.data(), vchIV.size());
@@ -62,6 +123,33 @@ bool CCrypter::SetKeyFromPassphrase(const SecureString &strKeyData, const std::v
   return true;
 }
 
+bool CCrypter::CalibrateArgon2id(const SecureString &strKeyData, CMasterKey &kMasterKey) {
+  uint32_t nLanes = std::min<uint32_t>(std::thread::hardware_concurrency(), WALLET_KDF_MAX_LANES);
+  if (nLanes < 1) nLanes = 1;
+  uint32_t nMemoryKiB = WALLET_KDF_MAX_MEMORY_KIB;
+
+  // Time a single pass over the full budget, halving the memory while even that is over the target.
+  // The cost of Argon2id is linear in its passes, so the passes then follow from the time one took.
+  int64_t nElapsed;
+  while (true) {
+    kMasterKey.nDerivationMethod = WALLET_DERIVATION_ARGON2ID;
+    kMasterKey.nDeriveIterations = 1;
+    kMasterKey.SetArgon2idParameters(nMemoryKiB, nLanes);
+    int64_t nStartTime = GetTimeMillis();
+    if (!SetKeyFromPassphrase(strKeyData, kMasterKey)) return false;
+    nElapsed = std::max<int64_t>(1, GetTimeMillis() - nStartTime);
+    if (nElapsed <= WALLET_KDF_TARGET_MS || nMemoryKiB / 2 < WALLET_KDF_MIN_MEMORY_KIB) break;
+    nMemoryKiB /= 2;
+  }
+  kMasterKey.nDeriveIterations = std::max<int64_t>(1, std::min<int64_t>(WALLET_KDF_TARGET_MS / nElapsed,
+                                                                        WALLET_KDF_MAX_PASSES));
+  CleanKey();
+
+  LogPrintf("%s: Argon2id with %u KiB, %u lanes and %u passes (one pass took %d ms)\n", __func__, nMemoryKiB, nLanes,
+            kMasterKey.nDeriveIterations, nElapsed);
+  return true;
+}
+
 bool CCrypter::SetKey(const CKeyingMaterial &chNewKey, const std::vector<uint8_t> &chNewIV) {
   if (chNewKey.size() != WALLET_CRYPTO_KEY_SIZE || chNewIV.size() != WALLET_CRYPTO_IV_SIZE) return false;
 
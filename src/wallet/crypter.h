@@ -21,15 +21,20 @@ const uint32_t WALLET_CRYPTO_KEY_SIZE = 32;
 const uint32_t WALLET_CRYPTO_SALT_SIZE = 8;
 const uint32_t WALLET_CRYPTO_IV_SIZE = 16;
 
+//! Passphrase key derivation methods of a CMasterKey
+const uint32_t WALLET_DERIVATION_SHA512 = 0;
+const uint32_t WALLET_DERIVATION_ARGON2ID = 2;
+
 /**
  * Private key encryption is done based on a CMasterKey,
  * which holds a salt and random encryption key.
  *
  * CMasterKeys are encrypted using AES-256-CBC using a key
  * derived using derivation method nDerivationMethod
- * (0 == EVP_sha512()) and derivation iterations nDeriveIterations.
+ * (0 == EVP_sha512(), 2 == Argon2id) and derivation iterations nDeriveIterations.
  * vchOtherDerivationParameters is provided for alternative algorithms
- * which may require more parameters (such as scrypt).
+ * which may require more parameters (such as scrypt, or the memory and
+ * lanes of Argon2id).
  *
  * Wallet Private Keys are then encrypted using AES-256-CBC
  * with the double-sha256 of the public key as the IV, and the
@@ -43,6 +48,7 @@ class CMasterKey {
   std::vector<uint8_t> vchSalt;
   //! 0 = EVP_sha512()
   //! 1 = scrypt()
+  //! 2 = Argon2id, nDeriveIterations being its passes over memory
   uint32_t nDerivationMethod;
   uint32_t nDeriveIterations;
   //! Use this for more parameters to key derivation, such as the various
@@ -66,6 +72,10 @@ class CMasterKey {
     nDerivationMethod = 0;
     vchOtherDerivationParameters = std::vector<uint8_t>(0);
   }
+
+  /** Argon2id memory in KiB and lanes, kept little endian in vchOtherDerivationParameters */
+  void SetArgon2idParameters(uint32_t nMemoryKiB, uint32_t nLanes);
+  bool GetArgon2idParameters(uint32_t &nMemoryKiB, uint32_t &nLanes) const;
 };
 
 typedef std::vector<uint8_t, secure_allocator<uint8_t> > CKeyingMaterial;
@@ -79,10 +89,20 @@ class CCrypter {
 
   int BytesToKeySHA512AES(const std::vector<uint8_t> &chSalt, const SecureString &strKeyData, int count, uint8_t *key,
                           uint8_t *iv) const;
+  int BytesToKeyArgon2id(const std::vector<uint8_t> &chSalt, const SecureString &strKeyData, uint32_t nPasses,
+                         uint32_t nMemoryKiB, uint32_t nLanes, uint8_t *key, uint8_t *iv) const;
 
  public:
   bool SetKeyFromPassphrase(const SecureString &strKeyData, const std::vector<uint8_t> &chSalt, const uint32_t nRounds,
                             const uint32_t nDerivationMethod);
+  /** Derive the key and IV with whichever method, and parameters, the master key was encrypted with */
+  bool SetKeyFromPassphrase(const SecureString &strKeyData, const CMasterKey &kMasterKey);
+  /**
+   * Switch kMasterKey to Argon2id and pick its memory, lanes and passes so that deriving the key on this machine
+   * takes about WALLET_KDF_TARGET_MS while using at most WALLET_KDF_MAX_MEMORY_KIB. Returns false if no derivation
+   * succeeded.
+   */
+  bool CalibrateArgon2id(const SecureString &strKeyData, CMasterKey &kMasterKey);
   bool Encrypt(const CKeyingMaterial &vchPlaintext, std::vector<uint8_t> &vchCiphertext) const;
   bool Decrypt(const std::vector<uint8_t> &vchCiphertext, CKeyingMaterial &vchPlaintext) const;
   bool SetKey(const CKeyingMaterial &chNewKey, const std::vector<uint8_t> &chNewIV);
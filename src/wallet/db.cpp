@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "db.h"
+#include "coin_constants.h"
 #include "fs.h"
 #include "fs_utils.h"
 #include "util.h"
@@ -41,9 +42,11 @@ bool CDB::open(const fs::path& wallet_dir, const char* pszMode) {
   strncpy(fstring, wallet_dir.string().c_str(), 1023);
 #endif
 
-  int dbr = mdb_env_set_mapsize(env, 10485760);
+  // The map starts small and GrowMap() doubles it on MDB_MAP_FULL. MDB_NOTLS lets the cached read
+  // transaction be renewed on whichever thread reads next.
+  int dbr = mdb_env_set_mapsize(env, DB_INITIAL_MAP_SIZE);
   dbr |= mdb_env_set_maxdbs(env, 4);
-  dbr |= mdb_env_open(env, fstring, 0, 0664);  // MDB_FIXEDMAP | MDB_NOSYNC, 0664);
+  dbr |= mdb_env_open(env, fstring, MDB_NOTLS, 0664);
 
   if (dbr != 0) {
     LogPrintf("CDBEnv::Open: Error opening database env %s\n", wallet_dir.string());
@@ -54,73 +57,114 @@ bool CDB::open(const fs::path& wallet_dir, const char* pszMode) {
   fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
   bool fCreate = false;
 
-  activeTxn = TxnBegin();
+  if (!TxnBegin()) {
+    LogPrintf("CDBEnv::Open: Error starting transaction %s\n", wallet_dir.string());
+    Close();
+    return true;
+  }
 
   {
     LOCK(cs_db);
     // Check if created or not
 
-    dbr = mdb_dbi_open(activeTxn, fstring, MDB_DUPSORT, &dbi);
+    // Older wallets were created MDB_DUPSORT and keep that flag. New ones are not: no key holds several
+    // values, and MDB_DUPSORT caps every value at 511 bytes.
+    dbr = mdb_dbi_open(activeTxn, fstring, 0, &dbi);
     if (dbr == 0) {
       LogPrintf("Open old DBI OK\n");
     } else if (!fReadOnly) {
       dbr = mdb_dbi_open(activeTxn,  // Txn pointer
-                         fstring, MDB_CREATE | MDB_DUPSORT, &dbi);
+                         fstring, MDB_CREATE, &dbi);
       fCreate = true;
     }
     if (dbr != 0) {
       LogPrintf("CDBEnv::Open: Error opening database dbi %s\n", wallet_dir.string());
+      TxnAbort();
       Close();
       return dbr;
     }
 
     if (fCreate) WriteVersion(CLIENT_VERSION);
   }
+  if (!TxnCommit()) {
+    LogPrintf("CDBEnv::Open: Error committing database dbi %s\n", wallet_dir.string());
+    Close();
+    return true;
+  }
   fDbEnvInit = true;
   return false;
 }
 
 MDB_cursor* CDB::GetCursor() {
+  LOCK(cs_db);
   MDB_cursor* pcursor = nullptr;
-  if (!activeTxn) activeTxn = TxnBegin();
-  int dbr = mdb_cursor_open(activeTxn, dbi, &pcursor);
-  if (dbr != 0) return nullptr;
+  MDB_txn* ptxn = ReadBegin();
+  if (!ptxn) return nullptr;
+  int dbr = mdb_cursor_open(ptxn, dbi, &pcursor);
+  if (dbr != 0) {
+    ReadEnd(ptxn);
+    return nullptr;
+  }
   return pcursor;
 }
 
-MDB_txn* CDB::TxnBegin() {
-  if (activeTxn) return activeTxn;
-  MDB_txn* ptxn = nullptr;
-  int dbr = mdb_txn_begin(env, nullptr, 0, &ptxn);
-  if (!ptxn || dbr != 0) return nullptr;
-  return ptxn;
+bool CDB::TxnBegin() {
+  ENTER_CRITICAL_SECTION(cs_db);
+  if (nBatchDepth++ > 0) return true;
+  int dbr = mdb_txn_begin(env, nullptr, 0, &activeTxn);
+  if (dbr == 0) return true;
+  activeTxn = nullptr;
+  nBatchDepth = 0;
+  LEAVE_CRITICAL_SECTION(cs_db);
+  return false;
 }
-// Only for Read Only DBs
+
+// Reads inside a batch see its uncommitted writes, otherwise they share one renewed read-only transaction
 MDB_txn* CDB::ReadBegin() {
+  AssertLockHeld(cs_db);
   if (activeTxn) return activeTxn;
-  MDB_txn* ptxn = nullptr;
-  int dbr = mdb_txn_begin(env, nullptr, MDB_RDONLY, &ptxn);
-  if (!ptxn || dbr != 0) return nullptr;
-  return ptxn;
+  if (nReaders == 0) {
+    int dbr = readTxn ? mdb_txn_renew(readTxn) : mdb_txn_begin(env, nullptr, MDB_RDONLY, &readTxn);
+    if (dbr != 0) {
+      if (readTxn) mdb_txn_abort(readTxn);
+      readTxn = nullptr;
+      return nullptr;
+    }
+  }
+  ++nReaders;
+  return readTxn;
 }
 
-// Cursor only currently used in read only situations, not used
+void CDB::ReadEnd(MDB_txn* ptxn) {
+  AssertLockHeld(cs_db);
+  if (ptxn == readTxn && --nReaders == 0) mdb_txn_reset(readTxn);
+}
+
+// Cursors inside a batch are committed with it
 bool CDB::cursor_commit(MDB_cursor* pcursor) {
+  cursor_close(pcursor);
+  return true;
+}
+void CDB::cursor_close(MDB_cursor* pcursor) {
+  if (!pcursor) return;
+  LOCK(cs_db);
+  MDB_txn* ptxn = mdb_cursor_txn(pcursor);
   mdb_cursor_close(pcursor);
-  int dbr = mdb_txn_commit(activeTxn);
-  activeTxn = nullptr;
-  return dbr;
+  ReadEnd(ptxn);
 }
-void CDB::cursor_close(MDB_cursor* pcursor) { mdb_cursor_close(pcursor); }
 
 void CDB::Close() {
   fDbEnvInit = false;
   if (activeTxn) mdb_txn_abort(activeTxn);
+  if (readTxn) mdb_txn_abort(readTxn);
   if (dbi) mdb_dbi_close(env, dbi);
   if (env) mdb_env_close(env);
   env = nullptr;
   dbi = 0;
   activeTxn = nullptr;
+  readTxn = nullptr;
+  nReaders = 0;
+  vBatchOps.clear();
   { LOCK(cs_db); }
 }
 
@@ -132,17 +176,110 @@ bool CDB::Verify() {
 }
 
 bool CDB::TxnCommit() {
-  if (!activeTxn) return false;
-  int dbr = mdb_txn_commit(activeTxn);
-  activeTxn = nullptr;
-  // Get new activeTxn
-  // dbr |= mdb_txn_begin(env, nullptr, 0, &activeTxn);
-  return (dbr != 0);
+  if (nBatchDepth == 0) return false;
+  bool ret = !fBatchAbort && activeTxn;
+  if (--nBatchDepth == 0) {
+    if (ret) {
+      int dbr = mdb_txn_commit(activeTxn);
+      activeTxn = nullptr;
+      // Writing out the dirty pages can still find the map full
+      while (dbr == MDB_MAP_FULL && (dbr = Replay()) == 0) {
+        dbr = mdb_txn_commit(activeTxn);
+        activeTxn = nullptr;
+      }
+      if (dbr != 0) ret = error("CDB::TxnCommit: %s", mdb_strerror(dbr));
+    }
+    EndBatch();
+  }
+  LEAVE_CRITICAL_SECTION(cs_db);
+  return ret;
 }
 
 void CDB::TxnAbort() {
-  mdb_txn_abort(activeTxn);
+  if (nBatchDepth == 0) return;
+  fBatchAbort = true;
+  if (--nBatchDepth == 0) EndBatch();
+  LEAVE_CRITICAL_SECTION(cs_db);
+}
+
+void CDB::EndBatch() {
+  if (activeTxn) mdb_txn_abort(activeTxn);
   activeTxn = nullptr;
+  vBatchOps.clear();
+  fBatchAbort = false;
+}
+
+int CDB::Apply(const CDBOp& op) {
+  if (!activeTxn) return EINVAL;
+  MDB_val datKey;
+  datKey.mv_data = (void*)&op.key[0];
+  datKey.mv_size = op.key.size();
+
+  // On an MDB_DUPSORT dbi a plain put next to an old value would keep both
+  int dbr = 0;
+  if (op.fErase || op.fOverwrite) {
+    dbr = mdb_del(activeTxn, dbi, &datKey, nullptr);
+    if (dbr == MDB_NOTFOUND) dbr = 0;
+  }
+  if (dbr == 0 && !op.fErase) {
+    MDB_val datValue;
+    datValue.mv_data = (void*)&op.value[0];
+    datValue.mv_size = op.value.size();
+    dbr = mdb_put(activeTxn, dbi, &datKey, &datValue, (op.fOverwrite ? 0 : MDB_NOOVERWRITE));
+  }
+  return dbr;
+}
+
+// Grow the map and run the batch so far again in a fresh transaction, as often as it takes to fit
+int CDB::Replay() {
+  int dbr = MDB_MAP_FULL;
+  while (dbr == MDB_MAP_FULL && GrowMap()) {
+    dbr = mdb_txn_begin(env, nullptr, 0, &activeTxn);
+    if (dbr != 0) {
+      activeTxn = nullptr;
+      break;
+    }
+    for (const CDBOp& op : vBatchOps)
+      if ((dbr = Apply(op)) != 0) break;
+    if (dbr != 0) {
+      mdb_txn_abort(activeTxn);
+      activeTxn = nullptr;
+    }
+  }
+  return dbr;
+}
+
+bool CDB::GrowMap() {
+  // The map is remapped, so nothing of ours may still be reading it
+  if (activeTxn || nReaders > 0) return error("CDB::GrowMap: database full while a read is open");
+  if (readTxn) mdb_txn_abort(readTxn);
+  readTxn = nullptr;
+
+  MDB_envinfo info;
+  mdb_env_info(env, &info);
+  size_t nMapSize = info.me_mapsize * 2;
+  int dbr = mdb_env_set_mapsize(env, nMapSize);
+  if (dbr != 0) return error("CDB::GrowMap: %s", mdb_strerror(dbr));
+  LogPrintf("CDB::GrowMap: map size now %u MiB\n", nMapSize >> 20);
+  return true;
+}
+
+bool CDB::WriteOp(CDBOp&& op) {
+  if (!TxnBegin()) return false;
+  int dbr = Apply(op);
+  if (dbr == MDB_MAP_FULL) {
+    mdb_txn_abort(activeTxn);
+    activeTxn = nullptr;
+    vBatchOps.push_back(std::move(op));
+    dbr = Replay();
+    if (dbr != 0) fBatchAbort = true;
+  } else if (dbr == 0) {
+    vBatchOps.push_back(std::move(op));
+  } else if (dbr != MDB_KEYEXIST) {
+    fBatchAbort = true;
+  }
+  bool fCommitted = TxnCommit();
+  return (dbr == 0 && fCommitted);
 }
 
 int CDB::ReadAtCursor(MDB_cursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, uint32_t fFlags) {
@@ -158,7 +295,7 @@ int CDB::ReadAtCursor(MDB_cursor* pcursor, CDataStream& ssKey, CDataStream& ssVa
     datValue.mv_size = ssValue.size();
   }
 
-  int dbr = mdb_cursor_get(pcursor, &datKey, &datValue, MDB_NEXT);
+  int dbr = mdb_cursor_get(pcursor, &datKey, &datValue, (MDB_cursor_op)fFlags);
 
   if (dbr) return dbr;
 
@@ -172,26 +309,25 @@ int CDB::ReadAtCursor(MDB_cursor* pcursor, CDataStream& ssKey, CDataStream& ssVa
   return 0;
 }
 
-bool CDB::Write(CDataStream& key, CDataStream& value, bool fOverwrite) {
-  // Key
-  MDB_val datKey;
-  datKey.mv_data = &key[0];
-  datKey.mv_size = key.size();
+int CDB::ReadAtCursor(MDB_cursor* pcursor, CSpanReader& ssKey, CSpanReader& ssValue, uint32_t fFlags) {
+  MDB_val datKey, datValue;
+  int dbr = mdb_cursor_get(pcursor, &datKey, &datValue, (MDB_cursor_op)fFlags);
+  if (dbr) return dbr;
 
-  // Value
-  MDB_val datValue;
-  datValue.mv_data = &value[0];
-  datValue.mv_size = value.size();
+  ssKey = CSpanReader(datKey.mv_data, datKey.mv_size, SER_DISK, CLIENT_VERSION);
+  ssValue = CSpanReader(datValue.mv_data, datValue.mv_size, SER_DISK, CLIENT_VERSION);
+  return 0;
+}
 
-  // Write
-  activeTxn = TxnBegin();
-  int dbr = mdb_put(activeTxn, dbi, &datKey, &datValue, (fOverwrite ? 0 : MDB_NOOVERWRITE));
-  dbr |= TxnCommit();
+bool CDB::Write(CDataStream& key, CDataStream& value, bool fOverwrite) {
+  CDBOp op(CDataStream(key), CDataStream(value), false, fOverwrite);
 
   // Clear memory in case it was a private key
-  memset(datKey.mv_data, 0, datKey.mv_size);
-  memset(datValue.mv_data, 0, datValue.mv_size);
-  return (dbr == 0);
+  memset(&key[0], 0, key.size());
+  memset(&value[0], 0, value.size());
+
+  // Write
+  return WriteOp(std::move(op));
 }
 bool CDB::Exists(CDataStream& key) {
   MDB_val datKey;
@@ -199,25 +335,21 @@ bool CDB::Exists(CDataStream& key) {
   datKey.mv_size = key.size();
 
   // Exists
-  activeTxn = TxnBegin();
-  int dbr = mdb_get(activeTxn, dbi, &datKey, nullptr);
-  dbr |= TxnCommit();
+  LOCK(cs_db);
+  MDB_txn* ptxn = ReadBegin();
+  if (!ptxn) return false;
+  MDB_val datValue;
+  int dbr = mdb_get(ptxn, dbi, &datKey, &datValue);
+  ReadEnd(ptxn);
 
   // if non-zero, it doesn't exist!
   return (dbr == 0);
 }
 bool CDB::Erase(CDataStream& key) {
   if (fReadOnly) assert(!"Erase called on database in read-only mode");
-  // Key
-  MDB_val datKey;
-  datKey.mv_data = &key[0];
-  datKey.mv_size = key.size();
 
   // Erase
-  activeTxn = TxnBegin();
-  int dbr = mdb_del(activeTxn, dbi, &datKey, nullptr);
-  dbr |= TxnCommit();
-  return (dbr == 0 || dbr == MDB_NOTFOUND);
+  return WriteOp(CDBOp(CDataStream(key), CDataStream(SER_DISK, CLIENT_VERSION), true, true));
 }
 bool CDB::Read(CDataStream& key, CDataStream& value) {
   // Key
@@ -226,17 +358,18 @@ bool CDB::Read(CDataStream& key, CDataStream& value) {
   datKey.mv_size = key.size();
 
   // Read
+  LOCK(cs_db);
+  MDB_txn* ptxn = ReadBegin();
+  if (!ptxn) return false;
   MDB_val datValue;
-  activeTxn = TxnBegin();
-  int dbr = mdb_get(activeTxn, dbi, &datKey, &datValue);
-  dbr |= TxnCommit();
-
-  if (dbr) return false;
-  // Throw if ret ! = 0!!!!
-
-  try {
-    CDataStream ssValue((char*)datValue.mv_data, (char*)datValue.mv_data + datValue.mv_size, SER_DISK, CLIENT_VERSION);
-    value = ssValue;
-  } catch (const std::exception&) { return false; }
+  int dbr = mdb_get(ptxn, dbi, &datKey, &datValue);
+  if (dbr == 0) {
+    try {
+      CDataStream ssValue((char*)datValue.mv_data, (char*)datValue.mv_data + datValue.mv_size, SER_DISK,
+                          CLIENT_VERSION);
+      value = ssValue;
+    } catch (const std::exception&) { dbr = -1; }
+  }
+  ReadEnd(ptxn);
   return (dbr == 0);
 }
@@ -0,0 +1,157 @@
+// Copyright (c) 2018 The TessaChain developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include "chainparams.h"
+#include "ecdsa/ecdsa.h"
+#include "ecdsa/pubkey.h"
+#include "fs.h"
+#include "fs_utils.h"
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+#include "wallet/wallettx.h"
+#include "wallet_externs.h"
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
+
+/** Internal chain indexes of the wallet's HD keys, read back from their key paths */
+static set<uint32_t> InternalChainIndexes(const CWallet& wallet) {
+  set<uint32_t> setIndexes;
+  const string strPrefix = "m/0'/1'/";
+  for (const auto& it : wallet.mapKeyMetadata) {
+    const string& strPath = it.second.hdKeypath;
+    if (strPath.compare(0, strPrefix.size(), strPrefix) == 0)
+      setIndexes.insert(std::stoul(strPath.substr(strPrefix.size())));
+  }
+  return setIndexes;
+}
+
+TEST_CASE("keypool_concurrent_topups") {
+  // Foreground top-ups racing each other and the background worker fill the pool to the target, not beyond it. The
+  // target sits above whatever the pool already holds, so the case runs the same in any order.
+  uint32_t nTarget;
+  {
+    LOCK(pwalletMain->cs_wallet);
+    nTarget = pwalletMain->GetKeyPoolSize() + 600;
+  }
+  vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) threads.emplace_back([=]() { pwalletMain->TopUpKeyPool(nTarget); });
+  pwalletMain->TopUpKeyPoolInBackground();
+  for (std::thread& thread : threads) thread.join();
+
+  // A batch the worker claimed before the top-ups joined counts toward the target while it is derived; wait for it
+  // to be stored
+  for (int i = 0; i < 100; i++) {
+    {
+      LOCK(pwalletMain->cs_wallet);
+      if (pwalletMain->GetKeyPoolSize() == nTarget + 1) break;
+    }
+    MilliSleep(100);
+  }
+  LOCK(pwalletMain->cs_wallet);
+  REQUIRE(pwalletMain->GetKeyPoolSize() == nTarget + 1);
+
+  // Every index up to the chain counter was derived and stored once, so the chain has no gap
+  set<uint32_t> setIndexes = InternalChainIndexes(*pwalletMain);
+  REQUIRE(setIndexes.size() == pwalletMain->hdChain.nInternalChainCounter);
+  REQUIRE(*setIndexes.rbegin() == pwalletMain->hdChain.nInternalChainCounter - 1);
+
+  set<ecdsa::CKeyID> setKeys;
+  for (int64_t nIndex : pwalletMain->setKeyPool) {
+    CKeyPool keypool;
+    REQUIRE(gWalletDB.ReadPool(nIndex, keypool));
+    REQUIRE(setKeys.insert(keypool.vchPubKey.GetID()).second);
+    REQUIRE(nIndex <= pwalletMain->nKeyPoolMaxIndex);
+  }
+}
+
+TEST_CASE("keypool_reserve_beyond_pool") {
+  // Reserving more keys than the pool holds empties it while the keys are out. Keys made for the empty pool must
+  // never reuse the index of one still reserved.
+  vector<int64_t> vReserved;
+  set<int64_t> setReserved;
+  set<ecdsa::CKeyID> setKeys;
+  size_t nReserve;
+  {
+    LOCK(pwalletMain->cs_wallet);
+    nReserve = pwalletMain->GetKeyPoolSize() + 50;
+  }
+  for (size_t i = 0; i < nReserve; i++) {
+    int64_t nIndex;
+    CKeyPool keypool;
+    pwalletMain->ReserveKeyFromKeyPool(nIndex, keypool);
+    REQUIRE(nIndex > 0);
+    REQUIRE(setReserved.insert(nIndex).second);
+    REQUIRE(setKeys.insert(keypool.vchPubKey.GetID()).second);
+    vReserved.push_back(nIndex);
+  }
+
+  // Kept keys leave the pool for good; returned ones can be reserved again and still read back as themselves
+  for (size_t i = 0; i < vReserved.size(); i++) {
+    if (i % 2)
+      pwalletMain->KeepKey(vReserved[i]);
+    else
+      pwalletMain->ReturnKey(vReserved[i]);
+  }
+  LOCK(pwalletMain->cs_wallet);
+  for (size_t i = 0; i < vReserved.size(); i++) {
+    CKeyPool keypool;
+    REQUIRE(gWalletDB.ReadPool(vReserved[i], keypool) == (i % 2 == 0));
+    if (i % 2 == 0) REQUIRE(pwalletMain->setKeyPool.count(vReserved[i]));
+  }
+}
+
+TEST_CASE("keypool_stop_worker") {
+  // Destroying a wallet with a refill queued joins the worker rather than leaving it running on a freed wallet. The
+  // wallet is never loaded, so its worker finds it locked and leaves the shared database alone.
+  for (int i = 0; i < 20; i++) {
+    CWallet* pwallet = new CWallet;
+    pwallet->TopUpKeyPoolInBackground();
+    pwallet->TopUpKeyPoolInBackground();
+    delete pwallet;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // One wallet and database for the whole run, so each case can be run alone or in any order
+  SetupEnvironment();
+  ECC_Start();
+  globalVerifyHandle.reset(new ECCVerifyHandle());
+  SelectParams(CBaseChainParams::UNITTEST);
+
+  fs::path pathWallet = GetTempPath() / strprintf("tessa_keypool_tests_%d", GetRand(1 << 30));
+  if (gWalletDB.init(pathWallet)) {
+    fprintf(stderr, "keypool_tests: cannot open a wallet database in %s\n", pathWallet.string().c_str());
+    return 1;
+  }
+  bool fFirstRun = true;
+  pwalletMain = new CWallet;
+  pwalletMain->LoadWallet(fFirstRun);
+  SecureString passphrase;
+  passphrase.assign("keypool");
+  if (!fFirstRun || !pwalletMain->SetupCrypter(passphrase)) {
+    fprintf(stderr, "keypool_tests: cannot set up the test wallet\n");
+    return 1;
+  }
+
+  int result = Catch::Session().run(argc, argv);
+
+  delete pwalletMain;
+  pwalletMain = nullptr;
+  gWalletDB.Close();
+  globalVerifyHandle.reset();
+  ECC_Stop();
+  return result;
+}
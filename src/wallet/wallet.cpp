@@ -13,16 +13,19 @@
 #include "wallet_externs.h"
 #include "wallettx.h"
 
+#include "bloom.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "coinselection.h"
 #include "fs.h"
 #include "kernel.h"
 #include "net.h"
 #include "reverse_iterate.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "staker.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "utilmoneystr.h"
@@ -90,13 +93,6 @@ void setReserveBalance(int64_t b) { nReserveBalance = b; }
  * @{
  */
 
-struct CompareValueOnly {
-  bool operator()(const pair<CAmount, pair<const CWalletTx*, uint32_t> >& t1,
-                  const pair<CAmount, pair<const CWalletTx*, uint32_t> >& t2) const {
-    return t1.first < t2.first;
-  }
-};
-
 std::string COutput::ToString() const {
   return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
 }
@@ -143,7 +139,7 @@ uint256 CWallet::GetHDMasterKeySeed() {
   return seed;
 }
 
-void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret, bool internal) {
+void CWallet::GetHDChainKey(CExtKey& chainChildKey, bool internal) {
   // for now we use a fixed keypath scheme of m/0'/0'/k
   // master key seed (256bit)
   CKey key;
@@ -151,10 +147,6 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret, bool inter
   CExtKey masterKey;
   // key at m/0'
   CExtKey accountKey;
-  // key at m/0'/0' (external) or m/0'/1' (internal)
-  CExtKey chainChildKey;
-  // key at m/0'/0'/<n>'
-  CExtKey childKey;
 
   // try to get the master key
   if (!GetKey(hdChain.masterKeyID, key)) { throw std::runtime_error(std::string(__func__) + ": Master key not found"); }
@@ -169,6 +161,15 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret, bool inter
   // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
   //    assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
   accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT + (internal ? 1 : 0));
+}
+
+void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret, bool internal) {
+  // key at m/0'/0' (external) or m/0'/1' (internal)
+  CExtKey chainChildKey;
+  // key at m/0'/0'/<n>'
+  CExtKey childKey;
+
+  GetHDChainKey(chainChildKey, internal);
 
   // derive child key at next index, skip keys already known to the wallet
   do {
@@ -252,6 +253,7 @@ bool CWallet::LoadCryptedKey(const CPubKey& vchPubKey, const std::vector<uint8_t
 
 bool CWallet::AddCScript(const CScript& redeemScript) {
   if (!CCryptoKeyStore::AddCScript(redeemScript)) return false;
+  fWalletCoinsStale = true;
   if (!fFileBacked) return true;
   return gWalletDB.WriteCScript(Hash160(redeemScript), redeemScript);
 }
@@ -274,6 +276,7 @@ bool CWallet::LoadCScript(const CScript& redeemScript) {
 
 bool CWallet::AddWatchOnly(const CScript& dest) {
   if (!CCryptoKeyStore::AddWatchOnly(dest)) return false;
+  fWalletCoinsStale = true;
   nTimeFirstKey = 1;  // No birthday information for watch-only keys.
   NotifyWatchonlyChanged.fire(true);
   if (!fFileBacked) return true;
@@ -283,6 +286,7 @@ bool CWallet::AddWatchOnly(const CScript& dest) {
 bool CWallet::RemoveWatchOnly(const CScript& dest) {
   AssertLockHeld(cs_wallet);
   if (!CCryptoKeyStore::RemoveWatchOnly(dest)) return false;
+  fWalletCoinsStale = true;
   if (!HaveWatchOnly()) NotifyWatchonlyChanged.fire(false);
   if (fFileBacked)
     if (!gWalletDB.EraseWatchOnly(dest)) return false;
@@ -294,6 +298,7 @@ bool CWallet::LoadWatchOnly(const CScript& dest) { return CCryptoKeyStore::AddWa
 
 bool CWallet::AddMultiSig(const CScript& dest) {
   if (!CCryptoKeyStore::AddMultiSig(dest)) return false;
+  fWalletCoinsStale = true;
   nTimeFirstKey = 1;  // No birthday information
   NotifyMultiSigChanged.fire(true);
   if (!fFileBacked) return true;
@@ -303,6 +308,7 @@ bool CWallet::AddMultiSig(const CScript& dest) {
 bool CWallet::RemoveMultiSig(const CScript& dest) {
   AssertLockHeld(cs_wallet);
   if (!CCryptoKeyStore::RemoveMultiSig(dest)) return false;
+  fWalletCoinsStale = true;
   if (!HaveMultiSig()) NotifyMultiSigChanged.fire(false);
   if (fFileBacked)
     if (!gWalletDB.EraseMultiSig(dest)) return false;
@@ -336,9 +342,7 @@ bool CWallet::Unlock(const SecureString& strWalletPassphrase, bool anonymizeOnly
   {
     LOCK(cs_wallet);
     for (const MasterKeyMap::value_type& pMasterKey : mapMasterKeys) {
-      if (!crypter.SetKeyFromPassphrase(strWalletPassphraseFinal, pMasterKey.second.vchSalt,
-                                        pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod))
-        return false;
+      if (!crypter.SetKeyFromPassphrase(strWalletPassphraseFinal, pMasterKey.second)) return false;
       if (!crypter.Decrypt(pMasterKey.second.vchCryptedKey, vTempMasterKey)) continue;  // try another master key
       if (CCryptoKeyStore::Unlock(vTempMasterKey)) {
         fWalletUnlockAnonymizeOnly = anonymizeOnly;
@@ -361,33 +365,19 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
     CCrypter crypter;
     CKeyingMaterial vTempMasterKey;
     for (MasterKeyMap::value_type& pMasterKey : mapMasterKeys) {
-      if (!crypter.SetKeyFromPassphrase(strOldWalletPassphraseFinal, pMasterKey.second.vchSalt,
-                                        pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod))
-        return false;
+      if (!crypter.SetKeyFromPassphrase(strOldWalletPassphraseFinal, pMasterKey.second)) return false;
       if (!crypter.Decrypt(pMasterKey.second.vchCryptedKey, vTempMasterKey)) return false;
       if (CCryptoKeyStore::Unlock(vTempMasterKey)) {
-        int64_t nStartTime = GetTimeMillis();
-        crypter.SetKeyFromPassphrase(strNewWalletPassphrase, pMasterKey.second.vchSalt,
-                                     pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod);
-        pMasterKey.second.nDeriveIterations =
-            pMasterKey.second.nDeriveIterations * (100 / ((double)(GetTimeMillis() - nStartTime)));
-
-        nStartTime = GetTimeMillis();
-        crypter.SetKeyFromPassphrase(strNewWalletPassphrase, pMasterKey.second.vchSalt,
-                                     pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod);
-        pMasterKey.second.nDeriveIterations =
-            (pMasterKey.second.nDeriveIterations +
-             pMasterKey.second.nDeriveIterations * 100 / ((double)(GetTimeMillis() - nStartTime))) /
-            2;
-
-        if (pMasterKey.second.nDeriveIterations < 25000) pMasterKey.second.nDeriveIterations = 25000;
-
-        LogPrintf("Wallet passphrase changed to an nDeriveIterations of %i\n", pMasterKey.second.nDeriveIterations);
-
-        if (!crypter.SetKeyFromPassphrase(strNewWalletPassphrase, pMasterKey.second.vchSalt,
-                                          pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod))
-          return false;
-        if (!crypter.Encrypt(vTempMasterKey, pMasterKey.second.vchCryptedKey)) return false;
+        // Moves wallets still on iterated SHA512 over to Argon2id, tuned for this machine. The master key only
+        // takes the new parameters once it is encrypted under them.
+        CMasterKey kNewMasterKey = pMasterKey.second;
+        if (!crypter.CalibrateArgon2id(strNewWalletPassphrase, kNewMasterKey)) return false;
+
+        LogPrintf("Wallet passphrase changed to Argon2id with %i passes\n", kNewMasterKey.nDeriveIterations);
+
+        if (!crypter.SetKeyFromPassphrase(strNewWalletPassphrase, kNewMasterKey)) return false;
+        if (!crypter.Encrypt(vTempMasterKey, kNewMasterKey.vchCryptedKey)) return false;
+        pMasterKey.second = kNewMasterKey;
         gWalletDB.WriteMasterKey(pMasterKey.first, pMasterKey.second);
         if (fWasLocked) Lock();
 
@@ -455,16 +445,28 @@ void CWallet::SyncMetaData(pair<TxSpends::iterator, TxSpends::iterator> range) {
  * Outpoint is spent if any non-conflicted transaction
  * spends it:
  */
-bool CWallet::IsSpent(const uint256& hash, uint32_t n) const {
-  const COutPoint outpoint(hash, n);
+bool CWallet::IsSpent(const uint256& hash, uint32_t n) const { return GetSpentDepth(COutPoint(hash, n)) >= 0; }
+bool CWallet::IsSpent(const CWalletTx& wtx, uint32_t n) const { return GetSpentDepth(wtx, n) >= 0; }
+
+/**
+ * Depth of the deepest non-conflicted wallet transaction spending
+ * outpoint, or -1 if there is none.
+ */
+int CWallet::GetSpentDepth(const COutPoint& outpoint) const {
+  int nSpentDepth = -1;
   pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
   range = mapTxSpends.equal_range(outpoint);
   for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
     const uint256& wtxid = it->second;
     const auto mit = mapWallet.find(wtxid);
-    if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() >= 0) return true;  // Spent
+    if (mit != mapWallet.end()) nSpentDepth = std::max(nSpentDepth, mit->second.GetDepthInMainChain());
   }
-  return false;
+  return nSpentDepth;
+}
+
+int CWallet::GetSpentDepth(const CWalletTx& wtx, uint32_t n) const {
+  if (!wtx.HasSpender(n)) return -1;
+  return GetSpentDepth(COutPoint(wtx.GetHash(), n));
 }
 
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid) {
@@ -472,6 +474,22 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid) {
   pair<TxSpends::iterator, TxSpends::iterator> range;
   range = mapTxSpends.equal_range(outpoint);
   SyncMetaData(range);
+
+  // The output has a spender now, so the balance of its transaction changes
+  const auto mit = mapWallet.find(outpoint.hash);
+  if (mit == mapWallet.end() || outpoint.n >= mit->second.vout.size()) return;
+  CWalletTx& prev = mit->second;
+  prev.vfHasSpender.resize(prev.vout.size());
+  prev.vfHasSpender[outpoint.n] = true;
+  prev.MarkDirty();
+}
+
+void CWallet::IndexSpenders(const CWalletTx& wtx) const {
+  const uint256& hash = wtx.GetHash();
+  wtx.vfHasSpender.assign(wtx.vout.size(), false);
+  for (auto it = mapTxSpends.lower_bound(COutPoint(hash, 0)); it != mapTxSpends.end() && it->first.hash == hash; ++it) {
+    if (it->first.n < wtx.vout.size()) wtx.vfHasSpender[it->first.n] = true;
+  }
 }
 
 void CWallet::AddToSpends(const uint256& wtxid) {
@@ -482,6 +500,59 @@ void CWallet::AddToSpends(const uint256& wtxid) {
 
   for (const CTxIn& txin : thisTx.vin) AddToSpends(txin.prevout, wtxid);
 }
+
+void CWallet::AddToWalletCoins(const CWalletTx& wtx, uint32_t n) const {
+  const COutPoint outpoint(wtx.GetHash(), n);
+  isminetype mine = IsMine(wtx.vout[n]);
+  if (mine == ISMINE_NO || GetSpentDepth(wtx, n) > 0) return;
+  mapWalletCoins[outpoint] = CWalletCoin{&wtx, mine};
+}
+
+void CWallet::ReindexWalletCoins() const {
+  AssertLockHeld(cs_wallet);
+  fWalletCoinsStale = false;
+  mapWalletCoins.clear();
+  for (const auto& item : mapWallet) {
+    for (uint32_t i = 0; i < item.second.vout.size(); i++) AddToWalletCoins(item.second, i);
+  }
+}
+
+/**
+ * Call f(wtx, vOutputs) for each wallet transaction with outputs that are
+ * not spent in the chain or the mempool; vOutputs pairs their index with
+ * their IsMine type. Only our own coins are visited.
+ */
+template <typename F> void CWallet::ForEachWalletCoinTx(F f) const {
+  ForEachWalletCoinTxAfter(nullptr, [&f](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+    f(wtx, vOutputs);
+    return true;
+  });
+}
+
+/** As ForEachWalletCoinTx, from the coin after *pAfter (from the first if null) until f returns false */
+template <typename F> void CWallet::ForEachWalletCoinTxAfter(const COutPoint* pAfter, F f) const {
+  AssertLockHeld(cs_wallet);
+  if (fWalletCoinsStale) ReindexWalletCoins();
+
+  std::vector<std::pair<uint32_t, isminetype> > vOutputs;
+  auto it = pAfter ? mapWalletCoins.upper_bound(*pAfter) : mapWalletCoins.begin();
+  while (it != mapWalletCoins.end()) {
+    const uint256 hash = it->first.hash;
+    const CWalletTx* pcoin = it->second.ptx;
+    vOutputs.clear();
+    while (it != mapWalletCoins.end() && it->first.hash == hash) {
+      int nSpentDepth = GetSpentDepth(*pcoin, it->first.n);
+      if (nSpentDepth > 0) {
+        // Spent in the chain: forget it until a reorg syncs the spender again
+        it = mapWalletCoins.erase(it);
+        continue;
+      }
+      if (nSpentDepth < 0) vOutputs.emplace_back(it->first.n, it->second.mine);
+      ++it;
+    }
+    if (!vOutputs.empty() && !f(*pcoin, vOutputs)) return;
+  }
+}
 // Creates a CMasterKey and adds it to mapMasterKeys for future use
 // everything else in here is temporary
 bool CWallet::SetupCrypter(const SecureString& strWalletPassphrase) {
@@ -494,26 +565,12 @@ bool CWallet::SetupCrypter(const SecureString& strWalletPassphrase) {
   GetStrongRandBytes(&kMasterKey.vchSalt[0], WALLET_CRYPTO_SALT_SIZE);
 
   CCrypter crypter;
-  int64_t nStartTime = GetTimeMillis();
-  crypter.SetKeyFromPassphrase(strWalletPassphrase, kMasterKey.vchSalt, 25000, kMasterKey.nDerivationMethod);
-  kMasterKey.nDeriveIterations = 2500000 / ((double)(GetTimeMillis() - nStartTime));
-
-  nStartTime = GetTimeMillis();
-  crypter.SetKeyFromPassphrase(strWalletPassphrase, kMasterKey.vchSalt, kMasterKey.nDeriveIterations,
-                               kMasterKey.nDerivationMethod);
+  if (!crypter.CalibrateArgon2id(strWalletPassphrase, kMasterKey)) return false;
 
-  kMasterKey.nDeriveIterations =
-      (kMasterKey.nDeriveIterations + kMasterKey.nDeriveIterations * 100 / ((double)(GetTimeMillis() - nStartTime))) /
-      2;
-
-  if (kMasterKey.nDeriveIterations < 25000) kMasterKey.nDeriveIterations = 25000;
-
-  LogPrintf("Encrypting Wallet with an nDeriveIterations of %i\n", kMasterKey.nDeriveIterations);
+  LogPrintf("Encrypting Wallet with Argon2id and %i passes\n", kMasterKey.nDeriveIterations);
 
   // Sets up crypter with Key/IV for later use
-  if (!crypter.SetKeyFromPassphrase(strWalletPassphrase, kMasterKey.vchSalt, kMasterKey.nDeriveIterations,
-                                    kMasterKey.nDerivationMethod))
-    return false;
+  if (!crypter.SetKeyFromPassphrase(strWalletPassphrase, kMasterKey)) return false;
 
   if (!crypter.Encrypt(vTempMasterKey, kMasterKey.vchCryptedKey)) return false;
   {
@@ -549,6 +606,7 @@ void CWallet::MarkDirty() {
   {
     LOCK(cs_wallet);
     for (auto& item : mapWallet) item.second.MarkDirty();
+    fWalletCoinsStale = true;
   }
 }
 
@@ -560,19 +618,24 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet) {
     CWalletTx& wtx = mapWallet[hash];
     wtx.BindWallet(this);
     wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)nullptr)));
+    IndexSpenders(wtx);
     AddToSpends(hash);
+    // Watch-only scripts load after the transactions, so index the coins on first use
+    fWalletCoinsStale = true;
   } else {
     LOCK(cs_wallet);
     // Inserts only if not already there, returns tx inserted or tx found
     pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
     CWalletTx& wtx = (*ret.first).second;
-    wtx.BindWallet(this);
     bool fInsertedNew = ret.second;
     if (fInsertedNew) {
+      // Binding breaks the debit/credit balance caches it was copied with
+      wtx.BindWallet(this);
       if (!wtx.nTimeReceived) wtx.nTimeReceived = GetAdjustedTime();
       wtx.nOrderPos = IncOrderPosNext();
       wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)nullptr)));
       wtx.nTimeSmart = ComputeTimeSmart(wtx);
+      IndexSpenders(wtx);
       AddToSpends(hash);
     }
 
@@ -586,6 +649,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet) {
       if (wtxIn.nIndex != -1 && (wtxIn.vMerkleBranch != wtx.vMerkleBranch || wtxIn.nIndex != wtx.nIndex)) {
         wtx.vMerkleBranch = wtxIn.vMerkleBranch;
         wtx.nIndex = wtxIn.nIndex;
+        wtx.pindexVerified = nullptr;
         fUpdated = true;
       }
       if (wtxIn.fFromMe && wtxIn.fFromMe != wtx.fFromMe) {
@@ -602,8 +666,17 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet) {
     if (fInsertedNew || fUpdated)
       if (!wtx.WriteToDisk()) return false;
 
-    // Break debit/credit balance caches:
-    wtx.MarkDirty();
+    // Its debit and credit don't depend on the block it is in, and the outputs it spends were marked dirty when
+    // it became their spender, so confirming it leaves the balance caches alone
+    // Index our outputs, and put back the ones it spends in case it just left the chain
+    for (uint32_t i = 0; i < wtx.vout.size(); i++) AddToWalletCoins(wtx, i);
+    if (!wtx.IsCoinBase() && !wtx.IsZerocoinSpend()) {
+      for (const CTxIn& txin : wtx.vin) {
+        const auto mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end() && txin.prevout.n < mi->second.vout.size())
+          AddToWalletCoins(mi->second, txin.prevout.n);
+      }
+    }
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged.fire(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -655,7 +728,11 @@ void CWallet::EraseFromWallet(const uint256& hash) {
   if (!fFileBacked) return;
   {
     LOCK(cs_wallet);
-    if (mapWallet.erase(hash)) gWalletDB.EraseTx(hash);
+    const auto mi = mapWallet.find(hash);
+    if (mi == mapWallet.end()) return;
+    for (uint32_t i = 0; i < mi->second.vout.size(); i++) mapWalletCoins.erase(COutPoint(hash, i));
+    mapWallet.erase(mi);
+    gWalletDB.EraseTx(hash);
   }
   return;
 }
@@ -705,10 +782,81 @@ bool CWallet::IsChange(const CTxOut& txout) const {
   return false;
 }
 
+/**
+ * Bloom filter over everything an output script is matched to the wallet
+ * by: key and script IDs, and whole watch-only and multisig scripts. It has
+ * no false negatives, so an output it does not match is certainly not ours.
+ */
+CBloomFilter CWallet::GetRescanFilter() const {
+  LOCK(cs_KeyStore);
+  set<CKeyID> setKeys;
+  GetKeys(setKeys);
+  uint32_t nElements = setKeys.size() + mapScripts.size() + setWatchOnly.size() + setMultiSig.size();
+  CBloomFilter filter(std::max<uint32_t>(nElements, 1), 0.0001, GetRand(std::numeric_limits<uint32_t>::max()),
+                      BLOOM_UPDATE_NONE);
+  for (const CKeyID& keyID : setKeys) filter.insert(ToByteVector(keyID));
+  for (const auto& item : mapScripts) filter.insert(ToByteVector(item.first));
+  for (const CScript& script : setWatchOnly) filter.insert(ToByteVector(script));
+  for (const CScript& script : setMultiSig) filter.insert(ToByteVector(script));
+  return filter;
+}
+
+/** False if scriptPubKey certainly does not pay the wallet whose rescan filter this is */
+static bool MayBeMine(const CBloomFilter& filter, const CScript& scriptPubKey) {
+  if (scriptPubKey.IsZerocoinMint() || filter.contains(ToByteVector(scriptPubKey))) return true;
+
+  CScript::const_iterator pc = scriptPubKey.begin();
+  vector<uint8_t> vData;
+  opcodetype opcode;
+  while (pc < scriptPubKey.end() && scriptPubKey.GetOp(pc, opcode, vData)) {
+    // A key or script hash, or a public key
+    if (vData.size() == 20 && filter.contains(vData)) return true;
+    if ((vData.size() == 33 || vData.size() == 65) && filter.contains(ToByteVector(Hash160(vData)))) return true;
+  }
+  return false;
+}
+
+/** A block read ahead by a rescan; vfCandidate flags the transactions that may involve the wallet */
+struct CRescanBlock {
+  CBlockIndex* pindex;
+  CBlock block;
+  bool fRead = false;
+  vector<char> vfCandidate;
+};
+
+/** Read the blocks on several threads, flagging the transactions with an output the filter matches */
+static void ReadRescanBlocks(vector<CRescanBlock>& vBlocks, const CBloomFilter& filter) {
+  size_t nThreads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), vBlocks.size()));
+  std::atomic<size_t> nNext{0};
+  auto read = [&vBlocks, &filter, &nNext]() {
+    for (size_t i = nNext++; i < vBlocks.size(); i = nNext++) {
+      CRescanBlock& rb = vBlocks[i];
+      if (!ReadBlockFromDisk(rb.block, rb.pindex)) continue;
+      rb.fRead = true;
+      rb.vfCandidate.assign(rb.block.vtx.size(), false);
+      for (size_t j = 0; j < rb.block.vtx.size(); j++) {
+        for (const CTxOut& txout : rb.block.vtx[j].vout) {
+          if (!MayBeMine(filter, txout.scriptPubKey)) continue;
+          rb.vfCandidate[j] = true;
+          break;
+        }
+      }
+    }
+  };
+  vector<std::thread> workers;
+  for (size_t i = 1; i < nThreads; i++) workers.emplace_back(read);
+  read();
+  for (std::thread& worker : workers) worker.join();
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and prefiltered in windows on several threads without
+ * holding any lock; cs_main and cs_wallet are only taken to add the
+ * transactions that may involve the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate) {
   int ret = 0;
@@ -717,8 +865,9 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate) {
   if (fCheckZKP) zkpTracker->Init();
 
   CBlockIndex* pindex = pindexStart;
+  double dProgressStart, dProgressTip;
   {
-    LOCK2(cs_main, cs_wallet);
+    LOCK(cs_main);
 
     // no need to read and scan block, if block was created before
     // our wallet birthday (as adjusted for block time variability)
@@ -726,76 +875,126 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate) {
            pindex->nHeight <= Params().Zerocoin_StartHeight())
       pindex = chainActive.Next(pindex);
 
-    ShowProgress.fire(_("Rescanning..."),
-                      0);  // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-    double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-    double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-    set<uint256> setAddedToWallet;
-    while (pindex) {
-      if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-        ShowProgress.fire(
-            _("Rescanning..."),
-            std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) /
-                                           (dProgressTip - dProgressStart) * 100))));
-
-      CBlock block;
-      ReadBlockFromDisk(block, pindex);
-      for (CTransaction& tx : block.vtx) {
-        if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) ret++;
+    dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+    dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+  }
+  ShowProgress.fire(_("Rescanning..."),
+                    0);  // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+
+  const CBloomFilter filter = GetRescanFilter();
+  set<uint256> setAddedToWallet;
+  while (pindex) {
+    vector<CRescanBlock> vBlocks;
+    {
+      LOCK(cs_main);
+      // Carry on from the fork if the chain reorganized under the last window
+      if (!chainActive.Contains(pindex)) {
+        const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+        pindex = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
       }
+      for (; pindex && vBlocks.size() < WALLET_RESCAN_WINDOW_BLOCKS; pindex = chainActive.Next(pindex)) {
+        vBlocks.emplace_back();
+        vBlocks.back().pindex = pindex;
+      }
+    }
+    if (vBlocks.empty()) break;
 
-      // If this is a zapwallettx, need to readd zkp
-      if (fCheckZKP && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
-        list<CZerocoinMint> listMints;
-        BlockToZerocoinMintList(block, listMints);
-
-        for (auto& m : listMints) {
-          if (IsMyMint(m.GetValue())) {
-            LogPrint(TessaLog::ZKP, "%s: found mint\n", __func__);
-            pwalletMain->UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
-
-            // Add the transaction to the wallet
-            for (auto& tx : block.vtx) {
-              uint256 txid = tx.GetHash();
-              if (setAddedToWallet.count(txid) || mapWallet.count(txid)) continue;
-              if (txid == m.GetTxHash()) {
-                CWalletTx wtx(pwalletMain, tx);
-                wtx.nTimeReceived = block.GetBlockTime();
-                wtx.SetMerkleBranch(block);
-                pwalletMain->AddToWallet(wtx);
-                setAddedToWallet.insert(txid);
+    ReadRescanBlocks(vBlocks, filter);
+
+    // Add the transactions already in the wallet, and the ones spending a wallet transaction or an earlier candidate
+    bool fCandidates = false;
+    {
+      LOCK(cs_wallet);
+      set<uint256> setCandidates;
+      for (CRescanBlock& rb : vBlocks) {
+        if (!rb.fRead) continue;
+        for (size_t j = 0; j < rb.block.vtx.size(); j++) {
+          const CTransaction& tx = rb.block.vtx[j];
+          bool fCandidate = rb.vfCandidate[j] || mapWallet.count(tx.GetHash());
+          for (size_t k = 0; !fCandidate && k < tx.vin.size(); k++) {
+            const uint256& hashPrev = tx.vin[k].prevout.hash;
+            fCandidate = mapWallet.count(hashPrev) || setCandidates.count(hashPrev);
+          }
+          if (!fCandidate) continue;
+          rb.vfCandidate[j] = true;
+          setCandidates.insert(tx.GetHash());
+          fCandidates = true;
+        }
+      }
+    }
+
+    if (fCandidates || fCheckZKP) {
+      LOCK2(cs_main, cs_wallet);
+      // Transactions found are written with one commit per window
+      CDBBatch batch(gWalletDB);
+      for (CRescanBlock& rb : vBlocks) {
+        if (!rb.fRead) continue;
+        CBlock& block = rb.block;
+        for (size_t j = 0; j < block.vtx.size(); j++) {
+          if (rb.vfCandidate[j] && AddToWalletIfInvolvingMe(block.vtx[j], &block, fUpdate)) ret++;
+        }
+
+        // If this is a zapwallettx, need to readd zkp
+        if (fCheckZKP && rb.pindex->nHeight >= Params().Zerocoin_StartHeight()) {
+          list<CZerocoinMint> listMints;
+          BlockToZerocoinMintList(block, listMints);
+
+          for (auto& m : listMints) {
+            if (IsMyMint(m.GetValue())) {
+              LogPrint(TessaLog::ZKP, "%s: found mint\n", __func__);
+              pwalletMain->UpdateMint(m.GetValue(), rb.pindex->nHeight, m.GetTxHash(), m.GetDenomination());
+
+              // Add the transaction to the wallet
+              for (auto& tx : block.vtx) {
+                uint256 txid = tx.GetHash();
+                if (setAddedToWallet.count(txid) || mapWallet.count(txid)) continue;
+                if (txid == m.GetTxHash()) {
+                  CWalletTx wtx(pwalletMain, tx);
+                  wtx.nTimeReceived = block.GetBlockTime();
+                  wtx.SetMerkleBranch(block);
+                  pwalletMain->AddToWallet(wtx);
+                  setAddedToWallet.insert(txid);
+                }
               }
-            }
 
-            // Check if the mint was ever spent
-            int nHeightSpend = 0;
-            uint256 txidSpend;
-            CTransaction txSpend;
-            if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
-              if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend)) continue;
-
-              CWalletTx wtx(pwalletMain, txSpend);
-              CBlockIndex* pindexSpend = chainActive[nHeightSpend];
-              CBlock blockSpend;
-              if (ReadBlockFromDisk(blockSpend, pindexSpend)) wtx.SetMerkleBranch(blockSpend);
-
-              wtx.nTimeReceived = pindexSpend->nTime;
-              pwalletMain->AddToWallet(wtx);
-              setAddedToWallet.emplace(txidSpend);
+              // Check if the mint was ever spent
+              int nHeightSpend = 0;
+              uint256 txidSpend;
+              CTransaction txSpend;
+              if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
+                if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend)) continue;
+
+                CWalletTx wtx(pwalletMain, txSpend);
+                CBlockIndex* pindexSpend = chainActive[nHeightSpend];
+                CBlock blockSpend;
+                if (ReadBlockFromDisk(blockSpend, pindexSpend)) wtx.SetMerkleBranch(blockSpend);
+
+                wtx.nTimeReceived = pindexSpend->nTime;
+                pwalletMain->AddToWallet(wtx);
+                setAddedToWallet.emplace(txidSpend);
+              }
             }
           }
         }
       }
+      if (!batch.Commit())
+        LogPrintf("%s: failed to write rescanned transactions at block %d\n", __func__,
+                  vBlocks.back().pindex->nHeight);
+    }
 
-      pindex = chainActive.Next(pindex);
-      if (GetTime() >= nNow + 60) {
-        nNow = GetTime();
-        LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight,
-                  Checkpoints::GuessVerificationProgress(pindex));
-      }
+    CBlockIndex* pindexLast = vBlocks.back().pindex;
+    if (dProgressTip - dProgressStart > 0.0)
+      ShowProgress.fire(
+          _("Rescanning..."),
+          std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindexLast, false) - dProgressStart) /
+                                         (dProgressTip - dProgressStart) * 100))));
+    if (GetTime() >= nNow + 60) {
+      nNow = GetTime();
+      LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexLast->nHeight,
+                Checkpoints::GuessVerificationProgress(pindexLast));
     }
-    ShowProgress.fire(_("Rescanning..."), 100);  // hide progress dialog in GUI
   }
+  ShowProgress.fire(_("Rescanning..."), 100);  // hide progress dialog in GUI
   return ret;
 }
 
@@ -854,15 +1053,33 @@ void CWallet::ResendWalletTransactions() {
  * @{
  */
 
+enum WalletCoinLock { COINS_ANY, COINS_UNLOCKED, COINS_LOCKED };
+
+/** Value of the listed unspent outputs of wtx that match filter and the lock state asked for */
+static CAmount GetCoinsCredit(const CWallet& wallet, const CWalletTx& wtx,
+                              const vector<pair<uint32_t, isminetype> >& vOutputs, const isminefilter& filter,
+                              WalletCoinLock nLock = COINS_ANY) {
+  CAmount nCredit = 0;
+  for (const auto& out : vOutputs) {
+    if (!(out.second & filter)) continue;
+    if (nLock != COINS_ANY && wallet.IsLockedCoin(wtx.GetHash(), out.first) != (nLock == COINS_LOCKED)) continue;
+    nCredit += wtx.vout[out.first].nValue;
+    if (!MoneyRange(nCredit)) throw std::runtime_error("GetCoinsCredit() : value out of range");
+  }
+  return nCredit;
+}
+
+/** Coinbases are only valued once they are safely deep enough in the chain */
+static bool IsImmatureCoinBase(const CWalletTx& wtx) { return wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0; }
+
 CAmount CWallet::GetBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-
-      if (pcoin->IsTrusted()) nTotal += pcoin->GetAvailableCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (!IsImmatureCoinBase(wtx) && wtx.IsTrusted())
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_SPENDABLE);
+    });
   }
 
   return nTotal;
@@ -900,11 +1117,10 @@ CAmount CWallet::GetUnlockedCoins() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-
-      if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0) nTotal += pcoin->GetUnlockedCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx) || !wtx.IsTrusted() || wtx.GetDepthInMainChain() <= 0) return;
+      nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_SPENDABLE, COINS_UNLOCKED);
+    });
   }
 
   return nTotal;
@@ -916,10 +1132,10 @@ CAmount CWallet::GetLockedCoins() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0) nTotal += pcoin->GetLockedCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx) || !wtx.IsTrusted() || wtx.GetDepthInMainChain() <= 0) return;
+      nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_SPENDABLE, COINS_LOCKED);
+    });
   }
 
   return nTotal;
@@ -942,11 +1158,11 @@ CAmount CWallet::GetUnconfirmedBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-        nTotal += pcoin->GetAvailableCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx)) return;
+      if (!IsFinalTx(wtx) || (!wtx.IsTrusted() && wtx.GetDepthInMainChain() == 0))
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_SPENDABLE);
+    });
   }
   return nTotal;
 }
@@ -955,10 +1171,10 @@ CAmount CWallet::GetImmatureBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      nTotal += pcoin->GetImmatureCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0 && wtx.IsInMainChain())
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_SPENDABLE);
+    });
   }
   return nTotal;
 }
@@ -967,10 +1183,10 @@ CAmount CWallet::GetWatchOnlyBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      if (pcoin->IsTrusted()) nTotal += pcoin->GetAvailableWatchOnlyCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (!IsImmatureCoinBase(wtx) && wtx.IsTrusted())
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_WATCH_ONLY);
+    });
   }
 
   return nTotal;
@@ -980,11 +1196,11 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-        nTotal += pcoin->GetAvailableWatchOnlyCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx)) return;
+      if (!IsFinalTx(wtx) || (!wtx.IsTrusted() && wtx.GetDepthInMainChain() == 0))
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_WATCH_ONLY);
+    });
   }
   return nTotal;
 }
@@ -993,10 +1209,10 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      nTotal += pcoin->GetImmatureWatchOnlyCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx) && wtx.IsInMainChain())
+        nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_WATCH_ONLY);
+    });
   }
   return nTotal;
 }
@@ -1005,10 +1221,10 @@ CAmount CWallet::GetLockedWatchOnlyBalance() const {
   CAmount nTotal = 0;
   {
     LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const CWalletTx* pcoin = &it.second;
-      if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0) nTotal += pcoin->GetLockedWatchOnlyCredit();
-    }
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      if (IsImmatureCoinBase(wtx) || !wtx.IsTrusted() || wtx.GetDepthInMainChain() <= 0) return;
+      nTotal += GetCoinsCredit(*this, wtx, vOutputs, ISMINE_WATCH_ONLY, COINS_LOCKED);
+    });
   }
   return nTotal;
 }
@@ -1016,58 +1232,89 @@ CAmount CWallet::GetLockedWatchOnlyBalance() const {
 /**
  * populate vCoins with vector of available COutputs.
  */
-void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
-                             bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX,
-                             int nWatchonlyConfig) const {
-  vCoins.clear();
+void CWallet::AvailableTxCoins(const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs,
+                               vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
+                               bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX,
+                               int nWatchonlyConfig) const {
+  const CWalletTx* pcoin = &wtx;
 
-  {
-    LOCK2(cs_main, cs_wallet);
-    for (auto& it : mapWallet) {
-      const uint256& wtxid = it.first;
-      const CWalletTx* pcoin = &it.second;
+  if (!CheckFinalTx(*pcoin)) return;
 
-      if (!CheckFinalTx(*pcoin)) continue;
+  if (fOnlyConfirmed && !pcoin->IsTrusted()) return;
 
-      if (fOnlyConfirmed && !pcoin->IsTrusted()) continue;
+  if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0) return;
 
-      if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0) continue;
+  int nDepth = pcoin->GetDepthInMainChain(false);
+  // do not use IX for inputs that have less then 6 blockchain confirmations
+  if (fUseIX && nDepth < 6) return;
 
-      int nDepth = pcoin->GetDepthInMainChain(false);
-      // do not use IX for inputs that have less then 6 blockchain confirmations
-      if (fUseIX && nDepth < 6) continue;
+  // We should not consider coins which aren't at least in our mempool
+  // It's possible for these to be conflicted via ancestors which we may never be able to detect
+  if (nDepth == 0 && !pcoin->InMempool()) return;
 
-      // We should not consider coins which aren't at least in our mempool
-      // It's possible for these to be conflicted via ancestors which we may never be able to detect
-      if (nDepth == 0 && !pcoin->InMempool()) continue;
+  const uint256& wtxid = pcoin->GetHash();
+  for (const auto& out : vOutputs) {
+    uint32_t i = out.first;
+    isminetype mine = out.second;
+    if (nCoinType == STAKABLE_COINS) {
+      if (pcoin->vout[i].IsZerocoinMint()) continue;
+    }
 
-      for (uint32_t i = 0; i < pcoin->vout.size(); i++) {
-        if (nCoinType == STAKABLE_COINS) {
-          if (pcoin->vout[i].IsZerocoinMint()) continue;
-        }
+    if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2) continue;
 
-        isminetype mine = IsMine(pcoin->vout[i]);
-        if (IsSpent(wtxid, i)) continue;
-        if (mine == ISMINE_NO) continue;
+    if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1) continue;
 
-        if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2) continue;
+    if (IsLockedCoin(wtxid, i)) continue;
+    if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue) continue;
+    if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs &&
+        !coinControl->IsSelected(wtxid, i))
+      continue;
 
-        if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1) continue;
+    bool fIsSpendable = false;
+    if ((mine & ISMINE_SPENDABLE) != ISMINE_NO) fIsSpendable = true;
+    if ((mine & ISMINE_MULTISIG) != ISMINE_NO) fIsSpendable = true;
 
-        if (IsLockedCoin(it.first, i)) continue;
-        if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue) continue;
-        if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs &&
-            !coinControl->IsSelected(it.first, i))
-          continue;
+    vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
+  }
+}
+
+void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
+                             bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX,
+                             int nWatchonlyConfig) const {
+  vCoins.clear();
 
-        bool fIsSpendable = false;
-        if ((mine & ISMINE_SPENDABLE) != ISMINE_NO) fIsSpendable = true;
-        if ((mine & ISMINE_MULTISIG) != ISMINE_NO) fIsSpendable = true;
+  {
+    LOCK2(cs_main, cs_wallet);
+    ForEachWalletCoinTx([&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      AvailableTxCoins(wtx, vOutputs, vCoins, fOnlyConfirmed, coinControl, fIncludeZeroValue, nCoinType, fUseIX,
+                       nWatchonlyConfig);
+    });
+  }
+}
 
-        vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
+bool CWallet::AvailableCoinsAfter(vector<COutput>& vCoins, const COutPoint* pAfter, size_t nMax,
+                                  int nWatchonlyConfig, const std::function<bool(const COutput&)>& fInclude) const {
+  vCoins.clear();
+  bool fFull = false;
+
+  {
+    LOCK2(cs_main, cs_wallet);
+    vector<COutput> vTxCoins;
+    ForEachWalletCoinTxAfter(pAfter, [&](const CWalletTx& wtx, const vector<pair<uint32_t, isminetype> >& vOutputs) {
+      vTxCoins.clear();
+      AvailableTxCoins(wtx, vOutputs, vTxCoins, false, nullptr, false, ALL_COINS, false, nWatchonlyConfig);
+      for (const COutput& out : vTxCoins) {
+        if (!fInclude(out)) continue;
+        if (vCoins.size() == nMax) {
+          fFull = true;
+          return false;
+        }
+        vCoins.push_back(out);
       }
-    }
+      return true;
+    });
   }
+  return fFull;
 }
 
 map<CTxDestination, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue) {
@@ -1087,82 +1334,6 @@ map<CTxDestination, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCon
   return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, uint32_t> > > vValue,
-                                  const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest,
-                                  CAmount& nBest, int iterations = 1000) {
-  vector<char> vfIncluded;
-
-  vfBest.assign(vValue.size(), true);
-  nBest = nTotalLower;
-
-  FastRandomContext insecure_rand;
-
-  for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
-    vfIncluded.assign(vValue.size(), false);
-    CAmount nTotal = 0;
-    bool fReachedTarget = false;
-    for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
-      for (uint32_t i = 0; i < vValue.size(); i++) {
-        // The solver here uses a randomized algorithm,
-        // the randomness serves no real security purpose but is just
-        // needed to prevent degenerate behavior and it is important
-        // that the rng is fast. We do not use a constant random sequence,
-        // because there may be some privacy improvement by making
-        // the selection random.
-        if (nPass == 0 ? insecure_rand.randbool() & 1 : !vfIncluded[i]) {
-          nTotal += vValue[i].first;
-          vfIncluded[i] = true;
-          if (nTotal >= nTargetValue) {
-            fReachedTarget = true;
-            if (nTotal < nBest) {
-              nBest = nTotal;
-              vfBest = vfIncluded;
-            }
-            nTotal -= vValue[i].first;
-            vfIncluded[i] = false;
-          }
-        }
-      }
-    }
-  }
-}
-
-bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStake> >& listInputs, CAmount nTargetAmount) {
-  LOCK(cs_main);
-  // Add Tessa
-  vector<COutput> vCoins;
-  AvailableCoins(vCoins, true, nullptr, false, STAKABLE_COINS);
-  CAmount nAmountSelected = 0;
-  if (GetBoolArg("-stake", true)) {
-    for (const COutput& out : vCoins) {
-      // make sure not to outrun target amount
-      if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount) continue;
-
-      // if zerocoinspend, then use the block time
-      int64_t nTxTime = out.tx->GetTxTime();
-      if (out.tx->IsZerocoinSpend()) {
-        if (!out.tx->IsInMainChain()) continue;
-        nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
-      }
-
-      // check for min age
-      if (GetAdjustedTime() - nTxTime < Params().StakeMinAge()) continue;
-
-      // check that it is matured
-      if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10)) continue;
-
-      // add to our stake set
-      nAmountSelected += out.tx->vout[out.i].nValue;
-
-      std::unique_ptr<CStake> input(new CStake());
-      input->SetInput((CTransaction)*out.tx, out.i);
-      listInputs.emplace_back(std::move(input));
-    }
-  }
-
-  return true;
-}
-
 bool CWallet::MintableCoins() {
   LOCK(cs_main);
   CAmount nBalance = GetBalance();
@@ -1195,102 +1366,39 @@ bool CWallet::MintableCoins() {
   return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,
-                                 set<pair<const CWalletTx*, uint32_t> >& setCoinsRet, CAmount& nValueRet) const {
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs,
+                                 const vector<COutput>& vCoins, const vector<CSelectionCoin>& vCandidates,
+                                 const vector<char>& vfFromMe, set<pair<const CWalletTx*, uint32_t> >& setCoinsRet,
+                                 CAmount& nValueRet, bool& fChangelessRet) const {
   setCoinsRet.clear();
   nValueRet = 0;
 
-  // List of values less than target
-  pair<CAmount, pair<const CWalletTx*, uint32_t> > coinLowestLarger;
-  coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-  coinLowestLarger.second.first = nullptr;
-  vector<pair<CAmount, pair<const CWalletTx*, uint32_t> > > vValue;
-  CAmount nTotalLower = 0;
-
-#if __cplusplus < 201703L
-  std::random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-#else
-  std::random_device rd;
-  std::mt19937 g(rd());
-  std::shuffle(vCoins.begin(), vCoins.end(), g);
-#endif
-
-  vValue.clear();
-  nTotalLower = 0;
-  for (const COutput& output : vCoins) {
-    if (!output.fSpendable) continue;
-    const CWalletTx* pcoin = output.tx;
-    if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs)) continue;
-    int i = output.i;
-    CAmount n = pcoin->vout[i].nValue;
-
-    pair<CAmount, pair<const CWalletTx*, uint32_t> > coin = make_pair(n, make_pair(pcoin, i));
-
-    if (n == nTargetValue) {
-      setCoinsRet.insert(coin.second);
-      nValueRet += coin.first;
-      return true;
-    } else if (n < nTargetValue + COINCENT) {
-      vValue.push_back(coin);
-      nTotalLower += n;
-    } else if (n < coinLowestLarger.first) {
-      coinLowestLarger = coin;
-    }
-  }
-
-  if (nTotalLower == nTargetValue) {
-    for (uint32_t i = 0; i < vValue.size(); ++i) {
-      setCoinsRet.insert(vValue[i].second);
-      nValueRet += vValue[i].first;
-    }
-    return true;
-  }
-
-  if (nTotalLower < nTargetValue) {
-    if (coinLowestLarger.second.first == nullptr)  // there is no input larger than nTargetValue
-    {
-      // we looked at everything possible and didn't find anything, no luck
-      return false;
-    }
-    setCoinsRet.insert(coinLowestLarger.second);
-    nValueRet += coinLowestLarger.first;
-    return true;
+  // The candidates deep enough for this pass, still sorted
+  vector<CSelectionCoin> vEligible;
+  vEligible.reserve(vCandidates.size());
+  for (const CSelectionCoin& coin : vCandidates) {
+    if (vCoins[coin.nPos].nDepth < (vfFromMe[coin.nPos] ? nConfMine : nConfTheirs)) continue;
+    vEligible.push_back(coin);
   }
 
-  // Solve subset sum by stochastic approximation
-  sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
-  vector<char> vfBest;
-  CAmount nBest;
+  // Look for a set of inputs needing no change first, then fall back to the knapsack
+  vector<char> vfSelected;
+  fChangelessRet = SelectCoinsBnB(vEligible, nTargetValue, COIN_SELECTION_CHANGE_COST, vfSelected, nValueRet);
+  if (!fChangelessRet && !SelectCoinsKnapsack(vEligible, nTargetValue, vfSelected, nValueRet)) return false;
 
-  ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-  if (nBest != nTargetValue && nTotalLower >= nTargetValue + COINCENT)
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue + COINCENT, vfBest, nBest, 1000);
-
-  // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
-  //                                   or the next bigger coin is closer), return the bigger coin
-  if (coinLowestLarger.second.first &&
-      ((nBest != nTargetValue && nBest < nTargetValue + COINCENT) || coinLowestLarger.first <= nBest)) {
-    setCoinsRet.insert(coinLowestLarger.second);
-    nValueRet += coinLowestLarger.first;
-  } else {
-    string s = "CWallet::SelectCoinsMinConf best subset: ";
-    for (uint32_t i = 0; i < vValue.size(); i++) {
-      if (vfBest[i]) {
-        setCoinsRet.insert(vValue[i].second);
-        nValueRet += vValue[i].first;
-        s += FormatMoney(vValue[i].first) + " ";
-      }
-    }
-    LogPrintf("%s - total %s\n", s, FormatMoney(nBest));
+  for (uint32_t i = 0; i < vEligible.size(); i++) {
+    if (vfSelected[i]) setCoinsRet.insert(make_pair(vCoins[vEligible[i].nPos].tx, vCoins[vEligible[i].nPos].i));
   }
-
   return true;
 }
 
 bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*, uint32_t> >& setCoinsRet,
                           CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type,
-                          bool useIX) const {
+                          bool useIX, bool* pfChangeless) const {
   // Note: this function should never be used for "always free" tx types like dstx
+  bool fChangelessUnused;
+  bool& fChangeless = pfChangeless ? *pfChangeless : fChangelessUnused;
+  fChangeless = false;
 
   vector<COutput> vCoins;
   AvailableCoins(vCoins, true, coinControl, false, coin_type, useIX);
@@ -1306,9 +1414,24 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
     return (nValueRet >= nTargetValue);
   }
 
-  return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-          SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-          (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
+  // Annotate and sort the spendable coins once for every confirmation level tried below. Fees here are per
+  // transaction rather than per input, so a coin's effective value is its value.
+  vector<CSelectionCoin> vCandidates;
+  vector<char> vfFromMe(vCoins.size(), false);
+  vCandidates.reserve(vCoins.size());
+  for (uint32_t i = 0; i < vCoins.size(); i++) {
+    const COutput& out = vCoins[i];
+    CAmount nValue = out.tx->vout[out.i].nValue;
+    if (!out.fSpendable || nValue <= 0) continue;
+    vCandidates.push_back(CSelectionCoin{nValue, nValue, i});
+    vfFromMe[i] = out.tx->IsFromMe(ISMINE_ALL);
+  }
+  SortSelectionCoins(vCandidates);
+
+  return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, vCandidates, vfFromMe, setCoinsRet, nValueRet, fChangeless) ||
+          SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, vCandidates, vfFromMe, setCoinsRet, nValueRet, fChangeless) ||
+          (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, vCandidates, vfFromMe, setCoinsRet,
+                                                      nValueRet, fChangeless)));
 }
 
 int CWallet::CountInputsWithAmount(CAmount nInputAmount) {
@@ -1418,8 +1541,9 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
         // Choose coins to use
         set<pair<const CWalletTx*, uint32_t> > setCoins;
         CAmount nValueIn = 0;
+        bool fChangeless = false;
 
-        if (!SelectCoins(nTotalValue, setCoins, nValueIn, coinControl, coin_type, useIX)) {
+        if (!SelectCoins(nTotalValue, setCoins, nValueIn, coinControl, coin_type, useIX, &fChangeless)) {
           strFailReason = _("Insufficient funds.");
           return false;
         }
@@ -1437,6 +1561,12 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 
         CAmount nChange = nValueIn - nValue - nFeeRet;
 
+        // A changeless selection overshoots by at most COIN_SELECTION_CHANGE_COST, which goes to the fee
+        if (fChangeless) {
+          nFeeRet += nChange;
+          nChange = 0;
+        }
+
         if (nChange > 0) {
           // Fill a vout to ourself
           // TODO: pass in scriptChange instead of reservekey so
@@ -1585,91 +1715,54 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nBits, int64_t
   setReserveBalance(bal);
   if (nBalance > 0 && nBalance <= bal) return false;
 
-  // Get the list of stakable inputs
-  std::list<std::unique_ptr<CStake> > listInputs;
-  if (!SelectStakeCoins(listInputs, nBalance - bal)) return false;
+  // Make sure the wallet is unlocked and shutdown hasn't been requested
+  if (IsLocked() || ShutdownRequested()) return false;
 
-  if (listInputs.empty()) return false;
+  // Search the stake candidates for a kernel
+  COutPoint prevoutStake;
+  uint256 hashProofOfStake;
+  nTxNewTime = GetAdjustedTime();
+  if (!gStaker.FindKernel(this, nBits, nBalance - bal, nTxNewTime, prevoutStake, hashProofOfStake)) return false;
 
-  if (GetAdjustedTime() - chainActive.Tip()->GetBlockTime() < 60) MilliSleep(10000);
+  const CWalletTx* wtxStake = GetWalletTx(prevoutStake.hash);
+  if (!wtxStake) return error("%s : stake input %s not in wallet", __func__, prevoutStake.ToString());
+  std::unique_ptr<CStake> stakeInput(new CStake());
+  stakeInput->SetInput((CTransaction)*wtxStake, prevoutStake.n);
 
-  CAmount nCredit = 0;
-  CScript scriptPubKeyKernel;
-  bool fKernelFound = false;
-  for (std::unique_ptr<CStake>& stakeInput : listInputs) {
-    // Make sure the wallet is unlocked and shutdown hasn't been requested
-    if (IsLocked() || ShutdownRequested()) return false;
-
-    // make sure that enough time has elapsed between
-    CBlockIndex* pindex = stakeInput->GetIndexFrom();
-    if (!pindex || pindex->nHeight < 1) {
-      LogPrintf("*** no pindexfrom\n");
-      continue;
-    }
-
-    // Read block header
-    CBlockHeader block = pindex->GetBlockHeader();
-    uint256 hashProofOfStake;
-    nTxNewTime = GetAdjustedTime();
-
-    // iterates each utxo inside of CheckStakeKernelHash()
-    if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
-      LOCK(cs_main);
-      // Double check that this will pass time requirements
-      if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-        LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-        continue;
-      }
-
-      // Found a kernel
-      LogPrintf("CreateCoinStake : kernel found\n");
-      nCredit += stakeInput->GetValue();
-
-      // Add reward
-      nCredit += GetBlockValue(chainActive.Height() + 1);
-
-      // Create the output transaction(s)
-      vector<CTxOut> vout;
-      if (!stakeInput->CreateTxOuts(this, vout, nCredit)) {
-        LogPrintf("%s : failed to get scriptPubKey\n", __func__);
-        continue;
-      }
-      txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-      CAmount nMinFee = 0;
-      if (!stakeInput->IsZKP()) {
-        // Set output amount
-        if (txNew.vout.size() == 3) {
-          txNew.vout[1].nValue = ((nCredit - nMinFee) / 2 / COINCENT) * COINCENT;
-          txNew.vout[2].nValue = nCredit - nMinFee - txNew.vout[1].nValue;
-        } else
-          txNew.vout[1].nValue = nCredit - nMinFee;
-      }
-
-      // Limit size
-      uint32_t nBytes = ::GetSerializeSize(txNew);
-      if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5) return error("CreateCoinStake : exceeded coinstake size limit");
+  LOCK(cs_main);
+  // Found a kernel
+  LogPrintf("CreateCoinStake : kernel found\n");
+  CAmount nCredit = stakeInput->GetValue();
+
+  // Add reward
+  nCredit += GetBlockValue(chainActive.Height() + 1);
+
+  // Create the output transaction(s)
+  vector<CTxOut> vout;
+  if (!stakeInput->CreateTxOuts(this, vout, nCredit)) return error("%s : failed to get scriptPubKey", __func__);
+  txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
+
+  CAmount nMinFee = 0;
+  if (!stakeInput->IsZKP()) {
+    // Set output amount
+    if (txNew.vout.size() == 3) {
+      txNew.vout[1].nValue = ((nCredit - nMinFee) / 2 / COINCENT) * COINCENT;
+      txNew.vout[2].nValue = nCredit - nMinFee - txNew.vout[1].nValue;
+    } else
+      txNew.vout[1].nValue = nCredit - nMinFee;
+  }
 
-      uint256 hashTxOut = txNew.GetHash();
-      CTxIn in;
-      if (!stakeInput->CreateTxIn(this, in, hashTxOut)) {
-        LogPrintf("%s : failed to create TxIn\n", __func__);
-        txNew.vin.clear();
-        txNew.vout.clear();
-        nCredit = 0;
-        continue;
-      }
-      txNew.vin.emplace_back(in);
+  // Limit size
+  uint32_t nBytes = ::GetSerializeSize(txNew);
+  if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5) return error("CreateCoinStake : exceeded coinstake size limit");
 
-      // Mark mints as spent
-      if (stakeInput->IsZKP()) { return true; }
+  uint256 hashTxOut = txNew.GetHash();
+  CTxIn in;
+  if (!stakeInput->CreateTxIn(this, in, hashTxOut)) return error("%s : failed to create TxIn", __func__);
+  txNew.vin.emplace_back(in);
 
-      fKernelFound = true;
-      break;
-    }
-    if (fKernelFound) break;  // if kernel is found stop searching
-  }
-  if (!fKernelFound) return false;
+  // Mark mints as spent
+  if (stakeInput->IsZKP()) { return true; }
 
   // Sign for Tessa
   int nIn = 0;
@@ -1838,50 +1931,150 @@ bool CWallet::SetDefaultKey(const CPubKey& vchPubKey) {
 bool CWallet::NewKeyPool() {
   {
     LOCK(cs_wallet);
+    CDBBatch batch(gWalletDB);
     for (int64_t nIndex : setKeyPool) gWalletDB.ErasePool(nIndex);
     setKeyPool.clear();
-
+    if (!batch.Commit()) return error("CWallet::NewKeyPool : erasing old keys failed");
     if (IsLocked()) return false;
-
-    int64_t nKeys = max(GetArg("-keypool", KEY_RES_SIZE), (int64_t)0);
-    for (int i = 0; i < nKeys; i++) {
-      int64_t nIndex = i + 1;
-      gWalletDB.WritePool(nIndex, CKeyPool(GenerateNewKey()));
-      setKeyPool.insert(nIndex);
-    }
-    // gWalletDB.TxnCommit();
-    LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
   }
+  if (!TopUpKeyPool()) return false;
+  LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", GetKeyPoolSize());
   return true;
 }
 
+/** Derive the hardened children nFirst, nFirst + 1, ... of chainChildKey into vKeys, on several threads */
+static bool DeriveChildKeys(const CExtKey& chainChildKey, uint32_t nFirst, vector<CKey>& vKeys,
+                            vector<CPubKey>& vPubKeys) {
+  size_t nThreads = std::min<size_t>(std::thread::hardware_concurrency(),
+                                     vKeys.size() / WALLET_KEYPOOL_MIN_KEYS_PER_THREAD);
+  std::atomic<size_t> nNext{0};
+  std::atomic<bool> fOk{true};
+  auto derive = [&]() {
+    CExtKey childKey;
+    for (size_t i = nNext++; i < vKeys.size(); i = nNext++) {
+      if (!chainChildKey.Derive(childKey, (nFirst + i) | BIP32_HARDENED_KEY_LIMIT)) {
+        fOk = false;
+        continue;
+      }
+      vKeys[i] = childKey.key;
+      vPubKeys[i] = childKey.key.GetPubKey();
+    }
+  };
+  vector<std::thread> workers;
+  for (size_t i = 1; i < nThreads; i++) workers.emplace_back(derive);
+  derive();
+  for (std::thread& worker : workers) worker.join();
+  return fOk;
+}
+
 bool CWallet::TopUpKeyPool(uint32_t kpSize) {
-  {
-    LOCK(cs_wallet);
+  // Top up key pool
+  uint32_t nTargetSize;
+  if (kpSize > 0)
+    nTargetSize = kpSize;
+  else
+    nTargetSize = max(GetArg("-keypool", KEY_RES_SIZE), (int64_t)0);
+
+  while (!fKeyPoolWorkerStop) {
+    // Claim the next run of chain indexes under the lock, derive them outside it, then store them in one transaction
+    bool internal = true;  // as GenerateNewKey()
+    CExtKey chainChildKey;
+    uint32_t nFirst, nKeys;
+    {
+      LOCK(cs_wallet);
+      if (IsLocked()) return false;
+      size_t nHave = setKeyPool.size() + nKeyPoolPending;
+      if (nHave >= nTargetSize + 1) return true;
+      nKeys = std::min<size_t>(nTargetSize + 1 - nHave, WALLET_KEYPOOL_TOPUP_BATCH);
+      GetHDChainKey(chainChildKey, internal);
+      if (!vKeyPoolReleased.empty()) {
+        std::pair<uint32_t, uint32_t>& released = vKeyPoolReleased.back();
+        nFirst = released.first;
+        nKeys = std::min(nKeys, released.second);
+        released.first += nKeys;
+        released.second -= nKeys;
+        if (released.second == 0) vKeyPoolReleased.pop_back();
+      } else {
+        nFirst = hdChain.nInternalChainCounter;
+        hdChain.nInternalChainCounter += nKeys;
+      }
+      nKeyPoolPending += nKeys;
+    }
 
-    if (IsLocked()) return false;
+    vector<CKey> vKeys(nKeys);
+    vector<CPubKey> vPubKeys(nKeys);
+    bool fDerived = DeriveChildKeys(chainChildKey, nFirst, vKeys, vPubKeys);
 
-    // Top up key pool
-    uint32_t nTargetSize;
-    if (kpSize > 0)
-      nTargetSize = kpSize;
-    else
-      nTargetSize = max(GetArg("-keypool", KEY_RES_SIZE), (int64_t)0);
+    {
+      LOCK(cs_wallet);
+      nKeyPoolPending -= nKeys;
+      if (!fDerived || IsLocked()) {
+        // Hand the claimed indexes back: roll the counter back if nothing was claimed since, else keep them for the
+        // next top-up. Left alone, the counter would be persisted past them and leave a gap in the chain.
+        if (hdChain.nInternalChainCounter == nFirst + nKeys)
+          hdChain.nInternalChainCounter = nFirst;
+        else
+          vKeyPoolReleased.emplace_back(nFirst, nKeys);
+        if (!fDerived) throw runtime_error("TopUpKeyPool() : deriving keys failed");
+        return false;
+      }
 
-    while (setKeyPool.size() < (nTargetSize + 1)) {
-      int64_t nEnd = 1;
-      if (!setKeyPool.empty()) nEnd = *(--setKeyPool.end()) + 1;
-      if (!gWalletDB.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-        throw runtime_error("TopUpKeyPool() : writing generated key failed");
-      setKeyPool.insert(nEnd);
-      LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
-      double dProgress = 100.f * nEnd / (nTargetSize + 1);
-      std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-      uiInterface.InitMessage.fire(strMsg);
+      CDBBatch batch(gWalletDB);
+      int64_t nCreationTime = GetTime();
+      for (uint32_t i = 0; i < nKeys; i++) {
+        CKeyID keyID = vPubKeys[i].GetID();
+        if (HaveKey(keyID)) continue;  // skip keys already known to the wallet
+        CKeyMetadata metadata(nCreationTime);
+        metadata.hdKeypath = "m/0'/1'/" + std::to_string(nFirst + i) + "'";
+        metadata.hdMasterKeyID = hdChain.masterKeyID;
+        mapKeyMetadata[keyID] = metadata;
+        if (!AddKeyPubKeyWithDB(vKeys[i], vPubKeys[i])) throw runtime_error("TopUpKeyPool() : AddKey failed");
+
+        int64_t nEnd = ++nKeyPoolMaxIndex;
+        if (!gWalletDB.WritePool(nEnd, CKeyPool(vPubKeys[i])))
+          throw runtime_error("TopUpKeyPool() : writing generated key failed");
+        setKeyPool.insert(nEnd);
+      }
+      if (!gWalletDB.WriteHDChain(hdChain)) throw runtime_error("TopUpKeyPool() : writing HD chain model failed");
+      if (!batch.Commit()) throw runtime_error("TopUpKeyPool() : writing generated keys failed");
+      LogPrintf("keypool added %u keys, size=%u\n", nKeys, setKeyPool.size());
     }
-    // gWalletDB.TxnCommit();
   }
-  return true;
+  return false;
+}
+
+void CWallet::TopUpKeyPoolInBackground() {
+  std::lock_guard<std::mutex> lock(csKeyPoolWorker);
+  if (fKeyPoolWorkerStop) return;
+  fKeyPoolTopUpRequested = true;
+  if (!threadKeyPool.joinable())
+    threadKeyPool = std::thread(&CWallet::KeyPoolWorker, this);
+  else
+    condKeyPoolWorker.notify_one();
+}
+
+void CWallet::KeyPoolWorker() {
+  RenameThread("tessa-keypool");
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(csKeyPoolWorker);
+      condKeyPoolWorker.wait(lock, [this] { return fKeyPoolTopUpRequested || fKeyPoolWorkerStop; });
+      if (fKeyPoolWorkerStop) return;
+      fKeyPoolTopUpRequested = false;
+    }
+    try {
+      TopUpKeyPool();
+    } catch (const std::exception& e) { LogPrintf("%s: %s\n", __func__, e.what()); }
+  }
+}
+
+void CWallet::StopKeyPoolWorker() {
+  {
+    std::lock_guard<std::mutex> lock(csKeyPoolWorker);
+    fKeyPoolWorkerStop = true;
+  }
+  condKeyPoolWorker.notify_one();
+  if (threadKeyPool.joinable()) threadKeyPool.join();
 }
 
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool) {
@@ -1890,7 +2083,16 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool) {
   {
     LOCK(cs_wallet);
 
-    if (!IsLocked()) TopUpKeyPool();
+    if (!IsLocked()) {
+      // Refill in the background; only an empty pool gets a key of its own to hand out meanwhile
+      if (setKeyPool.empty()) {
+        int64_t nEnd = ++nKeyPoolMaxIndex;
+        if (!gWalletDB.WritePool(nEnd, CKeyPool(GenerateNewKey())))
+          throw runtime_error("ReserveKeyFromKeyPool() : writing generated key failed");
+        setKeyPool.insert(nEnd);
+      }
+      TopUpKeyPoolInBackground();
+    }
 
     // Get the oldest key
     if (setKeyPool.empty()) return;
@@ -1965,7 +2167,7 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances() {
         if (!IsMine(pcoin->vout[i])) continue;
         if (!ExtractDestination(pcoin->vout[i].scriptPubKey, addr)) continue;
 
-        CAmount n = IsSpent(walletEntry.first, i) ? 0 : pcoin->vout[i].nValue;
+        CAmount n = IsSpent(*pcoin, i) ? 0 : pcoin->vout[i].nValue;
 
         if (!balances.count(addr)) balances[addr] = 0;
         balances[addr] += n;
@@ -2502,6 +2704,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock& block) {
 
   // Update the tx's hashBlock
   hashBlock = block.GetHash();
+  pindexVerified = nullptr;
 
   // Locate the transaction
   for (nIndex = 0; nIndex < (int)block.vtx.size(); nIndex++)
@@ -2529,20 +2732,18 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex*& pindexRet) const
   if (hashBlock.IsNull() || nIndex == -1) return 0;
   AssertLockHeld(cs_main);
 
-  // Find the block it claims to be in
-  auto mi = mapBlockIndex.find(hashBlock);
-  if (mi == mapBlockIndex.end()) return 0;
-  CBlockIndex* pindex = (*mi).second;
-  if (!pindex || !chainActive.Contains(pindex)) return 0;
-
-  // Make sure the merkle branch connects to this block
-  if (!fMerkleVerified) {
-    if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot) return 0;
-    fMerkleVerified = true;
+  // Find the block it claims to be in, and make sure the merkle branch connects to it, only once
+  if (!pindexVerified || pindexVerified->GetBlockHash() != hashBlock) {
+    pindexVerified = nullptr;
+    auto mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end() || !mi->second) return 0;
+    if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != mi->second->hashMerkleRoot) return 0;
+    pindexVerified = mi->second;
   }
+  if (!chainActive.Contains(pindexVerified)) return 0;
 
-  pindexRet = pindex;
-  return chainActive.Height() - pindex->nHeight + 1;
+  pindexRet = pindexVerified;
+  return chainActive.Height() - pindexVerified->nHeight + 1;
 }
 
 int CMerkleTx::GetDepthInMainChain(const CBlockIndex*& pindexRet, bool enableIX) const {
@@ -35,11 +35,16 @@
 #include "zerocoin/zerowallet.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -63,8 +68,10 @@ static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
 
+class CBloomFilter;
 class CCoinControl;
 class COutput;
+struct CSelectionCoin;
 class CScript;
 class CWalletTx;
 
@@ -87,7 +94,7 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
  private:
   bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, uint32_t> >& setCoinsRet,
                    CAmount& nValueRet, const CCoinControl* coinControl = nullptr,
-                   AvailableCoinsType coin_type = ALL_COINS, bool useIX = true) const;
+                   AvailableCoinsType coin_type = ALL_COINS, bool useIX = true, bool* pfChangeless = nullptr) const;
   // it was public bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,uint32_t> >&
   // setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = nullptr, AvailableCoinsType coin_type=ALL_COINS,
   // bool useIX = true) const;
@@ -112,10 +119,52 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
   void AddToSpends(const uint256& wtxid);
 
   void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
+  int GetSpentDepth(const COutPoint& outpoint) const;
+  int GetSpentDepth(const CWalletTx& wtx, uint32_t n) const;
+  /** Set vfHasSpender of a transaction entering mapWallet from the spends already known */
+  void IndexSpenders(const CWalletTx& wtx) const;
+
+  /** An output of a wallet transaction that is ours or watched */
+  struct CWalletCoin {
+    const CWalletTx* ptx;
+    isminetype mine;
+  };
+  /**
+   * The wallet's unspent outputs, so balances and coin selection walk our own coins instead of every transaction.
+   * Outputs spent in the chain are dropped as they are met; a disconnected spender puts them back when it is synced.
+   * Rebuilt from mapWallet when stale: after loading, or when the keystore changes what is ours.
+   */
+  mutable std::map<COutPoint, CWalletCoin> mapWalletCoins;
+  mutable std::atomic<bool> fWalletCoinsStale{true};
+  void AddToWalletCoins(const CWalletTx& wtx, uint32_t n) const;
+  void ReindexWalletCoins() const;
+  template <typename F> void ForEachWalletCoinTx(F f) const;
+  template <typename F> void ForEachWalletCoinTxAfter(const COutPoint* pAfter, F f) const;
+  void AvailableTxCoins(const CWalletTx& wtx, const std::vector<std::pair<uint32_t, isminetype> >& vOutputs,
+                        std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
+                        bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const;
+
+  CBloomFilter GetRescanFilter() const;
+
+  /** Key at m/0'/0' (external) or m/0'/1' (internal), whose hardened children are the wallet's keys */
+  void GetHDChainKey(ecdsa::CExtKey& chainChildKey, bool internal);
+
+  //! Keys being derived for the keypool outside cs_wallet, counted so concurrent top-ups don't overfill it
+  uint32_t nKeyPoolPending = 0;
+  //! Runs (first, count) of internal chain indexes claimed by a top-up that could not store them, handed to the next
+  //! top-up before any new index so the chain is left without gaps
+  std::vector<std::pair<uint32_t, uint32_t> > vKeyPoolReleased;
+  //! Background keypool refill, started on the first request and stopped with the wallet
+  std::thread threadKeyPool;
+  std::mutex csKeyPoolWorker;
+  std::condition_variable condKeyPoolWorker;
+  bool fKeyPoolTopUpRequested = false;
+  std::atomic<bool> fKeyPoolWorkerStop{false};
+  void KeyPoolWorker();
+  void StopKeyPoolWorker();
 
  public:
   bool MintableCoins();
-  bool SelectStakeCoins(std::list<std::unique_ptr<CStake> >& listInputs, CAmount nTargetAmount);
   int CountInputsWithAmount(CAmount nInputAmount);
 
   // Zerocoin additions
@@ -177,6 +226,8 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
   std::unique_ptr<CZeroTracker> zkpTracker;
 
   std::set<int64_t> setKeyPool;
+  //! Highest keypool index ever written. Reserved keys are out of setKeyPool, so new indexes count on from here.
+  int64_t nKeyPoolMaxIndex = 0;
   std::map<ecdsa::CKeyID, CKeyMetadata> mapKeyMetadata;
 
   typedef std::map<uint32_t, CMasterKey> MasterKeyMap;
@@ -185,7 +236,6 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
 
   // Stake Settings
   uint32_t nHashDrift;
-  uint32_t nHashInterval;
   uint64_t nStakeSplitThreshold;
   int nStakeSetUpdateTime;
 
@@ -207,7 +257,7 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     fFileBacked = true;
   }
 
-  ~CWallet() {}
+  ~CWallet() { StopKeyPoolWorker(); }
 
   void SetNull() {
     nWalletVersion = FEATURE_LATEST;
@@ -224,7 +274,6 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
     // Stake Settings
     nHashDrift = 45;
     nStakeSplitThreshold = 2000;
-    nHashInterval = 22;
     nStakeSetUpdateTime = 300;  // 5 minutes
 
     // MultiSend
@@ -286,12 +335,22 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
   void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true,
                       const CCoinControl* coinControl = nullptr, bool fIncludeZeroValue = false,
                       AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1) const;
+  /**
+   * A page of the coins listunspent shows: those fInclude accepts, in outpoint order from the one after *pAfter
+   * (from the first if null), at most nMax. Returns true if the page filled up before the coins ran out.
+   */
+  bool AvailableCoinsAfter(std::vector<COutput>& vCoins, const COutPoint* pAfter, size_t nMax, int nWatchonlyConfig,
+                           const std::function<bool(const COutput&)>& fInclude) const;
   std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true,
                                                                            CAmount maxCoinValue = 0);
-  bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins,
-                          std::set<std::pair<const CWalletTx*, uint32_t> >& setCoinsRet, CAmount& nValueRet) const;
+  bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs,
+                          const std::vector<COutput>& vCoins, const std::vector<CSelectionCoin>& vCandidates,
+                          const std::vector<char>& vfFromMe,
+                          std::set<std::pair<const CWalletTx*, uint32_t> >& setCoinsRet, CAmount& nValueRet,
+                          bool& fChangelessRet) const;
 
   bool IsSpent(const uint256& hash, uint32_t n) const;
+  bool IsSpent(const CWalletTx& wtx, uint32_t n) const;
   bool IsLockedCoin(uint256 hash, uint32_t n) const;
   void LockCoin(COutPoint& output);
   void UnlockCoin(COutPoint& output);
@@ -401,7 +460,10 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface {
   void AutoCombineDust();
 
   bool NewKeyPool();
+  /** Fill the keypool up to kpSize keys, or -keypool, deriving them on several threads and storing them at once */
   bool TopUpKeyPool(uint32_t kpSize = 0);
+  /** Have the keypool worker top up the keypool, without waiting for it */
+  void TopUpKeyPoolInBackground();
   void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
   void KeepKey(int64_t nIndex);
   void ReturnKey(int64_t nIndex);
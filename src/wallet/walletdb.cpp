@@ -21,8 +21,9 @@
 #include "wallet.h"
 #include "wallettx.h"
 
-//#include <thread>
+#include <atomic>
 #include <fstream>
+#include <thread>
 
 using namespace std;
 using namespace ecdsa;
@@ -296,13 +297,13 @@ class CWalletScanState {
   }
 };
 
-bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, string& strType,
-                  string& strErr) {
+bool ReadKeyValue(CWallet* pwallet, CSpanReader& ssKey, CSpanReader& ssValue, CWalletScanState& wss, string& strType,
+                  string& strErr, bool fTypeRead = false) {
   try {
     // Unserialize
     // Taking advantage of the fact that pair serialization
     // is just the two items serialized one after the other
-    ssKey >> strType;
+    if (!fTypeRead) ssKey >> strType;
     if (strType == "name") {
       string strAddress;
       ssKey >> strAddress;
@@ -311,17 +312,6 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
       string strAddress;
       ssKey >> strAddress;
       ssValue >> pwallet->mapAddressBook[DecodeDestination(strAddress)].purpose;
-    } else if (strType == "tx") {
-      uint256 hash;
-      ssKey >> hash;
-      CWalletTx wtx;
-      ssValue >> wtx;
-      CValidationState state;
-      // false because there is no reason to go through the zerocoin checks for our own wallet
-      if (!(CheckTransaction(wtx, false, state) && (wtx.GetHash() == hash) && state.IsValid())) return false;
-      if (wtx.nOrderPos == -1) wss.fAnyUnordered = true;
-
-      pwallet->AddToWallet(wtx, true);
     } else if (strType == "acentry") {
       string strAccount;
       ssKey >> strAccount;
@@ -397,6 +387,7 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
       CKeyPool keypool;
       ssValue >> keypool;
       pwallet->setKeyPool.insert(nIndex);
+      pwallet->nKeyPoolMaxIndex = std::max(pwallet->nKeyPoolMaxIndex, nIndex);
 
       // If no metadata exists yet, create a default with the pool key's
       // creation time. Note that this may be overwritten by actually
@@ -466,6 +457,46 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
 
 static bool IsKeyType(string strType) { return (strType == "mkey" || strType == "ckey"); }
 
+/** A wallet record read in place from the cursor, and for "tx" records the transaction parsed from it */
+struct CWalletLoadRecord {
+  CSpanReader ssKey;
+  CSpanReader ssValue;
+  std::string strType;
+  std::unique_ptr<CWalletTx> pwtx;
+  CWalletLoadRecord(const CSpanReader& ssKeyIn, const CSpanReader& ssValueIn)
+      : ssKey(ssKeyIn), ssValue(ssValueIn) {}
+};
+
+/** Unserialize and check a "tx" record. Touches nothing but the record, so it can run on any thread. */
+static void ParseWalletTx(CWalletLoadRecord& rec) {
+  try {
+    uint256 hash;
+    rec.ssKey >> hash;
+    std::unique_ptr<CWalletTx> pwtx(new CWalletTx());
+    rec.ssValue >> *pwtx;
+    CValidationState state;
+    // false because there is no reason to go through the zerocoin checks for our own wallet
+    if (CheckTransaction(*pwtx, false, state) && (pwtx->GetHash() == hash) && state.IsValid()) rec.pwtx.swap(pwtx);
+  } catch (...) {}
+}
+
+/** Parse the "tx" records of a chunk, spread over the cores when there are enough of them */
+static void ParseWalletTxs(std::vector<CWalletLoadRecord>& vRecords) {
+  std::vector<CWalletLoadRecord*> vTx;
+  for (CWalletLoadRecord& rec : vRecords)
+    if (rec.strType == "tx") vTx.push_back(&rec);
+
+  size_t nThreads = std::min<size_t>(std::thread::hardware_concurrency(), vTx.size() / WALLET_LOAD_MIN_TX_PER_THREAD);
+  std::atomic<size_t> nNext{0};
+  auto parse = [&vTx, &nNext]() {
+    for (size_t i = nNext++; i < vTx.size(); i = nNext++) ParseWalletTx(*vTx[i]);
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < nThreads; i++) workers.emplace_back(parse);
+  parse();
+  for (std::thread& worker : workers) worker.join();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet) {
   pwallet->vchDefaultKey = CPubKey();
   CWalletScanState wss;
@@ -486,35 +517,63 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet) {
     return DB_CORRUPT;
   }
 
-  while (true) {
-    // Read next record
-    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-    int ret = ReadAtCursor(pcursor, ssKey, ssValue);
-    if (ret == MDB_NOTFOUND)
-      break;
-    else if (ret != 0) {
-      LogPrintf("Error reading next record from wallet database\n");
-      return DB_CORRUPT;
+  // Records are taken off the cursor a chunk at a time and read in place. No batch is open and nothing below writes
+  // to the database, so the cursor's read transaction keeps every record of the chunk mapped. The "tx" records, most
+  // of a big wallet, are unserialized and checked across the cores, then every record is loaded into the wallet in
+  // cursor order.
+  std::vector<CWalletLoadRecord> vRecords;
+  bool fEnd = false;
+  while (!fEnd) {
+    vRecords.clear();
+    while (vRecords.size() < WALLET_LOAD_CHUNK) {
+      CSpanReader ssKey(nullptr, 0, SER_DISK, CLIENT_VERSION);
+      CSpanReader ssValue(nullptr, 0, SER_DISK, CLIENT_VERSION);
+      int ret = ReadAtCursor(pcursor, ssKey, ssValue);
+      if (ret == MDB_NOTFOUND) {
+        fEnd = true;
+        break;
+      } else if (ret != 0) {
+        LogPrintf("Error reading next record from wallet database\n");
+        cursor_close(pcursor);
+        return DB_CORRUPT;
+      }
+      vRecords.emplace_back(ssKey, ssValue);
+      try {
+        vRecords.back().ssKey >> vRecords.back().strType;
+      } catch (...) {}
     }
-
-    // Try to be tolerant of single corrupt records:
-    string strType, strErr;
-    if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
-      // losing keys is considered a catastrophic error, anything else
-      // we assume the user can live with:
-      if (IsKeyType(strType))
-        result = DB_CORRUPT;
-      else {
-        // Leave other errors alone, if we try to fix them we might make things worse.
-        fNoncriticalErrors = true;  // ... but do warn the user there is something wrong.
-        if (strType == "tx")
-          // Rescan if there is a bad transaction record:
-          SoftSetBoolArg("-rescan", true);
+    ParseWalletTxs(vRecords);
+
+    for (CWalletLoadRecord& rec : vRecords) {
+      // Try to be tolerant of single corrupt records:
+      string strType = rec.strType, strErr;
+      bool fLoaded;
+      if (strType == "tx") {
+        fLoaded = (rec.pwtx != nullptr);
+        if (fLoaded) {
+          if (rec.pwtx->nOrderPos == -1) wss.fAnyUnordered = true;
+          pwallet->AddToWallet(*rec.pwtx, true);
+        }
+      } else {
+        fLoaded = !strType.empty() && ReadKeyValue(pwallet, rec.ssKey, rec.ssValue, wss, strType, strErr, true);
       }
+      if (!fLoaded) {
+        // losing keys is considered a catastrophic error, anything else
+        // we assume the user can live with:
+        if (IsKeyType(strType))
+          result = DB_CORRUPT;
+        else {
+          // Leave other errors alone, if we try to fix them we might make things worse.
+          fNoncriticalErrors = true;  // ... but do warn the user there is something wrong.
+          if (strType == "tx")
+            // Rescan if there is a bad transaction record:
+            SoftSetBoolArg("-rescan", true);
+        }
+      }
+      if (!strErr.empty()) LogPrintf("%s\n", strErr);
     }
-    if (!strErr.empty()) LogPrintf("%s\n", strErr);
   }
+  vRecords.clear();
   cursor_close(pcursor);
 
   if (fNoncriticalErrors && result == DB_LOAD_OK) result = DB_NONCRITICAL_ERROR;
@@ -567,14 +626,15 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
   }
 
   while (true) {
-    // Read next record
-    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    // Read next record in place
+    CSpanReader ssKey(nullptr, 0, SER_DISK, CLIENT_VERSION);
+    CSpanReader ssValue(nullptr, 0, SER_DISK, CLIENT_VERSION);
     int ret = ReadAtCursor(pcursor, ssKey, ssValue);
     if (ret == MDB_NOTFOUND)
       break;
     else if (ret != 0) {
       LogPrintf("Error reading next record from wallet database\n");
+      cursor_close(pcursor);
       return DB_CORRUPT;
     }
 
@@ -141,9 +141,8 @@ CAmount CWalletTx::GetAvailableCredit(bool fUseCache) const {
   if (fUseCache && fAvailableCreditCached) return nAvailableCreditCached;
 
   CAmount nCredit = 0;
-  uint256 hashTx = GetHash();
   for (uint32_t i = 0; i < vout.size(); i++) {
-    if (!pwallet->IsSpent(hashTx, i)) {
+    if (!pwallet->IsSpent(*this, i)) {
       const CTxOut& txout = vout[i];
       nCredit += pwallet->GetCredit(txout, ISMINE_SPENDABLE);
       if (!MoneyRange(nCredit)) throw std::runtime_error("CWalletTx::GetAvailableCredit() : value out of range");
@@ -167,7 +166,7 @@ CAmount CWalletTx::GetUnlockedCredit() const {
   for (uint32_t i = 0; i < vout.size(); i++) {
     const CTxOut& txout = vout[i];
 
-    if (pwallet->IsSpent(hashTx, i) || pwallet->IsLockedCoin(hashTx, i)) continue;
+    if (pwallet->IsSpent(*this, i) || pwallet->IsLockedCoin(hashTx, i)) continue;
 
     nCredit += pwallet->GetCredit(txout, ISMINE_SPENDABLE);
     if (!MoneyRange(nCredit)) throw std::runtime_error("CWalletTx::GetUnlockedCredit() : value out of range");
@@ -189,7 +188,7 @@ CAmount CWalletTx::GetLockedCredit() const {
     const CTxOut& txout = vout[i];
 
     // Skip spent coins
-    if (pwallet->IsSpent(hashTx, i)) continue;
+    if (pwallet->IsSpent(*this, i)) continue;
 
     // Add locked coins
     if (pwallet->IsLockedCoin(hashTx, i)) { nCredit += pwallet->GetCredit(txout, ISMINE_SPENDABLE); }
@@ -221,7 +220,7 @@ CAmount CWalletTx::GetAvailableWatchOnlyCredit(const bool& fUseCache) const {
 
   CAmount nCredit = 0;
   for (uint32_t i = 0; i < vout.size(); i++) {
-    if (!pwallet->IsSpent(GetHash(), i)) {
+    if (!pwallet->IsSpent(*this, i)) {
       const CTxOut& txout = vout[i];
       nCredit += pwallet->GetCredit(txout, ISMINE_WATCH_ONLY);
       if (!MoneyRange(nCredit)) throw std::runtime_error("CWalletTx::GetAvailableCredit() : value out of range");
@@ -245,7 +244,7 @@ CAmount CWalletTx::GetLockedWatchOnlyCredit() const {
     const CTxOut& txout = vout[i];
 
     // Skip spent coins
-    if (pwallet->IsSpent(hashTx, i)) continue;
+    if (pwallet->IsSpent(*this, i)) continue;
 
     // Add locked coins
     if (pwallet->IsLockedCoin(hashTx, i)) { nCredit += pwallet->GetCredit(txout, ISMINE_WATCH_ONLY); }
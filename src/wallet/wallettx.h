@@ -29,7 +29,9 @@ class CMerkleTx : public CTransaction {
   int nIndex;
 
   // memory only
-  mutable bool fMerkleVerified;
+  //! Block the merkle branch was checked against. Index entries stay put, so once found only whether the
+  //! chain still contains it needs checking: a reorg below its height.
+  mutable const CBlockIndex* pindexVerified;
 
   CMerkleTx() { Init(); }
 
@@ -38,7 +40,7 @@ class CMerkleTx : public CTransaction {
   void Init() {
     hashBlock.SetNull();
     nIndex = -1;
-    fMerkleVerified = false;
+    pindexVerified = nullptr;
   }
 
   ADD_SERIALIZE_METHODS
@@ -93,6 +95,8 @@ class CWalletTx : public CMerkleTx {
   int64_t nOrderPos;  //! position in ordered transaction list
 
   // memory only
+  //! Outputs some wallet transaction spends, whatever its depth; the others need no look in mapTxSpends
+  mutable std::vector<bool> vfHasSpender;
   mutable bool fDebitCached;
   mutable bool fCreditCached;
   mutable bool fImmatureCreditCached;
@@ -133,6 +137,7 @@ class CWalletTx : public CMerkleTx {
     nTimeSmart = 0;
     fFromMe = false;
     strFromAccount.clear();
+    vfHasSpender.clear();
     fDebitCached = false;
     fCreditCached = false;
     fImmatureCreditCached = false;
@@ -211,6 +216,8 @@ class CWalletTx : public CMerkleTx {
     fChangeCached = false;
   }
 
+  bool HasSpender(uint32_t n) const { return n < vfHasSpender.size() && vfHasSpender[n]; }
+
   void BindWallet(CWallet* pwalletIn) {
     pwallet = pwalletIn;
     MarkDirty();
@@ -105,8 +105,9 @@ void CZeroWallet::GenerateZMintPool(uint32_t nCountStart, uint32_t nCountEnd) {
   uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
   LogPrint(TessaLog::ZKP, "%s : n=%d nStop=%d, diff = %d\n", __func__, n, nStop - 1, nStop - n);
   int64_t nTime_ref = GetTimeMillis();
+  CDBBatch batch(gWalletDB);
   for (uint32_t i = n; i < nStop; ++i) {
-    if (ShutdownRequested()) return;
+    if (ShutdownRequested()) break;
 
     fFound = false;
 
@@ -131,6 +132,7 @@ void CZeroWallet::GenerateZMintPool(uint32_t nCountStart, uint32_t nCountEnd) {
     LogPrint(TessaLog::ZKP, "%s : %s count=%d, time total= %d (ms), this coin time = %d (ms)\n", __func__,
              bnValue.GetHex().substr(0, 6), i, now - nTime_ref, now - nTime_delta);
   }
+  if (!batch.Commit()) LogPrintf("%s: failed to write mint pool\n", __func__);
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without